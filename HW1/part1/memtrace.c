@@ -0,0 +1,277 @@
+//------------------------------------------------------------------------------
+//
+// memtrace
+//
+// trace calls to the dynamic memory manager
+//
+// Calls are printed to stderr as they happen. With MEMTRACE_BIN=<file> in
+// the environment they are recorded in a binary log instead (memblog.h),
+// which costs little enough to trace real programs; mtdecode <file>
+// prints it in the same format afterwards. Blocks never freed are listed
+// after the statistics.
+//
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <memlog.h>
+#include <memlist.h>
+#include <memblog.h>
+
+//
+// function pointers to stdlib's memory management functions
+//
+static void *(*mallocp)(size_t size) = NULL;
+static void (*freep)(void *ptr) = NULL;
+static void *(*callocp)(size_t nmemb, size_t size);
+static void *(*reallocp)(void *ptr, size_t size);
+
+//
+// statistics & other global variables
+//
+static unsigned long n_malloc  = 0;
+static unsigned long n_calloc  = 0;
+static unsigned long n_realloc = 0;
+static unsigned long n_allocb  = 0;
+static unsigned long n_freeb   = 0;
+static memlist *list = NULL;
+
+static int tracing = 0;     // between init and fini
+static int binary = 0;      // recording to the binary log
+
+//
+// dlsym may itself call calloc before we have found the real one: such
+// calls are served from this buffer (and their frees ignored)
+//
+static char boot[4096];
+static size_t boot_used = 0;
+static int resolving = 0;
+
+static void *boot_alloc(size_t size)
+{
+  void *p;
+
+  size = (size + 15) & ~(size_t)15;
+  if (boot_used + size > sizeof(boot)) return NULL;
+  p = boot + boot_used;
+  boot_used += size;
+  return p;
+}
+
+static int is_boot(void *ptr)
+{
+  return ((char*)ptr >= boot) && ((char*)ptr < boot + sizeof(boot));
+}
+
+static void *get_symbol(const char *name)
+{
+  char *error;
+  void *p;
+
+  dlerror();
+  p = dlsym(RTLD_NEXT, name);
+  if (((error = dlerror()) != NULL) || (p == NULL)) {
+    fprintf(stderr, "Error getting symbol '%s': %s\n", name, error);
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+//
+// find stdlib's functions. Allocations may come in before init runs,
+// so this is done on first use.
+//
+static void resolve(void)
+{
+  if (resolving) return;
+  resolving = 1;
+  callocp = get_symbol("calloc");
+  mallocp = get_symbol("malloc");
+  reallocp = get_symbol("realloc");
+  freep = get_symbol("free");
+  resolving = 0;
+}
+
+//
+// init - this function is called once when the shared library is loaded
+//
+__attribute__((constructor))
+void init(void)
+{
+  char *path = getenv(MBLOG_ENV);
+
+  if (mallocp == NULL) resolve();
+
+  if (path != NULL) {
+    if (mblog_open(path) == 0) {
+      binary = 1;
+      return;
+    }
+    fprintf(stderr, "memtrace: cannot open %s, tracing to stderr\n", path);
+  }
+
+  LOG_START();
+
+  // initialize a new list to keep track of all memory (de-)allocations
+  list = new_list();
+
+  tracing = 1;
+}
+
+//
+// leak report: one line per block not freed, after a heading
+//
+static void log_block(item *i)
+{
+  static int n = 0;
+
+  if (n++ == 0) LOG_NONFREED_START();
+  LOG_BLOCK(i->ptr, i->size, i->cnt);
+}
+
+//
+// fini - this function is called once when the shared library is unloaded
+//
+__attribute__((destructor))
+void fini(void)
+{
+  unsigned long n = n_malloc + n_calloc + n_realloc;
+
+  if (binary) {
+    binary = 0;
+    mblog_close();
+    return;
+  }
+  tracing = 0;
+
+  LOG_STATISTICS(n_allocb, n ? n_allocb / n : 0L, n_freeb);
+
+  walk_allocated(list, log_block);
+
+  LOG_STOP();
+
+  // free list
+  free_list(list);
+}
+
+//
+// size of a block being freed, for the statistics
+//
+static void note_free(void *ptr)
+{
+  item *i = find(list, ptr);
+
+  if ((i != NULL) && (i->cnt > 0)) {
+    n_freeb += i->size;
+    dealloc(list, ptr);
+  }
+}
+
+void *malloc(size_t size)
+{
+  void *res;
+
+  if (mallocp == NULL) {
+    if (resolving) return boot_alloc(size);
+    resolve();
+  }
+  res = mallocp(size);
+
+  if (binary) {
+    mblog_add(MB_MALLOC, NULL, res, 0, size, __builtin_return_address(0));
+  } else if (tracing) {
+    n_malloc++;
+    n_allocb += size;
+    alloc(list, res, size);
+    LOG_MALLOC(size, res);
+  }
+  return res;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+  void *res;
+
+  if (callocp == NULL) {
+    if (resolving) return boot_alloc(nmemb * size);   // already zero
+    resolve();
+  }
+  res = callocp(nmemb, size);
+
+  if (binary) {
+    mblog_add(MB_CALLOC, NULL, res, nmemb, size, __builtin_return_address(0));
+  } else if (tracing) {
+    n_calloc++;
+    n_allocb += nmemb * size;
+    alloc(list, res, nmemb * size);
+    LOG_CALLOC(nmemb, size, res);
+  }
+  return res;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+  item *old = NULL;
+  size_t old_size = 0;
+  uint64_t ts = 0;
+  void *res;
+
+  if (reallocp == NULL) resolve();
+  if (is_boot(ptr)) {
+    // not ours to resize: move it to a real block
+    if ((res = mallocp(size)) != NULL)
+      memcpy(res, ptr, size < sizeof(boot) - ((char*)ptr - boot) ?
+                       size : sizeof(boot) - ((char*)ptr - boot));
+    return res;
+  }
+
+  // what ptr was is taken while it is still ours: once reallocp releases
+  // it, another thread may be handed the same address and note it first
+  if (binary) {
+    ts = mblog_time();
+  } else if (tracing && ptr) {
+    if (((old = find(list, ptr)) != NULL) && (old->cnt > 0)) old_size = old->size;
+    else old = NULL;
+  }
+
+  res = reallocp(ptr, size);
+
+  if (binary) {
+    mblog_add_at(ts, MB_REALLOC, ptr, res, 0, size, __builtin_return_address(0));
+  } else if (tracing) {
+    n_realloc++;
+    // on failure (NULL for size > 0) the old block is untouched
+    if ((res != NULL) || (size == 0)) {
+      if (old) {
+        n_freeb += old_size;
+        dealloc(list, ptr);
+      }
+      if (res) {
+        n_allocb += size;
+        alloc(list, res, size);
+      }
+    }
+    LOG_REALLOC(ptr, size, res);
+  }
+  return res;
+}
+
+void free(void *ptr)
+{
+  if ((ptr == NULL) || is_boot(ptr)) return;
+  if (freep == NULL) resolve();
+
+  // noted before the block is released, when no other thread can have
+  // been given its address yet
+  if (binary) {
+    mblog_add(MB_FREE, ptr, NULL, 0, 0, __builtin_return_address(0));
+  } else if (tracing) {
+    note_free(ptr);
+    LOG_FREE(ptr);
+  }
+
+  freep(ptr);
+}
@@ -0,0 +1,238 @@
+//------------------------------------------------------------------------------
+//
+// mtdecode
+//
+// print a binary memtrace log (MEMTRACE_BIN=<file>) in memtrace's text
+// format, statistics and blocks never freed included
+//
+//   usage: mtdecode [-v] <file>
+//
+//   -v         also print each call's time, thread and caller
+//
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <memlog.h>
+#include <memblog.h>
+
+//
+// live blocks (pointer -> size), to total up what was freed
+//
+typedef struct {
+  uint64_t ptr;            // 0: empty
+  uint64_t size;
+} slot;
+
+static slot *table = NULL;
+static size_t cap = 0, used = 0;
+
+static size_t slot_of(uint64_t ptr)
+{
+  size_t i = (ptr >> 4) * 0x9e3779b97f4a7c15ULL & (cap - 1);
+
+  while ((table[i].ptr != 0) && (table[i].ptr != ptr)) i = (i + 1) & (cap - 1);
+  return i;
+}
+
+static void put(uint64_t ptr, uint64_t size)
+{
+  slot *old = table;
+  size_t i, n = cap;
+
+  if (ptr == 0) return;
+  if (2 * (used + 1) > cap) {
+    cap = cap ? 2 * cap : 1024;
+    table = calloc(cap, sizeof(slot));
+    used = 0;
+    for (i = 0; i < n; i++) {
+      if (old[i].ptr != 0) {
+        table[slot_of(old[i].ptr)] = old[i];
+        used++;
+      }
+    }
+    free(old);
+  }
+  i = slot_of(ptr);
+  if (table[i].ptr == 0) used++;
+  table[i].ptr = ptr;
+  table[i].size = size;
+}
+
+// remove ptr, returning its size (0 if unknown)
+static uint64_t take(uint64_t ptr)
+{
+  size_t i, j, k;
+  uint64_t size;
+
+  if ((cap == 0) || (ptr == 0)) return 0;
+  i = slot_of(ptr);
+  if (table[i].ptr == 0) return 0;
+  size = table[i].size;
+
+  // backward-shift deletion keeps the probe chains intact
+  table[i].ptr = 0;
+  used--;
+  for (j = (i + 1) & (cap - 1); table[j].ptr != 0; j = (j + 1) & (cap - 1)) {
+    k = (table[j].ptr >> 4) * 0x9e3779b97f4a7c15ULL & (cap - 1);
+    if (((j > i) && ((k <= i) || (k > j))) || ((j < i) && (k <= i) && (k > j))) {
+      table[i] = table[j];
+      table[j].ptr = 0;
+      i = j;
+    }
+  }
+  return size;
+}
+
+static int by_address(const void *a, const void *b)
+{
+  const slot *x = a, *y = b;
+
+  return x->ptr < y->ptr ? -1 : x->ptr > y->ptr;
+}
+
+//
+// leak report: the blocks still in the table, in address order
+//
+static void log_nonfreed(void)
+{
+  size_t i, k = 0;
+
+  for (i = 0; i < cap; i++) {
+    if (table[i].ptr != 0) table[k++] = table[i];
+  }
+  if (k == 0) return;
+  qsort(table, k, sizeof(slot), by_address);
+
+  LOG_NONFREED_START();
+  for (i = 0; i < k; i++) {
+    LOG_BLOCK((void*)(uintptr_t)table[i].ptr, (size_t)table[i].size, 1);
+  }
+}
+
+//
+// records in time order; ties keep their order in the file, which within
+// one thread is the order of the calls
+//
+typedef struct {
+  mb_record r;
+  size_t idx;
+} entry;
+
+static int by_time(const void *a, const void *b)
+{
+  const entry *x = a, *y = b;
+
+  if (x->r.ts != y->r.ts) return x->r.ts < y->r.ts ? -1 : 1;
+  return x->idx < y->idx ? -1 : x->idx > y->idx;
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned long n_alloc = 0, n_allocb = 0, n_freeb = 0;
+  int verbose = 0, fd, c;
+  const mb_header *h;
+  const char *map;
+  struct stat st;
+  size_t n, i;
+  entry *e;
+
+  while ((c = getopt(argc, argv, "v")) != -1) {
+    if (c == 'v') verbose = 1;
+    else break;
+  }
+  if (optind != argc - 1) {
+    fprintf(stderr, "usage: %s [-v] <file>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (((fd = open(argv[optind], O_RDONLY)) < 0) || (fstat(fd, &st) < 0)) {
+    perror(argv[optind]);
+    return EXIT_FAILURE;
+  }
+  if ((size_t)st.st_size < sizeof(mb_header) ||
+      (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+    fprintf(stderr, "%s: not a memtrace log\n", argv[optind]);
+    return EXIT_FAILURE;
+  }
+  h = (const mb_header*)map;
+  if ((h->magic != MBLOG_MAGIC) || (h->version != MBLOG_VERSION) ||
+      (h->rec_size != sizeof(mb_record))) {
+    fprintf(stderr, "%s: not a memtrace log (or another version)\n", argv[optind]);
+    return EXIT_FAILURE;
+  }
+
+  // a process that did not reach fini leaves its log at the size of the
+  // mapped window, zero-filled past the last record written
+  n = (st.st_size - sizeof(mb_header)) / sizeof(mb_record);
+  while ((n > 0) && (((const mb_record*)(map + sizeof(mb_header)))[n-1].op == 0)) n--;
+  if ((e = malloc((n ? n : 1) * sizeof(entry))) == NULL) {
+    perror("malloc");
+    return EXIT_FAILURE;
+  }
+  for (i = 0; i < n; i++) {
+    memcpy(&e[i].r, map + sizeof(mb_header) + i * sizeof(mb_record), sizeof(mb_record));
+    e[i].idx = i;
+  }
+  qsort(e, n, sizeof(entry), by_time);
+
+  mlog_output(stdout);
+  LOG_START();
+  for (i = 0; i < n; i++) {
+    mb_record *r = &e[i].r;
+    void *ptr = (void*)(uintptr_t)r->ptr, *res = (void*)(uintptr_t)r->res;
+    size_t size = r->size, nmemb = r->nmemb;
+
+    switch (r->op) {
+      case MB_MALLOC:
+        n_alloc++;
+        n_allocb += size;
+        put(r->res, size);
+        if (!verbose) LOG_MALLOC(size, res);
+        else mlog("%9c malloc( %zu ) = %p", ' ', size, res);
+        break;
+      case MB_CALLOC:
+        n_alloc++;
+        n_allocb += nmemb * size;
+        put(r->res, nmemb * size);
+        if (!verbose) LOG_CALLOC(nmemb, size, res);
+        else mlog("%9c calloc( %zu , %zu ) = %p", ' ', nmemb, size, res);
+        break;
+      case MB_REALLOC:
+        n_alloc++;
+        // on failure (NULL for size > 0) the old block is untouched
+        if ((r->res != 0) || (size == 0)) {
+          n_freeb += take(r->ptr);
+          if (r->res != 0) n_allocb += size;
+          put(r->res, size);
+        }
+        if (!verbose) LOG_REALLOC(ptr, size, res);
+        else mlog("%9c realloc( %p , %zu ) = %p", ' ', ptr, size, res);
+        break;
+      case MB_FREE:
+        n_freeb += take(r->ptr);
+        if (!verbose) LOG_FREE(ptr);
+        else mlog("%9c free( %p )", ' ', ptr);
+        break;
+      default:
+        mlog("%9c unknown record (op %u)", ' ', r->op);
+        continue;
+    }
+    if (verbose)
+      printf("%16c%llu.%09llu  tid %u  from %p\n", ' ',
+             (unsigned long long)(r->ts / 1000000000),
+             (unsigned long long)(r->ts % 1000000000),
+             r->tid, (void*)(uintptr_t)r->caller);
+  }
+
+  LOG_STATISTICS(n_allocb, n_alloc ? n_allocb / n_alloc : 0L, n_freeb);
+  log_nonfreed();
+  LOG_STOP();
+
+  free(e);
+  free(table);
+  return EXIT_SUCCESS;
+}
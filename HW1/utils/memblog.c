@@ -0,0 +1,384 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "memblog.h"
+
+//
+// per-thread record buffer
+//
+//   n          records used
+//   tid        owning thread
+//   next       link in the live, full or spare list
+//
+#define MB_RECS    4096
+#define MB_WINDOW  (16UL << 20)   // bytes of the log file mapped at a time
+
+typedef struct __mb_buf {
+  size_t n;
+  uint32_t tid;
+  struct __mb_buf *next;
+  mb_record rec[MB_RECS];
+} mb_buf;
+
+static int logging = 0;                 // records are being taken
+static uint64_t start_ns;
+
+static __thread mb_buf *tbuf = NULL;    // this thread's buffer
+static __thread uint32_t ttid = 0;
+static __thread int twriter = 0;        // the writer thread: not traced
+
+//
+// buffers owned by threads (live), waiting for the writer (full, oldest
+// first) and ready for reuse (spare). Buffers are allocated with mmap,
+// so taking one never calls back into the tracer.
+//
+static mb_buf *live = NULL, *full = NULL, *full_tail = NULL, *spare = NULL;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t have_full = PTHREAD_COND_INITIALIZER;
+static pthread_key_t exit_key;
+static pthread_t writer;
+static int stopping = 0;
+
+//
+// log file, written through a window of MB_WINDOW bytes mapped at win_off
+//
+static char out_path[4096];             // MEMTRACE_BIN, as given
+static int out_fd = -1;
+static char *win = NULL;
+static off_t win_off = 0;
+static size_t win_used = 0;
+static off_t out_len = 0;
+
+static uint64_t now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+//
+// append n bytes to the log file, moving the window along as it fills
+//
+static int out_write(const void *p, size_t n)
+{
+  size_t k;
+
+  while (n > 0) {
+    if ((win == NULL) || (win_used == MB_WINDOW)) {
+      if (win != NULL) {
+        munmap(win, MB_WINDOW);
+        win_off += MB_WINDOW;
+      }
+      win = NULL;
+      if (ftruncate(out_fd, win_off + MB_WINDOW) < 0) return -1;
+      win = mmap(NULL, MB_WINDOW, PROT_READ | PROT_WRITE, MAP_SHARED,
+                 out_fd, win_off);
+      if (win == MAP_FAILED) {
+        win = NULL;
+        return -1;
+      }
+      win_used = 0;
+    }
+    k = n < MB_WINDOW - win_used ? n : MB_WINDOW - win_used;
+    memcpy(win + win_used, p, k);
+    win_used += k;
+    out_len += k;
+    p = (const char*)p + k;
+    n -= k;
+  }
+  return 0;
+}
+
+static void out_buf(mb_buf *b)
+{
+  if ((b->n > 0) && (out_write(b->rec, b->n * sizeof(mb_record)) < 0))
+    logging = 0;
+}
+
+//
+// remove b from the live list. Called with lock held.
+//
+static void unlink_live(mb_buf *b)
+{
+  mb_buf **pp;
+
+  for (pp = &live; *pp != NULL; pp = &(*pp)->next) {
+    if (*pp == b) {
+      *pp = b->next;
+      break;
+    }
+  }
+}
+
+//
+// hand b to the writer. Called with lock held.
+//
+static void queue_full(mb_buf *b)
+{
+  unlink_live(b);
+  b->next = NULL;
+  if (full_tail) full_tail->next = b;
+  else full = b;
+  full_tail = b;
+  pthread_cond_signal(&have_full);
+}
+
+//
+// this thread's buffer is full (or it has none yet): queue it and take
+// another
+//
+static mb_buf *next_buf(mb_buf *old)
+{
+  mb_buf *b;
+
+  pthread_mutex_lock(&lock);
+  if (old) queue_full(old);
+  if ((b = spare) != NULL) {
+    spare = b->next;
+  } else {
+    b = mmap(NULL, sizeof(mb_buf), PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (b == MAP_FAILED) b = NULL;
+  }
+  if (b) {
+    if (ttid == 0) ttid = syscall(SYS_gettid);
+    b->n = 0;
+    b->tid = ttid;
+    b->next = live;
+    live = b;
+  }
+  pthread_mutex_unlock(&lock);
+
+  if (old == NULL) pthread_setspecific(exit_key, (void*)1);
+  tbuf = b;
+  return b;
+}
+
+//
+// a thread is exiting: its records go to the writer
+//
+static void thread_exit(void *arg)
+{
+  (void)arg;
+  if (tbuf == NULL) return;
+  pthread_mutex_lock(&lock);
+  if (!stopping) queue_full(tbuf);
+  pthread_mutex_unlock(&lock);
+  tbuf = NULL;
+}
+
+//
+// writer thread: copy full buffers into the log file, then reuse them
+//
+static void *write_loop(void *arg)
+{
+  mb_buf *b, *next;
+
+  (void)arg;
+  twriter = 1;
+  pthread_mutex_lock(&lock);
+  while (1) {
+    while ((full == NULL) && !stopping)
+      pthread_cond_wait(&have_full, &lock);
+    if (full == NULL) break;
+
+    b = full;
+    full = full_tail = NULL;
+    pthread_mutex_unlock(&lock);
+    for (next = b; next != NULL; next = next->next) out_buf(next);
+    pthread_mutex_lock(&lock);
+
+    for (; b != NULL; b = next) {
+      next = b->next;
+      b->next = spare;
+      spare = b;
+    }
+  }
+  pthread_mutex_unlock(&lock);
+  return NULL;
+}
+
+//
+// open a log file named name (a new one if excl), locked for as long as
+// it is open. Returns the descriptor, or -1 (with errno EWOULDBLOCK if
+// another process has it open).
+//
+static int open_locked(const char *name, int excl)
+{
+  int fd = open(name, O_RDWR | O_CREAT | O_CLOEXEC | (excl ? O_EXCL : 0), 0644);
+
+  if (fd < 0) return -1;
+  if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+//
+// start a log: out_path if no other process is writing it (a parent we
+// were exec'd from, say), else a new file out_path.<pid>, or .<pid>.<n>
+// if that exists (we forked, logged, then exec'd). Then write the header
+// and start the writer thread.
+//
+static int start_log(int own)
+{
+  char name[sizeof(out_path) + 32];
+  mb_header h;
+  int n;
+
+  out_fd = own ? -1 : open_locked(out_path, 0);
+  if ((out_fd < 0) && (own || (errno == EWOULDBLOCK))) {
+    snprintf(name, sizeof(name), "%s.%d", out_path, (int)getpid());
+    for (n = 1; ((out_fd = open_locked(name, 1)) < 0) && (errno == EEXIST) && (n < 100); n++)
+      snprintf(name, sizeof(name), "%s.%d.%d", out_path, (int)getpid(), n);
+  }
+  if (out_fd < 0) return -1;
+
+  win = NULL;
+  win_off = 0;
+  win_used = 0;
+  out_len = 0;
+  stopping = 0;
+  h.magic = MBLOG_MAGIC;
+  h.version = MBLOG_VERSION;
+  h.rec_size = sizeof(mb_record);
+  h.pid = getpid();
+  if ((ftruncate(out_fd, 0) < 0) || (out_write(&h, sizeof(h)) < 0) ||
+      (pthread_create(&writer, NULL, write_loop, NULL) != 0)) {
+    if (win) munmap(win, MB_WINDOW);
+    win = NULL;
+    close(out_fd);
+    out_fd = -1;
+    return -1;
+  }
+
+  start_ns = now();
+  logging = 1;
+  return 0;
+}
+
+//
+// fork: keep the lists consistent across it. The child has none of our
+// threads and must not write our file, so it drops what it inherited
+// and starts a log of its own.
+//
+static void fork_prepare(void)
+{
+  pthread_mutex_lock(&lock);
+}
+
+static void fork_parent(void)
+{
+  pthread_mutex_unlock(&lock);
+}
+
+static void fork_child(void)
+{
+  mb_buf *b;
+
+  logging = 0;
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&have_full, NULL);
+  if (out_fd < 0) return;
+
+  // the parent's records: the buffers are ours to reuse
+  while ((b = live) != NULL) {
+    live = b->next;
+    b->next = spare;
+    spare = b;
+  }
+  while ((b = full) != NULL) {
+    full = b->next;
+    b->next = spare;
+    spare = b;
+  }
+  full_tail = NULL;
+  tbuf = NULL;
+  ttid = 0;
+
+  if (win) munmap(win, MB_WINDOW);
+  win = NULL;
+  close(out_fd);
+  out_fd = -1;
+  start_log(1);
+}
+
+int mblog_open(const char *path)
+{
+  if (strlen(path) >= sizeof(out_path)) return -1;
+  strcpy(out_path, path);
+
+  if ((pthread_key_create(&exit_key, thread_exit) != 0) ||
+      (pthread_atfork(fork_prepare, fork_parent, fork_child) != 0))
+    return -1;
+  return start_log(0);
+}
+
+uint64_t mblog_time(void)
+{
+  return now() - start_ns;
+}
+
+void mblog_add(int op, void *ptr, void *res, size_t nmemb, size_t size,
+               void *caller)
+{
+  if (logging) mblog_add_at(mblog_time(), op, ptr, res, nmemb, size, caller);
+}
+
+void mblog_add_at(uint64_t ts, int op, void *ptr, void *res, size_t nmemb,
+                  size_t size, void *caller)
+{
+  mb_buf *b = tbuf;
+  mb_record *r;
+
+  if (!logging || twriter) return;
+  if ((b == NULL) || (b->n == MB_RECS)) {
+    if ((b = next_buf(b)) == NULL) return;
+  }
+
+  r = &b->rec[b->n];
+  r->ts = ts;
+  r->ptr = (uintptr_t)ptr;
+  r->res = (uintptr_t)res;
+  r->nmemb = nmemb;
+  r->size = size;
+  r->caller = (uintptr_t)caller;
+  r->op = op;
+  r->tid = b->tid;
+  b->n++;
+}
+
+void mblog_close(void)
+{
+  mb_buf *b;
+
+  if (out_fd < 0) return;
+
+  // stop taking records, let the writer finish the full buffers
+  logging = 0;
+  pthread_mutex_lock(&lock);
+  stopping = 1;
+  pthread_cond_signal(&have_full);
+  pthread_mutex_unlock(&lock);
+  pthread_join(writer, NULL);
+
+  // then the buffers still owned by threads
+  for (b = live; b != NULL; b = b->next) out_buf(b);
+
+  if (win) munmap(win, MB_WINDOW);
+  if (ftruncate(out_fd, out_len) < 0) { /* the log is still readable */ }
+  close(out_fd);
+  out_fd = -1;
+}
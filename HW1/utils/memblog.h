@@ -0,0 +1,80 @@
+#ifndef __MEMBLOG_H__
+#define __MEMBLOG_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// binary event log
+//
+// With MEMTRACE_BIN=<file> in the environment, memtrace records each call
+// as a fixed-size record instead of printing it. Every thread appends to
+// a buffer of its own; full buffers are handed to a background thread
+// that copies them into the log file through a shared mapping, and what
+// is left is written at fini. mtdecode prints a log in memtrace's text
+// format.
+//
+// A process writes <file> unless another process is writing it (one it
+// was exec'd from), and then a new <file>.<pid>. A child that forks
+// drops what it inherited and writes a new <file>.<pid> too (.<pid>.<n>
+// if that exists). Records a child takes between fork and exec are lost
+// unless a buffer of them filled: exec runs no fini.
+//
+// Log file: one mb_header, then mb_records, grouped by thread and in
+// order within each thread. Sort by ts for the global order. A process
+// that dies before fini leaves zeroed records after the last one written
+// (and loses what its threads had not handed over).
+//
+
+#define MBLOG_ENV       "MEMTRACE_BIN"
+#define MBLOG_MAGIC     0x4352544d      // "MTRC"
+#define MBLOG_VERSION   1
+
+enum { MB_MALLOC = 1, MB_CALLOC, MB_REALLOC, MB_FREE };
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t rec_size;       // sizeof(mb_record)
+  uint32_t pid;
+} mb_header;
+
+typedef struct {
+  uint64_t ts;             // nanoseconds since the log was opened
+  uint64_t ptr;            // pointer argument (realloc, free)
+  uint64_t res;            // result (malloc, calloc, realloc)
+  uint64_t nmemb;          // calloc
+  uint64_t size;
+  uint64_t caller;         // return address of the call
+  uint32_t op;             // MB_*
+  uint32_t tid;
+} mb_record;
+
+//
+// open the log file and start the writer thread
+//
+// returns 0 on success, -1 on error (nothing will be logged)
+//
+int mblog_open(const char *path);
+
+//
+// record one call (from any thread)
+//
+void mblog_add(int op, void *ptr, void *res, size_t nmemb, size_t size,
+               void *caller);
+
+//
+// the same, for a call that began at ts (from mblog_time). A call that
+// releases a block (realloc) is stamped before it does, so it sorts
+// before whatever another thread does with the address next.
+//
+uint64_t mblog_time(void);
+void mblog_add_at(uint64_t ts, int op, void *ptr, void *res, size_t nmemb,
+                  size_t size, void *caller);
+
+//
+// write out all buffers and close the log
+//
+void mblog_close(void);
+
+#endif
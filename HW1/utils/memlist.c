@@ -0,0 +1,271 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "memlist.h"
+
+//
+// sizes
+//
+//   ML_SHARDS     shards of the table (a power of two)
+//   ML_SLOTS      initial slots per shard (a power of two)
+//   ML_SLAB       bytes of items mapped at a time
+//
+#define ML_SHARDS  64
+#define ML_SLOTS   512
+#define ML_SLAB    (64 * 1024)
+
+//
+// a block of items handed out one by one
+//
+typedef struct __slab {
+  struct __slab *next;
+  size_t used;
+  item items[];
+} slab;
+
+#define SLAB_ITEMS ((ML_SLAB - sizeof(slab)) / sizeof(item))
+
+//
+// one shard: an open-addressing table of items (linear probing, at most
+// half full) and the slabs its items come from
+//
+typedef struct {
+  pthread_mutex_t lock;
+  item **slot;
+  size_t cap;
+  size_t n;
+  slab *slabs;
+} __attribute__((aligned(64))) shard;
+
+struct __memlist {
+  shard s[ML_SHARDS];
+};
+
+static void *map(size_t size)
+{
+  void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "Error mapping %zu bytes for the block list\n", size);
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+static uint64_t hash(void *ptr)
+{
+  uint64_t h = ((uintptr_t)ptr >> 4) * 0x9e3779b97f4a7c15ULL;
+
+  return h ^ (h >> 32);
+}
+
+static shard *shard_of(memlist *list, uint64_t h)
+{
+  return &list->s[h & (ML_SHARDS - 1)];
+}
+
+//
+// slot holding ptr, or the empty slot where it would go
+//
+static item **lookup(shard *s, void *ptr, uint64_t h)
+{
+  size_t i = (h / ML_SHARDS) & (s->cap - 1);
+
+  while ((s->slot[i] != NULL) && (s->slot[i]->ptr != ptr)) i = (i + 1) & (s->cap - 1);
+  return &s->slot[i];
+}
+
+static void grow(shard *s)
+{
+  item **old = s->slot;
+  size_t i, n = s->cap;
+
+  s->cap = 2 * n;
+  s->slot = map(s->cap * sizeof(item*));
+  for (i = 0; i < n; i++) {
+    if (old[i] != NULL) *lookup(s, old[i]->ptr, hash(old[i]->ptr)) = old[i];
+  }
+  munmap(old, n * sizeof(item*));
+}
+
+static item *new_item(shard *s)
+{
+  slab *b = s->slabs;
+
+  if ((b == NULL) || (b->used == SLAB_ITEMS)) {
+    b = map(ML_SLAB);
+    b->next = s->slabs;
+    s->slabs = b;
+  }
+  return &b->items[b->used++];
+}
+
+memlist *new_list(void)
+{
+  // since we are tracing memory (de-)allocations we cannot use
+  // malloc/free for the list: everything it needs is mapped directly.
+  memlist *list = map(sizeof(memlist));
+  int i;
+
+  for (i = 0; i < ML_SHARDS; i++) {
+    pthread_mutex_init(&list->s[i].lock, NULL);
+    list->s[i].cap = ML_SLOTS;
+    list->s[i].slot = map(ML_SLOTS * sizeof(item*));
+  }
+  return list;
+}
+
+void free_list(memlist *list)
+{
+  slab *b, *next;
+  int i;
+
+  if (list == NULL) return;
+
+  for (i = 0; i < ML_SHARDS; i++) {
+    for (b = list->s[i].slabs; b != NULL; b = next) {
+      next = b->next;
+      munmap(b, ML_SLAB);
+    }
+    munmap(list->s[i].slot, list->s[i].cap * sizeof(item*));
+    pthread_mutex_destroy(&list->s[i].lock);
+  }
+  munmap(list, sizeof(memlist));
+}
+
+item *alloc(memlist *list, void *ptr, size_t size)
+{
+  uint64_t h = hash(ptr);
+  item **p, *i;
+  shard *s;
+
+  if (list == NULL) return NULL;
+  s = shard_of(list, h);
+
+  pthread_mutex_lock(&s->lock);
+  p = lookup(s, ptr, h);
+  if ((i = *p) != NULL) {
+    // existing block -> update size & reference counter
+    i->size = size;
+    i->cnt++;
+  } else {
+    // new block -> insert into table
+    i = new_item(s);
+    i->ptr = ptr;
+    i->size = size;
+    i->cnt = 1;
+    *p = i;
+    if (2 * ++s->n > s->cap) grow(s);
+  }
+  pthread_mutex_unlock(&s->lock);
+
+  return i;
+}
+
+item *dealloc(memlist *list, void *ptr)
+{
+  uint64_t h = hash(ptr);
+  item *i;
+  shard *s;
+
+  if (list == NULL) return NULL;
+  s = shard_of(list, h);
+
+  // decrement reference count if found
+  pthread_mutex_lock(&s->lock);
+  if ((i = *lookup(s, ptr, h)) != NULL) i->cnt--;
+  pthread_mutex_unlock(&s->lock);
+
+  return i;
+}
+
+item *find(memlist *list, void *ptr)
+{
+  uint64_t h = hash(ptr);
+  item *i;
+  shard *s;
+
+  if (list == NULL) return NULL;
+  s = shard_of(list, h);
+
+  pthread_mutex_lock(&s->lock);
+  i = *lookup(s, ptr, h);
+  pthread_mutex_unlock(&s->lock);
+
+  return i;
+}
+
+static int by_address(const void *a, const void *b)
+{
+  void *x = (*(item* const*)a)->ptr, *y = (*(item* const*)b)->ptr;
+
+  return x < y ? -1 : x > y;
+}
+
+//
+// the items in address order (all, or only those with cnt > 0): *n
+// items in an array of *len bytes, to be unmapped by the caller
+//
+static item **collect(memlist *list, int allocated, size_t *n, size_t *len)
+{
+  item **all, *it;
+  size_t i, k = 0;
+  int j;
+
+  for (j = 0; j < ML_SHARDS; j++) pthread_mutex_lock(&list->s[j].lock);
+
+  for (j = 0; j < ML_SHARDS; j++) k += list->s[j].n;
+  *len = (k ? k : 1) * sizeof(item*);
+  all = map(*len);
+
+  k = 0;
+  for (j = 0; j < ML_SHARDS; j++) {
+    for (i = 0; i < list->s[j].cap; i++) {
+      it = list->s[j].slot[i];
+      if ((it != NULL) && (!allocated || (it->cnt > 0))) all[k++] = it;
+    }
+  }
+
+  for (j = 0; j < ML_SHARDS; j++) pthread_mutex_unlock(&list->s[j].lock);
+
+  qsort(all, k, sizeof(item*), by_address);
+  *n = k;
+  return all;
+}
+
+int walk_allocated(memlist *list, void (*fn)(item *i))
+{
+  item **all;
+  size_t i, n, len;
+
+  if (list == NULL) return 0;
+
+  all = collect(list, 1, &n, &len);
+  for (i = 0; i < n; i++) fn(all[i]);
+  munmap(all, len);
+
+  return n;
+}
+
+void dump_list(memlist *list)
+{
+  assert(list != NULL);
+  item **all;
+  size_t i, n, len;
+
+  all = collect(list, 0, &n, &len);
+
+  printf("  %-16s   %-8s   %-3s\n",
+      "block", "size", "cnt");
+  for (i = 0; i < n; i++) {
+    printf("  %-16p   %-8zd   %-3d\n",
+        all[i]->ptr, all[i]->size, all[i]->cnt);
+  }
+  munmap(all, len);
+}
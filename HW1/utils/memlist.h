@@ -0,0 +1,101 @@
+#ifndef __MEMLIST_H__
+#define __MEMLIST_H__
+
+#include <stddef.h>
+
+//
+// element holding information about an allocated memory block
+//
+//   ptr        pointer to block
+//   size       size of block
+//   cnt        allocate count
+//
+typedef struct __item {
+  void *ptr;
+  size_t size;
+  int cnt;
+} item;
+
+//
+// the blocks of a traced program, in a hash table keyed by pointer
+//
+// The table is split into shards, each with its own lock, so threads
+// allocating at the same time rarely wait for each other. Items and
+// tables are taken from memory mapped for the purpose: the list never
+// calls malloc, and so never calls back into the tracer.
+//
+// An item stays in the table once its block is freed (with cnt 0), as in
+// the handout's linked list: it is reused if the block is allocated again.
+//
+typedef struct __memlist memlist;
+
+
+//
+// initialize a new list
+//
+memlist *new_list(void);
+
+//
+// free a list
+//
+void free_list(memlist *list);
+
+//
+// add information about newly allocated block to list
+//
+//
+//   list       pointer to list
+//   ptr        pointer to newly allocated block
+//   size       size of newly allocated block
+//
+// returns
+//    item*     pointer to item holding information about the block
+//
+// the reference count is updated automatically. If the block is re-allocated
+// (i.e., there already is an item to ptr) the size of the item is adjusted.
+//
+item *alloc(memlist *list, void *ptr, size_t size);
+
+//
+// update information on freed block
+//
+//    list      pointer to list
+//    ptr       pointer to freed block
+//
+// returns
+//    item*     pointer to item holding information about freed block
+//
+// the reference count is updated automatically
+//
+item *dealloc(memlist *list, void *ptr);
+
+//
+// find information about a block in list
+//
+//   list       pointer to list
+//   ptr        pointer of block
+//
+// returns
+//    item*     pointer to item holding information about the block
+//
+item *find(memlist *list, void *ptr);
+
+//
+// call fn for each block not deallocated (cnt > 0), in address order
+//
+//   list       pointer to list
+//   fn         function to call
+//
+// returns
+//    int       number of blocks
+//
+int walk_allocated(memlist *list, void (*fn)(item *i));
+
+//
+// dump (print) the list in human-readable form to stdout
+//
+//   list       pointer to list
+//
+void dump_list(memlist *list);
+
+#endif
@@ -0,0 +1,27 @@
+#include <stdarg.h>
+#include <stdio.h>
+
+static FILE *out = NULL;
+
+void mlog_output(FILE *f)
+{
+  out = f;
+}
+
+int mlog(const char *fmt, ...)
+{
+  static unsigned int id = 1;
+  FILE *f = out ? out : stderr;
+  va_list ap;
+  int res;
+
+  res = fprintf(f, "[%04u] ", id++);
+
+  va_start(ap, fmt);
+  res += vfprintf(f, fmt, ap);
+  va_end(ap);
+
+  fprintf(f, "\n");
+
+  return res;
+}
@@ -3,6 +3,7 @@
  * 
  * 2017-15108
  */
+#define _GNU_SOURCE         /* splice, tee */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -11,13 +12,26 @@
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <time.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <spawn.h>
 
 /* Misc manifest constants */
 #define MAXLINE    1024   /* max line size */
 #define MAXARGS     128   /* max args on a command line */
 #define MAXJOBS      16   /* max jobs at any point in time */
 #define MAXJID    1<<16   /* max job ID */
+#define MAXSTAGES    16   /* max commands in a pipeline */
+#define MAXREDIRS    16   /* max redirections per command */
+#define SPLICE_LEN  (1<<16) /* bytes moved per splice/tee call */
+#define HASHSIZE     64   /* buckets in the PATH lookup cache */
+#define RINGSIZE   1024   /* signal events queued (power of 2) */
 
 /* Job states */
 #define UNDEF 0 /* undefined */
@@ -25,6 +39,16 @@
 #define BG 2    /* running in background */
 #define ST 3    /* stopped */
 
+/* Signal event types */
+#define EV_CHLD 0 /* a child exited, was killed or stopped */
+#define EV_SIG  1 /* ctrl-c/ctrl-z to forward to the fg job */
+
+/* Redirection operators */
+#define R_IN      0 /* < file */
+#define R_OUT     1 /* > file */
+#define R_APPEND  2 /* >> file */
+#define R_ERR2OUT 3 /* 2>&1 */
+
 /* 
  * Jobs states: FG (foreground), BG (background), ST (stopped)
  * Job state transitions and enabling actions:
@@ -39,6 +63,7 @@
 extern char **environ;      /* defined in libc */
 char prompt[] = "tsh> ";    /* command line prompt (DO NOT CHANGE) */
 int verbose = 0;            /* if true, print additional output */
+int forkexec = 0;           /* if true, launch with fork+execve */
 int nextjid = 1;            /* next job ID to allocate */
 char sbuf[MAXLINE];         /* for composing sprintf messages */
 
@@ -47,8 +72,65 @@ struct job_t {              /* The job struct */
     int jid;                /* job ID [1, 2, ...] */
     int state;              /* UNDEF, BG, FG, or ST */
     char cmdline[MAXLINE];  /* command line */
+    int nprocs;             /* processes in the job (pipeline stages) */
+    int nlive;              /* processes not reaped yet */
+    int termsig;            /* first signal that killed a process, or 0 */
+    pid_t procs[MAXSTAGES]; /* member PIDs; procs[0] == pid == PGID */
+    int status;             /* wait status of the last stage */
+    struct rusage ru;       /* resources used by the reaped processes */
+    int batch;              /* index in batch[] (-j/-f mode), or -1 */
+    int timed;              /* started with the time prefix? */
+    struct timespec start;  /* when the job was started */
 };
 struct job_t jobs[MAXJOBS]; /* The job list */
+
+struct batch_t {            /* One command of a batch run (-j/-f) */
+    char cmdline[MAXLINE];  /* command line */
+    int started;            /* was a job started for it? */
+    struct timespec start;  /* when the job was started */
+    struct timespec end;    /* when its last process was reaped */
+    int status;             /* wait status of the last stage */
+    struct rusage ru;       /* summed over all stages */
+};
+struct batch_t *batch;      /* The batch command list */
+int nbatch = 0;             /* number of batch commands */
+int batchlive = 0;          /* batch jobs not finished yet */
+
+struct event_t {            /* One record from a signal handler */
+    int type;               /* EV_CHLD or EV_SIG */
+    pid_t pid;              /* child reaped (EV_CHLD) */
+    int status;             /* its wait status, or the signal (EV_SIG) */
+    struct rusage ru;       /* its resource usage (EV_CHLD) */
+};
+/*
+ * Single-producer/single-consumer ring. The handlers are the producer
+ * (they block each other, see Signal) and the main program the
+ * consumer; evhead/evtail only ever increase.
+ */
+struct event_t ring[RINGSIZE];
+atomic_uint evhead;         /* next slot the handlers fill */
+atomic_uint evtail;         /* next slot the main program reads */
+volatile sig_atomic_t evfull = 0; /* handler left children unreaped */
+int selfpipe[2];            /* handlers write a byte here to wake poll */
+
+struct redir_t {            /* One redirection of a command */
+    int op;                 /* R_IN, R_OUT, R_APPEND or R_ERR2OUT */
+    char *path;             /* target file (NULL for R_ERR2OUT) */
+};
+
+struct cmd_t {              /* One stage of a pipeline */
+    char *argv[MAXARGS];    /* NULL-terminated argument list */
+    int nredirs;            /* number of redirections */
+    struct redir_t redirs[MAXREDIRS]; /* applied in command line order */
+};
+
+struct hash_t {             /* One PATH lookup cache entry */
+    char *name;             /* command name as typed */
+    char *path;             /* full path found on PATH */
+    int hits;               /* lookups served from the cache */
+    struct hash_t *next;    /* next entry in the bucket */
+};
+struct hash_t *pathcache[HASHSIZE]; /* The PATH lookup cache */
 /* End global variables */
 
 
@@ -56,13 +138,33 @@ struct job_t jobs[MAXJOBS]; /* The job list */
 
 /* Here are the functions that you will implement */
 void eval(char *cmdline);
+pid_t startjob(struct cmd_t *cmds, int ncmds, int state, char *cmdline, int idx);
+void runbatch(char *file, int njobs);
+void batchsummary(int njobs, struct timespec *start, struct timespec *end);
 int builtin_cmd(char **argv);
 void do_bgfg(char **argv);
 void waitfg(pid_t pid);
+int readcmd(char *cmdline);
+void drainevents(void);
+void jobevent(struct event_t *ev);
+void eventmask(sigset_t *set);
 
 void sigchld_handler(int sig);
 void sigtstp_handler(int sig);
 void sigint_handler(int sig);
+void reapchildren(void);
+void pushsig(int sig);
+
+int parsepipe(char **argv, struct cmd_t *cmds);
+void runstage(struct cmd_t *cmd, char *path);
+pid_t spawnstage(struct cmd_t *cmd, char *path, pid_t pgid, int infd, int *fds);
+int redirect(struct cmd_t *cmd);
+int isbuiltin_stage(char **argv);
+int builtin_stage(char **argv);
+void do_hash(char **argv);
+
+char *findcmd(char *name);
+void clearhash(void);
 
 /* Here are helper routines that we've provided for you */
 int parseline(const char *cmdline, char **argv); 
@@ -71,13 +173,19 @@ void sigquit_handler(int sig);
 void clearjob(struct job_t *job);
 void initjobs(struct job_t *jobs);
 int maxjid(struct job_t *jobs); 
-int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline);
+int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline,
+           struct timespec *start);
 int deletejob(struct job_t *jobs, pid_t pid); 
+int addproc(struct job_t *job, pid_t pid);
+void addrusage(struct rusage *sum, struct rusage *ru);
 pid_t fgpid(struct job_t *jobs);
 struct job_t *getjobpid(struct job_t *jobs, pid_t pid);
 struct job_t *getjobjid(struct job_t *jobs, int jid); 
+struct job_t *getjobproc(struct job_t *jobs, pid_t pid);
 int pid2jid(pid_t pid); 
 void listjobs(struct job_t *jobs);
+void listjobs_long(struct job_t *jobs);
+void printtimes(struct job_t *job);
 
 void usage(void);
 void unix_error(char *msg);
@@ -93,13 +201,15 @@ int main(int argc, char **argv)
     char c;
     char cmdline[MAXLINE];
     int emit_prompt = 1; /* emit prompt (default) */
+    char *batchfile = NULL; /* command list to run in batch mode */
+    int njobs = 0; /* batch slots; 0: one per CPU, at most MAXJOBS */
 
     /* Redirect stderr to stdout (so that driver will get all output
      * on the pipe connected to stdout) */
     dup2(1, 2);
 
     /* Parse the command line */
-    while ((c = getopt(argc, argv, "hvp")) != EOF) {
+    while ((c = getopt(argc, argv, "hvpFj:f:")) != EOF) {
         switch (c) {
         case 'h':             /* print help message */
             usage();
@@ -110,6 +220,19 @@ int main(int argc, char **argv)
         case 'p':             /* don't print a prompt */
             emit_prompt = 0;  /* handy for automatic testing */
 	    break;
+        case 'F':             /* launch with fork+execve, not posix_spawn */
+            forkexec = 1;
+	    break;
+        case 'j':             /* run up to <n> batch jobs at once */
+            njobs = atoi(optarg);
+            if (njobs < 1 || njobs > MAXJOBS) {
+                printf("-j must be between 1 and %d\n", MAXJOBS);
+                exit(1);
+            }
+	    break;
+        case 'f':             /* run the commands in <file> as a batch */
+            batchfile = optarg;
+	    break;
 	default:
             usage();
 	}
@@ -128,6 +251,21 @@ int main(int argc, char **argv)
     /* Initialize the job list */
     initjobs(jobs);
 
+    /* The signal handlers wake the main program through this pipe */
+    if (pipe2(selfpipe, O_NONBLOCK | O_CLOEXEC) < 0)
+	unix_error("pipe error");
+
+    /* Batch mode: run the command file and exit */
+    if (batchfile != NULL) {
+	if (njobs == 0) {
+	    njobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	    njobs = njobs < 1 ? 1 : njobs > MAXJOBS ? MAXJOBS : njobs;
+	}
+	runbatch(batchfile, njobs);
+	fflush(stdout);
+	exit(0);
+    }
+
     /* Execute the shell's read/eval loop */
     while (1) {
 
@@ -136,9 +274,7 @@ int main(int argc, char **argv)
         printf("%s", prompt);
 	    fflush(stdout);
 	}
-	if ((fgets(cmdline, MAXLINE, stdin) == NULL) && ferror(stdin))
-	    app_error("fgets error");
-	if (feof(stdin)) { /* End of file (ctrl-d) */
+	if (!readcmd(cmdline)) { /* End of file (ctrl-d) */
 	    fflush(stdout);
 	    exit(0);
 	}
@@ -154,64 +290,485 @@ int main(int argc, char **argv)
 /* 
  * eval - Evaluate the command line that the user has just typed in
  * 
- * If the user has requested a built-in command (quit, jobs, bg or fg)
- * then execute it immediately. Otherwise, fork a child process and
- * run the job in the context of the child. If the job is running in
- * the foreground, wait for it to terminate and then return.  Note:
- * each child process must have a unique process group ID so that our
- * background children don't receive SIGINT (SIGTSTP) from the kernel
- * when we type ctrl-c (ctrl-z) at the keyboard.  
+ * If the user has requested a built-in command (quit, jobs, bg, fg or
+ * hash) then execute it immediately. Otherwise, start the pipeline as
+ * a job (see startjob). If the job is running in the foreground, wait
+ * for it to terminate and then return.
 */
 void eval(char *cmdline) 
 {
     // 0. Local Variable
     char* argv[MAXARGS];     /* holds arguments of command line */
+    struct cmd_t cmds[MAXSTAGES]; /* pipeline stages */
+    int ncmds;               /* number of stages */
     int bg;                  /* background job? */
-    sigset_t blocked;        /* blocked signals */
-    pid_t pid;               /* process id */
+    int timed = 0;           /* "time" prefix? */
+    pid_t pgid;              /* process group of the job */
+    struct job_t *obj;
+    int i;
 
     // 1. Parse & Check cmd
     bg = parseline(cmdline, argv);
     if(bg == 1 && argv[0] == NULL) return; // blank line인 경우 종료
+    if(strcmp(argv[0], "time") == 0){
+        // "time cmd ..." - report the job's resources when it is done
+        for(i = 0; argv[i] != NULL; i++) argv[i] = argv[i+1];
+        if(argv[0] == NULL) return;
+        timed = 1;
+    }
     if(builtin_cmd(argv)) return; // builtin_cmd인 경우 command 실행
+    if((ncmds = parsepipe(argv, cmds)) == 0) return; // syntax error
+
+    // 2. Start the job
+    if((pgid = startjob(cmds, ncmds, bg ? BG : FG, cmdline, -1)) == 0) return;
+    if(timed && (obj = getjobpid(jobs, pgid)) != NULL) obj->timed = 1;
+
+    // 3. (if fg) wait, (if bg) print log message
+    if(!bg){  /* parent waits for fg job to terminate */
+        waitfg(pgid);
+    } else{   /* otherwise, don't wait for bg job */
+        printf("[%d] (%d) %s", pid2jid(pgid), (int) pgid, cmdline);
+    }
+}
+
+/*
+ * startjob - Start a child process for every stage of the pipeline and
+ *    add them to the job list as one job in the given state. External
+ *    commands are looked up through the PATH cache and launched with
+ *    posix_spawn; built-in stages (and every stage with -F) are forked.
+ *    Note: each job must have a unique process group ID so that our
+ *    background children don't receive SIGINT (SIGTSTP) from the
+ *    kernel when we type ctrl-c (ctrl-z) at the keyboard. All stages of
+ *    a pipeline share the first stage's group. idx is the job's index
+ *    in batch[], or -1. Returns the job's PID (== PGID), or 0 if no
+ *    stage could be started.
+ */
+pid_t startjob(struct cmd_t *cmds, int ncmds, int state, char *cmdline, int idx)
+{
+    // 0. Local Variable
+    pid_t pids[MAXSTAGES];   /* process id of each started stage */
+    int nprocs = 0;          /* number of stages started */
+    char *path;              /* resolved program of a stage */
+    sigset_t blocked;        /* blocked signals */
+    pid_t pid;               /* process id */
+    pid_t pgid = 0;          /* process group of the job */
+    int fds[2];              /* pipe from this stage to the next */
+    int infd = -1;           /* read end feeding this stage */
+    struct job_t *obj;
+    struct timespec start;   /* before the first stage is launched */
+    int i;
     
-    // 2. Block SIGCHLD Signal
+    // 1. Block SIGCHLD Signal
     if(sigemptyset(&blocked) == -1) app_error("sigemptyset error"); // init
     if(sigaddset(&blocked, SIGCHLD) == -1) app_error("sigaddset error"); // add
     if(sigprocmask(SIG_BLOCK, &blocked, NULL) == -1) app_error("sigprocmask error"); // block
 
-    // Loads and runs in the context of an initial child process
-    // 3. Create Child Process
-    pid = fork();
+    // Loads and runs each stage in the context of its own child process
+    // 2. Create Child Processes
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(i = 0; i < ncmds; i++){
+        fds[0] = fds[1] = -1;
+        if(i < ncmds - 1 && pipe(fds) == -1) unix_error("pipe error");
+
+        // 2.0 Resolve the program through the PATH cache
+        path = cmds[i].argv[0] == NULL ? NULL : findcmd(cmds[i].argv[0]);
+
+        if(!forkexec && path != NULL && !isbuiltin_stage(cmds[i].argv)){
+            // 2.1' Launch without copying the shell (0 if it failed)
+            pid = spawnstage(&cmds[i], path, pgid, infd, fds);
+        } else if((pid = fork()) == -1){
+            unix_error("fork error");
+        } else if(pid == 0){
+            /* Child Process */
+            // 2.1 1) Unblock signal
+            if(sigprocmask(SIG_UNBLOCK, &blocked, NULL) == -1) app_error("sigprocmask Error");
+
+            // 2.1 2) Get new process group ID (or join the first stage's)
+            if(setpgid(0, pgid) == -1) app_error("setpgid Error");
+
+            // 2.1 3) Connect the pipes to stdin/stdout
+            if(infd != -1){
+                dup2(infd, 0);
+                close(infd);
+            }
+            if(fds[1] != -1){
+                dup2(fds[1], 1);
+                close(fds[1]);
+                close(fds[0]);
+            }
+
+            // 2.1 4) Load & run new program
+            runstage(&cmds[i], path);
+        }
+
+        /* Parent Process */
+        // 2.2 1) Put the child in the job's group from this side as well,
+        //        so later stages never race the leader's setpgid
+        if(pid > 0){
+            if(pgid == 0) pgid = pid;
+            setpgid(pid, pgid);
+            pids[nprocs++] = pid;
+        }
+
+        // 2.2 2) Keep only the read end that feeds the next stage
+        if(infd != -1) close(infd);
+        if(fds[1] != -1) close(fds[1]);
+        infd = fds[0];
+    }
+
+    // 3. Addjob (one job for the whole pipeline), then unblock signal
+    if(nprocs > 0) addjob(jobs, pgid, state, cmdline, &start);
+    if((obj = getjobpid(jobs, pgid)) != NULL){
+        for(i = 1; i < nprocs; i++)
+            addproc(obj, pids[i]);
+        obj->batch = idx;
+    }
+    if(sigprocmask(SIG_UNBLOCK, &blocked, NULL) == -1) app_error("SIG_UNBLOCK Error");
+
+    return nprocs > 0 ? pgid : 0;
+}
+
+/*
+ * runbatch - Run every line of file as a background job, keeping up to
+ *    njobs of them in the job list at once. The SIGCHLD handler wakes
+ *    the sigsuspend below when a child is reaped; once drainevents
+ *    sees a job's last process go it frees the slot, and the next
+ *    command starts right away. Prints a
+ *    per-job report and the makespan when all jobs have finished.
+ */
+void runbatch(char *file, int njobs)
+{
+    // 0. Local Variable
+    char line[MAXLINE];
+    char *argv[MAXARGS];
+    struct cmd_t cmds[MAXSTAGES];
+    int ncmds, size = 0, i;
+    struct batch_t *b;
+    struct timespec start, end;
+    sigset_t blocked, prev;
+    FILE *fp;
+
+    // 1. Read the command list
+    if((fp = fopen(file, "r")) == NULL) unix_error(file);
+    while(fgets(line, MAXLINE, fp) != NULL){
+        if(parseline(line, argv) == 1 && argv[0] == NULL) continue; // blank line
+        if(nbatch == size){
+            size = size ? size * 2 : 64;
+            if((batch = realloc(batch, size * sizeof(struct batch_t))) == NULL)
+                unix_error("realloc error");
+        }
+        b = &batch[nbatch++];
+        memset(b, 0, sizeof(*b));
+        strcpy(b->cmdline, line);
+        if(b->cmdline[strlen(b->cmdline)-1] != '\n') strcat(b->cmdline, "\n");
+    }
+    fclose(fp);
 
-    if(pid == 0){
-        /* Child Process */
-        // 3.1 1) Unblock signal
-        if(sigprocmask(SIG_UNBLOCK, &blocked, NULL) == -1) app_error("sigprocmask Error");
+    eventmask(&blocked);
 
-        // 3.1 2) Get new process group ID
-        if(setpgid(0, 0) == -1) app_error("setpgid Error");
+    // 2. Start each command as soon as a slot is free
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(i = 0; i < nbatch; i++){
+        b = &batch[i];
 
-        // 3.1 3) Load & run new program
-        if(execve(argv[0], argv, environ) < 0){
-            printf("%s: Command not found\n", argv[0]);
-            exit(0);
+        if(sigprocmask(SIG_BLOCK, &blocked, &prev) == -1) app_error("sigprocmask error");
+        drainevents();
+        while(batchlive >= njobs){
+            sigsuspend(&prev);
+            drainevents();
         }
-    }else{
-        /* Parent Process */
-        // 3.2. 1) Addjob
-        // 3.2. 2) Unblock signal
-        // 3.3. 3) (if bg) print log message
-        if(!bg){  /* parent waits for fg job to terminate */
-            addjob(jobs, pid, FG, cmdline);
-            if(sigprocmask(SIG_UNBLOCK, &blocked, NULL) == -1) app_error("SIG_UNBLOCK Error");
-            waitfg(pid);
-        } else{   /* otherwise, don't wait for bg job */
-            addjob(jobs, pid, BG, cmdline);
-            if(sigprocmask(SIG_UNBLOCK, &blocked, NULL) == -1) app_error("SIG_UNBLOCK Error");
-            printf("[%d] (%d) %s", pid2jid(pid), (int) pid, cmdline);
+        if(sigprocmask(SIG_SETMASK, &prev, NULL) == -1) app_error("sigprocmask error");
+
+        parseline(b->cmdline, argv); // trailing '&' is dropped
+        if(builtin_cmd(argv)) continue;
+        if((ncmds = parsepipe(argv, cmds)) == 0) continue;
+
+        clock_gettime(CLOCK_MONOTONIC, &b->start);
+        batchlive++;
+        if(startjob(cmds, ncmds, BG, b->cmdline, i) == 0){
+            batchlive--;
+            continue;
+        }
+        b->started = 1;
+    }
+
+    // 3. Wait for the stragglers
+    if(sigprocmask(SIG_BLOCK, &blocked, &prev) == -1) app_error("sigprocmask error");
+    drainevents();
+    while(batchlive > 0){
+        sigsuspend(&prev);
+        drainevents();
+    }
+    if(sigprocmask(SIG_SETMASK, &prev, NULL) == -1) app_error("sigprocmask error");
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    batchsummary(njobs, &start, &end);
+}
+
+/* tssec - Seconds from a to b */
+static double tssec(struct timespec *a, struct timespec *b)
+{
+    return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+/* tvsec - A struct timeval in seconds */
+static double tvsec(struct timeval *tv)
+{
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+/*
+ * batchsummary - Print one line per batch command (times relative to
+ *    the start of the batch) and the makespan
+ */
+void batchsummary(int njobs, struct timespec *start, struct timespec *end)
+{
+    struct batch_t *b;
+    double busy = 0, makespan = tssec(start, end);
+    int i, failed = 0;
+
+    printf("%5s %9s %9s %9s %8s %8s %8s %10s  %s\n", "#", "start", "end",
+           "elapsed", "status", "user", "sys", "maxrss(KB)", "command");
+    for(i = 0; i < nbatch; i++){
+        b = &batch[i];
+        if(!b->started){
+            failed++;
+            printf("%5d %9s %9s %9s %8s %8s %8s %10s  %s", i + 1, "-", "-",
+                   "-", "-", "-", "-", "-", b->cmdline);
+            continue;
+        }
+        busy += tssec(&b->start, &b->end);
+        if(WIFEXITED(b->status)){
+            if(WEXITSTATUS(b->status) != 0) failed++;
+            snprintf(sbuf, MAXLINE, "exit %d", WEXITSTATUS(b->status));
+        } else{
+            failed++;
+            snprintf(sbuf, MAXLINE, "sig %d", WTERMSIG(b->status));
+        }
+        printf("%5d %9.3f %9.3f %9.3f %8s %8.3f %8.3f %10ld  %s", i + 1,
+               tssec(start, &b->start), tssec(start, &b->end),
+               tssec(&b->start, &b->end), sbuf, tvsec(&b->ru.ru_utime),
+               tvsec(&b->ru.ru_stime), b->ru.ru_maxrss, b->cmdline);
+    }
+    printf("%d jobs (%d failed) with -j %d: makespan %.3f s, "
+           "job time %.3f s, speedup %.2fx\n", nbatch, failed, njobs,
+           makespan, busy, makespan > 0 ? busy / makespan : 0);
+}
+
+/*
+ * parsepipe - Split the argv built by parseline into pipeline stages
+ *    at "|" tokens and pull the redirections ("<", ">", ">>", "2>&1")
+ *    out of each stage. Operators must be separate words. Returns the
+ *    number of stages, or 0 (after printing a message) on a syntax
+ *    error.
+ */
+int parsepipe(char **argv, struct cmd_t *cmds)
+{
+    // 0. Local Variable
+    struct cmd_t *cmd = &cmds[0]; /* stage being built */
+    int ncmds = 1;                /* number of stages */
+    int argc = 0;                 /* args in the current stage */
+    struct redir_t *r;
+    char *tok;
+    int op;
+    int i;
+
+    cmd->nredirs = 0;
+    for(i = 0; (tok = argv[i]) != NULL; i++){
+        if(strcmp(tok, "<") == 0) op = R_IN;
+        else if(strcmp(tok, ">") == 0) op = R_OUT;
+        else if(strcmp(tok, ">>") == 0) op = R_APPEND;
+        else if(strcmp(tok, "2>&1") == 0) op = R_ERR2OUT;
+        else op = -1;
+
+        if(strcmp(tok, "|") == 0){
+            // 1. Close the current stage and start the next one
+            if(argc == 0 && cmd->nredirs == 0){
+                printf("Syntax error near '|'\n");
+                return 0;
+            }
+            if(ncmds == MAXSTAGES){
+                printf("Too many pipeline stages\n");
+                return 0;
+            }
+            cmd->argv[argc] = NULL;
+            cmd = &cmds[ncmds++];
+            cmd->nredirs = 0;
+            argc = 0;
+        } else if(op != -1){
+            // 2. Record a redirection (and its file name)
+            if(cmd->nredirs == MAXREDIRS){
+                printf("Too many redirections\n");
+                return 0;
+            }
+            r = &cmd->redirs[cmd->nredirs++];
+            r->op = op;
+            r->path = NULL;
+            if(op != R_ERR2OUT){
+                if(argv[i+1] == NULL || strchr("<>|", argv[i+1][0]) != NULL){
+                    printf("Syntax error near '%s'\n", tok);
+                    return 0;
+                }
+                r->path = argv[++i];
+            }
+        } else{
+            // 3. Ordinary argument
+            cmd->argv[argc++] = tok;
+        }
+    }
+    cmd->argv[argc] = NULL;
+
+    if(argc == 0 && cmd->nredirs == 0){
+        printf("Syntax error near '|'\n");
+        return 0;
+    }
+    return ncmds;
+}
+
+/*
+ * runstage - Apply the redirections of one pipeline stage and run it
+ *    (path is the program found by findcmd). Called in a forked child;
+ *    never returns.
+ */
+void runstage(struct cmd_t *cmd, char *path)
+{
+    char **argv = cmd->argv;
+
+    if(redirect(cmd) == -1) exit(1);
+    if(argv[0] == NULL) exit(0); // redirection only (e.g. "> file")
+
+    if(builtin_stage(argv)) exit(0);
+
+    if(path == NULL || execve(path, argv, environ) < 0){
+        printf("%s: Command not found\n", argv[0]);
+        exit(0);
+    }
+}
+
+/*
+ * spawnstage - Launch one external pipeline stage with posix_spawn.
+ *    glibc implements it with clone(CLONE_VM|CLONE_VFORK), so unlike
+ *    fork the shell's page tables are never copied. The child joins
+ *    process group pgid (its own new group if pgid is 0), starts with
+ *    an empty signal mask and default handlers, and receives the pipe
+ *    ends and redirections as file actions; redirection files are
+ *    opened here so errors are reported like in runstage. Returns the
+ *    child's PID, or 0 (after printing a message) if it was not
+ *    started.
+ */
+pid_t spawnstage(struct cmd_t *cmd, char *path, pid_t pgid, int infd, int *fds)
+{
+    // 0. Local Variable
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t mask;
+    int opened[MAXREDIRS];   /* files opened for redirections */
+    int nopened = 0;
+    struct redir_t *r;
+    pid_t pid = 0;
+    int fd, i;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    // 1. Pipe ends onto stdin/stdout
+    if(infd != -1){
+        posix_spawn_file_actions_adddup2(&actions, infd, 0);
+        posix_spawn_file_actions_addclose(&actions, infd);
+    }
+    if(fds[1] != -1){
+        posix_spawn_file_actions_adddup2(&actions, fds[1], 1);
+        posix_spawn_file_actions_addclose(&actions, fds[1]);
+        posix_spawn_file_actions_addclose(&actions, fds[0]);
+    }
+
+    // 2. Redirections, left to right (same semantics as redirect)
+    for(i = 0; i < cmd->nredirs; i++){
+        r = &cmd->redirs[i];
+        if(r->op == R_ERR2OUT){
+            posix_spawn_file_actions_adddup2(&actions, 1, 2);
+            continue;
+        }
+        if(r->op == R_IN) fd = open(r->path, O_RDONLY);
+        else if(r->op == R_OUT) fd = open(r->path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        else fd = open(r->path, O_WRONLY | O_CREAT | O_APPEND, 0666);
+        if(fd == -1){
+            printf("%s: %s\n", r->path, strerror(errno));
+            goto out;
+        }
+        opened[nopened++] = fd;
+        posix_spawn_file_actions_adddup2(&actions, fd, r->op == R_IN ? 0 : 1);
+    }
+    for(i = 0; i < nopened; i++)
+        posix_spawn_file_actions_addclose(&actions, opened[i]);
+
+    // 3. Process group, signal mask and handlers of the child
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP |
+                             POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+    posix_spawnattr_setpgroup(&attr, pgid);
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTSTP);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGQUIT);
+    posix_spawnattr_setsigdefault(&attr, &mask);
+
+    // 4. Load & run new program
+    if(posix_spawn(&pid, path, &actions, &attr, cmd->argv, environ) != 0){
+        printf("%s: Command not found\n", cmd->argv[0]);
+        pid = 0;
+    }
+
+out:
+    for(i = 0; i < nopened; i++)
+        close(opened[i]);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    return pid;
+}
+
+/*
+ * redirect - Open the files named by the stage's redirections and move
+ *    them onto stdin/stdout/stderr, left to right, so "> f 2>&1" sends
+ *    both streams to f. Returns -1 (after printing a message) on error.
+ */
+int redirect(struct cmd_t *cmd)
+{
+    struct redir_t *r;
+    int fd, target;
+    int i;
+
+    for(i = 0; i < cmd->nredirs; i++){
+        r = &cmd->redirs[i];
+        switch(r->op){
+        case R_IN:
+            fd = open(r->path, O_RDONLY);
+            target = 0;
+            break;
+        case R_OUT:
+            fd = open(r->path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+            target = 1;
+            break;
+        case R_APPEND:
+            fd = open(r->path, O_WRONLY | O_CREAT | O_APPEND, 0666);
+            target = 1;
+            break;
+        default: /* R_ERR2OUT */
+            if(dup2(1, 2) == -1) return -1;
+            continue;
+        }
+
+        if(fd == -1){
+            printf("%s: %s\n", r->path, strerror(errno));
+            return -1;
+        }
+        if(fd != target){
+            dup2(fd, target);
+            close(fd);
         }
     }
+    return 0;
 }
 
 /* 
@@ -283,19 +840,101 @@ int builtin_cmd(char **argv)
         /* quit terminates the shell */
         exit(0);
     }else if(strcmp(name, "jobs")==0){
-        /* jobs lists all background jobs */
-        listjobs(jobs);
+        /* jobs lists all background jobs, jobs -l with live usage */
+        if(argv[1] != NULL && strcmp(argv[1], "-l") == 0) listjobs_long(jobs);
+        else listjobs(jobs);
         return 1; // return true
     }else if(strcmp(name, "bg")==0 || strcmp(name, "fg")==0){
         /* bg <job> or fg <job> */
         do_bgfg(argv);
         return 1; // return true
+    }else if(strcmp(name, "hash")==0){
+        /* hash [-r] lists or forgets the PATH lookup cache */
+        do_hash(argv);
+        return 1; // return true
     } else{ 
         /* not a builtin command */
         return 0; // return false
     }    
 }
 
+/*
+ * copyfd - Copy in to out (and to tee, if tee != -1) through a user
+ *    space buffer until EOF. Fallback for the built-in stages when no
+ *    end is a pipe.
+ */
+static int copyfd(int in, int out, int tee)
+{
+    static char buf[SPLICE_LEN];
+    ssize_t n;
+
+    while((n = read(in, buf, sizeof(buf))) > 0){
+        if(write(out, buf, n) != n) return -1;
+        if(tee != -1 && write(tee, buf, n) != n) return -1;
+    }
+    return n == 0 ? 0 : -1;
+}
+
+/*
+ * isbuiltin_stage - Is argv "cat" (no arguments) or "tee [file]"?
+ */
+int isbuiltin_stage(char **argv)
+{
+    if(strcmp(argv[0], "cat") == 0)
+        return argv[1] == NULL;
+    if(strcmp(argv[0], "tee") == 0)
+        return argv[1] == NULL || (argv[1][0] != '-' && argv[2] == NULL);
+    return 0;
+}
+
+/*
+ * builtin_stage - Run "cat" (no arguments) or "tee [file]" as a
+ *    built-in pipeline stage in the current (child) process. Data is
+ *    moved with splice(2) and duplicated with tee(2) inside the kernel,
+ *    so it is never copied through user space; if the descriptors are
+ *    not pipes the stage falls back to read/write. Returns 0 if argv is
+ *    not a built-in stage, otherwise runs it and exits.
+ */
+int builtin_stage(char **argv)
+{
+    ssize_t n, m;
+    int fd = -1;
+
+    if(!isbuiltin_stage(argv)) return 0;
+
+    // 0. Behave like an exec'd program: default signal dispositions
+    Signal(SIGINT, SIG_DFL);
+    Signal(SIGTSTP, SIG_DFL);
+    Signal(SIGCHLD, SIG_DFL);
+    Signal(SIGQUIT, SIG_DFL);
+
+    if(strcmp(argv[0], "tee") == 0 && argv[1] != NULL){
+        if((fd = open(argv[1], O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1){
+            printf("%s: %s\n", argv[1], strerror(errno));
+            exit(1);
+        }
+    }
+
+    // 1. cat (or tee without a file): splice stdin straight to stdout
+    if(fd == -1){
+        while((n = splice(0, NULL, 1, NULL, SPLICE_LEN, SPLICE_F_MOVE | SPLICE_F_MORE)) > 0)
+            ;
+        if(n == -1 && errno == EINVAL) n = copyfd(0, 1, -1); // no pipe end
+        exit(n == 0 ? 0 : 1);
+    }
+
+    // 2. tee file: duplicate the pipe contents to stdout, then splice the
+    //    same bytes from stdin into the file
+    while((n = tee(0, 1, SPLICE_LEN, 0)) > 0){
+        while(n > 0){
+            if((m = splice(0, NULL, fd, NULL, n, SPLICE_F_MOVE)) <= 0) exit(1);
+            n -= m;
+        }
+    }
+    if(n == -1 && errno == EINVAL) n = copyfd(0, 1, fd); // not pipe to pipe
+    exit(n == 0 ? 0 : 1);
+}
+
 /* 
  * do_bgfg - Execute the builtin bg and fg commands
  */
@@ -359,13 +998,209 @@ void do_bgfg(char **argv)
  */
 void waitfg(pid_t pid)
 {
-    while(1){
-        if(pid == fgpid(jobs))  sleep(1);
-        else break;
+    // 0. Local Variable
+    sigset_t blocked;        /* signals that queue events */
+    sigset_t prev;           /* caller's mask, restored on return */
+    sigset_t waitmask;       /* caller's mask with those unblocked */
+
+    // 1. Block the event signals so the fgpid() check and the suspend
+    //    are atomic
+    eventmask(&blocked);
+    if(sigprocmask(SIG_BLOCK, &blocked, &prev) == -1) app_error("sigprocmask error");
+
+    // 2. Sleep until a handler queues an event, then apply it; the FG
+    //    state is cleared as soon as the job's exit or stop is drained
+    waitmask = prev;
+    if(sigdelset(&waitmask, SIGCHLD) == -1) app_error("sigdelset error");
+    if(sigdelset(&waitmask, SIGINT) == -1) app_error("sigdelset error");
+    if(sigdelset(&waitmask, SIGTSTP) == -1) app_error("sigdelset error");
+    drainevents();
+    while(pid == fgpid(jobs)){
+        sigsuspend(&waitmask);
+        drainevents();
     }
+
+    // 3. Restore the caller's mask
+    if(sigprocmask(SIG_SETMASK, &prev, NULL) == -1) app_error("sigprocmask error");
     return;
 }
 
+/*
+ * readcmd - Read the next command line (with its '\n') from stdin into
+ *    cmdline. Events the handlers queued are applied first, since a
+ *    line already buffered (scripted or piped input) skips the wait
+ *    below; while no complete line is buffered the shell polls stdin
+ *    together with the self-pipe, so job notifications are printed as
+ *    soon as they happen. Returns 0 at end of file.
+ */
+int readcmd(char *cmdline)
+{
+    // 0. Local Variable
+    static char buf[MAXLINE]; /* bytes read but not returned yet */
+    static size_t len = 0;
+    struct pollfd fds[2];
+    char *nl;
+    size_t n;
+    ssize_t rc;
+
+    // 1. Catch up on reaped and stopped children
+    drainevents();
+
+    // 2. Fill the buffer until it holds a line
+    while((nl = memchr(buf, '\n', len)) == NULL && len < MAXLINE - 2){
+        fds[0].fd = 0;
+        fds[0].events = POLLIN;
+        fds[1].fd = selfpipe[0];
+        fds[1].events = POLLIN;
+        if(poll(fds, 2, -1) == -1){
+            if(errno == EINTR) continue;
+            unix_error("poll error");
+        }
+        if(fds[1].revents & POLLIN) drainevents();
+        if(fds[0].revents & (POLLIN | POLLHUP | POLLERR)){
+            if((rc = read(0, buf + len, MAXLINE - 2 - len)) == -1){
+                if(errno == EINTR) continue;
+                unix_error("read error");
+            }
+            if(rc == 0){
+                if(len == 0) return 0; // end of file
+                break;                 // last line has no '\n'
+            }
+            len += rc;
+        }
+    }
+
+    // 3. Hand out one line and keep the rest
+    n = nl ? (size_t) (nl - buf) + 1 : len;
+    memcpy(cmdline, buf, n);
+    memmove(buf, buf + n, len - n);
+    len -= n;
+    if(cmdline[n-1] != '\n') cmdline[n++] = '\n';
+    cmdline[n] = '\0';
+    return 1;
+}
+
+/*
+ * drainevents - Apply every event queued by the signal handlers, in
+ *    one batch: update the job list for reaped and stopped children,
+ *    print the notifications and forward ctrl-c/ctrl-z to the
+ *    foreground job. Called only from the main program.
+ */
+void drainevents(void)
+{
+    // 0. Local Variable
+    char buf[256];
+    unsigned head, tail;
+    sigset_t blocked, prev;
+
+    // 1. Empty the self-pipe first, so no wakeup is lost
+    while(read(selfpipe[0], buf, sizeof(buf)) > 0)
+        ;
+
+    tail = atomic_load_explicit(&evtail, memory_order_relaxed);
+    while(1){
+        // 2. Process everything published so far, then free the slots
+        head = atomic_load_explicit(&evhead, memory_order_acquire);
+        if(head == tail){
+            if(!evfull) break;
+
+            // 3. The ring overflowed - reap the rest as the producer
+            eventmask(&blocked);
+            if(sigprocmask(SIG_BLOCK, &blocked, &prev) == -1) app_error("sigprocmask error");
+            evfull = 0;
+            reapchildren();
+            if(sigprocmask(SIG_SETMASK, &prev, NULL) == -1) app_error("sigprocmask error");
+            continue;
+        }
+        for(; tail != head; tail++)
+            jobevent(&ring[tail & (RINGSIZE - 1)]);
+        atomic_store_explicit(&evtail, tail, memory_order_release);
+    }
+}
+
+/*
+ * jobevent - Apply one signal handler event to the job list
+ */
+void jobevent(struct event_t *ev)
+{
+    // 0. Local Variable
+    int child_status = ev->status;
+    pid_t pid;
+    struct job_t *obj;
+    struct batch_t *b;
+
+    // 1. ctrl-c/ctrl-z - send it along to the foreground job
+    if(ev->type == EV_SIG){
+        if((pid = fgpid(jobs)) != 0) kill(-pid, ev->status);
+        return;
+    }
+
+    // 2. Reaped or stopped child
+    pid = ev->pid;
+    if((obj = getjobproc(jobs, pid)) == NULL) return;
+
+    if(WIFEXITED(child_status) || WIFSIGNALED(child_status)){
+        // 종료된 경우 - 파이프라인의 마지막 프로세스가 회수될 때 job 삭제
+        if(WIFSIGNALED(child_status) && obj->termsig == 0)
+            obj->termsig = WTERMSIG(child_status);
+        if(pid == obj->procs[obj->nprocs-1])
+            obj->status = child_status;
+        addrusage(&obj->ru, &ev->ru);
+        if(--obj->nlive > 0) return;
+
+        // batch job - record the result and free the slot
+        if(obj->batch >= 0){
+            b = &batch[obj->batch];
+            clock_gettime(CLOCK_MONOTONIC, &b->end);
+            b->status = obj->status;
+            b->ru = obj->ru;
+            batchlive--;
+        }
+
+        // SIGNAL에 의해 종료된 경우만 출력 (SIGCHLD의 default behavior는 ignore)
+        if(obj->termsig != 0)
+            printf("Job [%d] (%d) terminated by signal %d\n", obj->jid, (int) obj->pid, obj->termsig);
+        if(obj->timed) printtimes(obj);
+        deletejob(jobs, obj->pid);
+    } else if(WIFSTOPPED(child_status)){
+        // 파이프라인의 각 프로세스가 멈추지만 한 번만 출력
+        if(obj->state == ST) return;
+        obj->state = ST;
+        printf("Job [%d] (%d) stopped by signal %d\n", obj->jid, (int) obj->pid, WSTOPSIG(child_status));
+    }
+}
+
+/* eventmask - The signals whose handlers queue events */
+void eventmask(sigset_t *set)
+{
+    if(sigemptyset(set) == -1) app_error("sigemptyset error");
+    if(sigaddset(set, SIGCHLD) == -1) app_error("sigaddset error");
+    if(sigaddset(set, SIGINT) == -1) app_error("sigaddset error");
+    if(sigaddset(set, SIGTSTP) == -1) app_error("sigaddset error");
+}
+
+/*
+ * do_hash - Execute the builtin hash command: "hash" lists the PATH
+ *    lookup cache, "hash -r" empties it
+ */
+void do_hash(char **argv)
+{
+    struct hash_t *h;
+    int i;
+
+    if(argv[1] != NULL && strcmp(argv[1], "-r") == 0){
+        clearhash();
+        return;
+    }
+    if(argv[1] != NULL){
+        printf("hash: usage: hash [-r]\n");
+        return;
+    }
+    for(i = 0; i < HASHSIZE; i++)
+        for(h = pathcache[i]; h != NULL; h = h->next)
+            printf("%4d\t%s\n", h->hits, h->path);
+}
+
 /*****************
  * Signal handlers
  *****************/
@@ -375,60 +1210,80 @@ void waitfg(pid_t pid)
  *     a child job terminates (becomes a zombie), or stops because it
  *     received a SIGSTOP or SIGTSTP signal. The handler reaps all
  *     available zombie children, but doesn't wait for any other
- *     currently running children to terminate.  
+ *     currently running children to terminate. It only queues the
+ *     results; the job list is updated by drainevents.
  */
 void sigchld_handler(int sig) 
 {
-    int child_status;
-    pid_t pid;
-    int jobid;
-
-    // Reap Child
-    while((pid = waitpid(-1, &child_status, WNOHANG | WUNTRACED)) > 0){
-        jobid = pid2jid(pid);
-
-        if(WIFEXITED(child_status)){
-            // 일반적으로 종료된 경우 - 미출력 (SIGCHLD의 default behavior는 ignore)
-            deletejob(jobs, pid);
-        } else if(WIFSIGNALED(child_status)){
-            // SIGNAL에 의해 종료된 경우 - 출력 
-            deletejob(jobs, pid);
-            printf("Job [%d] (%d) terminated by signal %d\n", jobid, (int) pid, WTERMSIG(child_status));
+    int olderrno = errno;
 
-
-        } else if(WIFSTOPPED(child_status)){
-            struct job_t  *obj = getjobpid(jobs, pid);
-            obj->state = ST;
-            printf("Job [%d] (%d) stopped by signal %d\n", jobid, (int) pid, WSTOPSIG(child_status));
-        }
-    }
-
-    return;
+    reapchildren();
+    if(write(selfpipe[1], "", 1) < 0) {} // wake poll (full pipe is fine)
+    errno = olderrno;
 }
 
 /* 
  * sigint_handler - The kernel sends a SIGINT to the shell whenver the
- *    user types ctrl-c at the keyboard.  Catch it and send it along
- *    to the foreground job.  
+ *    user types ctrl-c at the keyboard.  Catch it and have the main
+ *    program send it along to the foreground job.  
  */
 void sigint_handler(int sig) 
 {
-    pid_t pid = fgpid(jobs); // Foreground job
+    int olderrno = errno;
 
-    if(pid != 0) kill(-pid, sig);
-    return;
+    pushsig(sig);
+    if(write(selfpipe[1], "", 1) < 0) {}
+    errno = olderrno;
 }
 
 /*
  * sigtstp_handler - The kernel sends a SIGTSTP to the shell whenever
- *     the user types ctrl-z at the keyboard. Catch it and suspend the
- *     foreground job by sending it a SIGTSTP.  
+ *     the user types ctrl-z at the keyboard. Catch it and have the main
+ *     program suspend the foreground job by sending it a SIGTSTP.  
  */
 void sigtstp_handler(int sig) 
 {
-    pid_t pid = fgpid(jobs); // Foreground job
-    if(pid != 0) kill(-pid, sig);
-    return;
+    int olderrno = errno;
+
+    pushsig(sig);
+    if(write(selfpipe[1], "", 1) < 0) {}
+    errno = olderrno;
+}
+
+/*
+ * reapchildren - Reap every child that has exited or stopped while
+ *     the event ring has room, and queue an EV_CHLD event for each.
+ *     If the ring fills up, set evfull so drainevents calls us again
+ *     (with the event signals blocked, so there is still one producer).
+ */
+void reapchildren(void)
+{
+    unsigned head = atomic_load_explicit(&evhead, memory_order_relaxed);
+    struct event_t *ev;
+
+    while(head - atomic_load_explicit(&evtail, memory_order_acquire) < RINGSIZE){
+        ev = &ring[head & (RINGSIZE - 1)];
+        ev->pid = wait4(-1, &ev->status, WNOHANG | WUNTRACED, &ev->ru);
+        if(ev->pid <= 0) return;
+        ev->type = EV_CHLD;
+        atomic_store_explicit(&evhead, ++head, memory_order_release);
+    }
+    evfull = 1;
+}
+
+/*
+ * pushsig - Queue an EV_SIG event (dropped if the ring is full)
+ */
+void pushsig(int sig)
+{
+    unsigned head = atomic_load_explicit(&evhead, memory_order_relaxed);
+    struct event_t *ev;
+
+    if(head - atomic_load_explicit(&evtail, memory_order_acquire) == RINGSIZE) return;
+    ev = &ring[head & (RINGSIZE - 1)];
+    ev->type = EV_SIG;
+    ev->status = sig;
+    atomic_store_explicit(&evhead, head + 1, memory_order_release);
 }
 
 /*********************
@@ -445,6 +1300,13 @@ void clearjob(struct job_t *job) {
     job->jid = 0;
     job->state = UNDEF;
     job->cmdline[0] = '\0';
+    job->nprocs = 0;
+    job->nlive = 0;
+    job->termsig = 0;
+    job->status = 0;
+    memset(&job->ru, 0, sizeof(job->ru));
+    job->batch = -1;
+    job->timed = 0;
 }
 
 /* initjobs - Initialize the job list */
@@ -466,8 +1328,9 @@ int maxjid(struct job_t *jobs)
     return max;
 }
 
-/* addjob - Add a job to the job list */
-int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline) 
+/* addjob - Add a job, started at *start, to the job list */
+int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline,
+           struct timespec *start) 
 {
     int i;
     
@@ -479,6 +1342,14 @@ int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline)
 	    jobs[i].pid = pid;
 	    jobs[i].state = state;
 	    jobs[i].jid = nextjid++;
+	    jobs[i].procs[0] = pid;
+	    jobs[i].nprocs = jobs[i].nlive = 1;
+	    jobs[i].termsig = 0;
+	    jobs[i].status = 0;
+	    memset(&jobs[i].ru, 0, sizeof(jobs[i].ru));
+	    jobs[i].batch = -1;
+	    jobs[i].timed = 0;
+	    jobs[i].start = *start;
 	    if (nextjid > MAXJOBS)
 		nextjid = 1;
 	    strcpy(jobs[i].cmdline, cmdline);
@@ -510,6 +1381,29 @@ int deletejob(struct job_t *jobs, pid_t pid)
     return 0;
 }
 
+/* addproc - Add another pipeline stage's PID to a job */
+int addproc(struct job_t *job, pid_t pid)
+{
+    if (pid < 1 || job->nprocs == MAXSTAGES)
+	return 0;
+    job->procs[job->nprocs++] = pid;
+    job->nlive++;
+    return 1;
+}
+
+/* addrusage - Add the resources in ru to sum (max for maxrss) */
+void addrusage(struct rusage *sum, struct rusage *ru)
+{
+    timeradd(&sum->ru_utime, &ru->ru_utime, &sum->ru_utime);
+    timeradd(&sum->ru_stime, &ru->ru_stime, &sum->ru_stime);
+    if (ru->ru_maxrss > sum->ru_maxrss)
+	sum->ru_maxrss = ru->ru_maxrss;
+    sum->ru_minflt += ru->ru_minflt;
+    sum->ru_majflt += ru->ru_majflt;
+    sum->ru_nvcsw += ru->ru_nvcsw;
+    sum->ru_nivcsw += ru->ru_nivcsw;
+}
+
 /* fgpid - Return PID of current foreground job, 0 if no such job */
 pid_t fgpid(struct job_t *jobs) {
     int i;
@@ -545,6 +1439,20 @@ struct job_t *getjobjid(struct job_t *jobs, int jid)
     return NULL;
 }
 
+/* getjobproc - Find the job (by the PID of any of its processes) */
+struct job_t *getjobproc(struct job_t *jobs, pid_t pid)
+{
+    int i, j;
+
+    if (pid < 1)
+	return NULL;
+    for (i = 0; i < MAXJOBS; i++)
+	for (j = 0; j < jobs[i].nprocs; j++)
+	    if (jobs[i].procs[j] == pid)
+		return &jobs[i];
+    return NULL;
+}
+
 /* pid2jid - Map process ID to job ID */
 int pid2jid(pid_t pid) 
 {
@@ -585,11 +1493,172 @@ void listjobs(struct job_t *jobs)
 	}
     }
 }
+/*
+ * listjobs_long - Print the job list, and for every live process of a
+ *    job its state, CPU time, RSS, page faults and thread count as
+ *    sampled from /proc/<pid>/stat. Processes already reaped are
+ *    summed on a "reaped" line.
+ */
+void listjobs_long(struct job_t *jobs)
+{
+    char path[64], buf[1024], state, *p;
+    unsigned long minflt, majflt, utime, stime, vsize;
+    long nthreads, rss;
+    long tck = sysconf(_SC_CLK_TCK), pagekb = sysconf(_SC_PAGESIZE) / 1024;
+    struct timespec now;
+    ssize_t n;
+    int i, j, fd;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (i = 0; i < MAXJOBS; i++) {
+	if (jobs[i].pid == 0)
+	    continue;
+	printf("[%d] (%d) %s %s", jobs[i].jid, jobs[i].pid,
+	       jobs[i].state == BG ? "Running" :
+	       jobs[i].state == FG ? "Foreground" : "Stopped",
+	       jobs[i].cmdline);
+	printf("    elapsed %.3fs\n", (now.tv_sec - jobs[i].start.tv_sec) +
+	       (now.tv_nsec - jobs[i].start.tv_nsec) / 1e9);
+	printf("    %7s %s %9s %9s %10s %8s %6s %4s\n", "PID", "S", "user",
+	       "sys", "rss(KB)", "minflt", "majflt", "thr");
+	for (j = 0; j < jobs[i].nprocs; j++) {
+	    snprintf(path, sizeof(path), "/proc/%d/stat", jobs[i].procs[j]);
+	    if ((fd = open(path, O_RDONLY)) == -1)
+		continue;        /* reaped (or not ours any more) */
+	    n = read(fd, buf, sizeof(buf) - 1);
+	    close(fd);
+	    if (n <= 0)
+		continue;
+	    buf[n] = '\0';
+	    /* comm may contain spaces and parens: skip to the last ')' */
+	    if ((p = strrchr(buf, ')')) == NULL ||
+		sscanf(p + 2, "%c %*d %*d %*d %*d %*d %*u %lu %*u %lu %*u "
+		       "%lu %lu %*d %*d %*d %*d %ld %*d %*u %lu %ld",
+		       &state, &minflt, &majflt, &utime, &stime, &nthreads,
+		       &vsize, &rss) != 8)
+		continue;
+	    if (state == 'Z')   /* exited, not drained yet */
+		continue;
+	    printf("    %7d %c %9.3f %9.3f %10ld %8lu %6lu %4ld\n",
+		   jobs[i].procs[j], state, (double) utime / tck,
+		   (double) stime / tck, rss * pagekb, minflt, majflt,
+		   nthreads);
+	}
+	if (jobs[i].nlive < jobs[i].nprocs)
+	    printf("    reaped %d: user %.3fs sys %.3fs maxrss %ldKB\n",
+		   jobs[i].nprocs - jobs[i].nlive,
+		   jobs[i].ru.ru_utime.tv_sec + jobs[i].ru.ru_utime.tv_usec / 1e6,
+		   jobs[i].ru.ru_stime.tv_sec + jobs[i].ru.ru_stime.tv_usec / 1e6,
+		   jobs[i].ru.ru_maxrss);
+    }
+}
+
+/*
+ * printtimes - Print the resources used by a finished job that was
+ *    started with the time prefix (summed over all its processes)
+ */
+void printtimes(struct job_t *job)
+{
+    struct timespec now;
+    struct rusage *ru = &job->ru;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    printf("real %.3fs  user %.3fs  sys %.3fs  maxrss %ldKB  "
+	   "faults %ld/%ld  csw %ld/%ld\n",
+	   (now.tv_sec - job->start.tv_sec) + (now.tv_nsec - job->start.tv_nsec) / 1e9,
+	   ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6,
+	   ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1e6,
+	   ru->ru_maxrss, ru->ru_minflt, ru->ru_majflt,
+	   ru->ru_nvcsw, ru->ru_nivcsw);
+}
 /******************************
  * end job list helper routines
  ******************************/
 
 
+/*******************************************
+ * Helper routines for the PATH lookup cache
+ *******************************************/
+
+/* hashname - Bucket of a command name (djb2) */
+static unsigned hashname(char *name)
+{
+    unsigned h = 5381;
+
+    while (*name)
+	h = h * 33 + (unsigned char) *name++;
+    return h % HASHSIZE;
+}
+
+/*
+ * findcmd - Return the program to run for name: name itself if it
+ *    contains a '/', otherwise the first executable PATH entry, cached
+ *    until "hash -r". Returns NULL if there is none.
+ */
+char *findcmd(char *name)
+{
+    char buf[MAXLINE];
+    char *dirs, *dir, *end;
+    struct stat st;
+    struct hash_t *h;
+    unsigned b;
+    size_t len;
+
+    if (strchr(name, '/') != NULL)
+	return name;
+
+    b = hashname(name);
+    for (h = pathcache[b]; h != NULL; h = h->next)
+	if (strcmp(h->name, name) == 0) {
+	    h->hits++;
+	    return h->path;
+	}
+
+    if ((dirs = getenv("PATH")) == NULL)
+	return NULL;
+    for (dir = dirs; ; dir = end + 1) {
+	end = strchr(dir, ':');
+	len = end ? (size_t) (end - dir) : strlen(dir);
+	if (len == 0)            /* empty entry means the cwd */
+	    snprintf(buf, MAXLINE, "./%s", name);
+	else
+	    snprintf(buf, MAXLINE, "%.*s/%s", (int) len, dir, name);
+	if (stat(buf, &st) == 0 && S_ISREG(st.st_mode) && access(buf, X_OK) == 0) {
+	    if ((h = malloc(sizeof(*h))) == NULL)
+		unix_error("malloc error");
+	    h->name = strdup(name);
+	    h->path = strdup(buf);
+	    h->hits = 1;
+	    h->next = pathcache[b];
+	    pathcache[b] = h;
+	    return h->path;
+	}
+	if (end == NULL)
+	    return NULL;
+    }
+}
+
+/* clearhash - Forget every cached PATH lookup */
+void clearhash(void)
+{
+    struct hash_t *h, *next;
+    int i;
+
+    for (i = 0; i < HASHSIZE; i++) {
+	for (h = pathcache[i]; h != NULL; h = next) {
+	    next = h->next;
+	    free(h->name);
+	    free(h->path);
+	    free(h);
+	}
+	pathcache[i] = NULL;
+    }
+}
+/**********************************
+ * end PATH lookup cache routines
+ **********************************/
+
+
 /***********************
  * Other helper routines
  ***********************/
@@ -599,10 +1668,13 @@ void listjobs(struct job_t *jobs)
  */
 void usage(void) 
 {
-    printf("Usage: shell [-hvp]\n");
+    printf("Usage: shell [-hvpF] [-j <n> -f <file>]\n");
     printf("   -h   print this message\n");
     printf("   -v   print additional diagnostic information\n");
     printf("   -p   do not emit a command prompt\n");
+    printf("   -F   launch commands with fork+execve instead of posix_spawn\n");
+    printf("   -f <file>  run the commands in <file> as a batch and exit\n");
+    printf("   -j <n>     keep up to <n> batch jobs running (default: #cpus, up to 16)\n");
     exit(1);
 }
 
@@ -633,6 +1705,9 @@ handler_t *Signal(int signum, handler_t *handler)
 
     action.sa_handler = handler;  
     sigemptyset(&action.sa_mask); /* block sigs of type being handled */
+    sigaddset(&action.sa_mask, SIGCHLD); /* and the other producers */
+    sigaddset(&action.sa_mask, SIGINT);  /* of the event ring */
+    sigaddset(&action.sa_mask, SIGTSTP);
     action.sa_flags = SA_RESTART; /* restart syscalls if possible */
 
     if (sigaction(signum, &action, &old_action) < 0)
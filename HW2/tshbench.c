@@ -0,0 +1,126 @@
+/*
+ * tshbench.c - Foreground command latency benchmark for tsh
+ *
+ * usage: tshbench [-n <count>] [-s <shell>] [-a <shellarg>] [-c <cmdline>]
+ *        tshbench -g <GiB> [-x] [-s <shell>] [-a <shellarg>]
+ * Feeds <count> copies of <cmdline> (default: /bin/true) to
+ * "<shell> -p [<shellarg>]" (default: ./tsh) on a pipe and reports the
+ * mean wall time per foreground command. Only the whole run is timed,
+ * so there is no spread (min, median, tail) to report; compare runs
+ * for that. "-a -F" measures tsh's fork+execve launch path instead of
+ * posix_spawn.
+ *
+ * With -g, runs a single four-stage pipeline that pushes <GiB> of
+ * zeros through three cat stages and reports the throughput. The cat
+ * stages are tsh's built-in splice cat, or /bin/cat with -x.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define MAXLINE 1024
+#define STAGES  3     /* cat stages in the -g pipeline */
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    int c, i, n = 10000;
+    char *shell = "./tsh";
+    char *shellarg = NULL;
+    char line[MAXLINE];
+    char *cmd = "/bin/true";
+    char *cat = "cat";
+    double gib = 0;
+    size_t len;
+    int fds[2], status;
+    pid_t pid;
+    FILE *fp;
+    double start, end;
+
+    while ((c = getopt(argc, argv, "n:s:a:c:g:x")) != -1) {
+	switch (c) {
+	case 'n':
+	    n = atoi(optarg);
+	    break;
+	case 's':
+	    shell = optarg;
+	    break;
+	case 'a':
+	    shellarg = optarg;
+	    break;
+	case 'c':
+	    cmd = optarg;
+	    break;
+	case 'g':
+	    gib = atof(optarg);
+	    break;
+	case 'x':
+	    cat = "/bin/cat";
+	    break;
+	default:
+	    fprintf(stderr, "Usage: %s [-n <count>] [-s <shell>] [-a <shellarg>] [-c <cmdline>]\n", argv[0]);
+	    fprintf(stderr, "       %s -g <GiB> [-x] [-s <shell>] [-a <shellarg>]\n", argv[0]);
+	    exit(1);
+	}
+    }
+    if (n <= 0) {
+	fprintf(stderr, "%s: count must be positive\n", argv[0]);
+	exit(1);
+    }
+    if (gib > 0) {
+	n = 1;
+	len = snprintf(line, MAXLINE, "/usr/bin/head -c %.0f /dev/zero",
+		       gib * (1 << 30));
+	for (i = 0; i < STAGES; i++)
+	    len += snprintf(line + len, MAXLINE - len, " | %s", cat);
+	snprintf(line + len, MAXLINE - len, " > /dev/null\n");
+    }
+    else
+	snprintf(line, MAXLINE, "%s\n", cmd);
+
+    if (pipe(fds) < 0) {
+	perror("pipe");
+	exit(1);
+    }
+
+    start = now();
+    if ((pid = fork()) == 0) {
+	dup2(fds[0], 0);
+	close(fds[0]);
+	close(fds[1]);
+	execl(shell, shell, "-p", shellarg, (char *) NULL);
+	perror(shell);
+	exit(1);
+    }
+    close(fds[0]);
+
+    /* Write every line up front, without waiting for the shell: the
+     * lines queue in the pipe (fputs blocks while it is full) as the
+     * shell reads one, runs it in the foreground, then reads the next. */
+    fp = fdopen(fds[1], "w");
+    for (i = 0; i < n; i++)
+	fputs(line, fp);
+    fclose(fp);
+
+    waitpid(pid, &status, 0);
+    end = now();
+
+    if (gib > 0)
+	printf("%.2f GiB through %d %s stages in %.3f s: %.2f GiB/s\n",
+	       gib, STAGES, cat, end - start, gib / (end - start));
+    else
+	printf("%d commands in %.3f s: %.1f us/command (mean)\n",
+	       n, end - start, (end - start) * 1e6 / n);
+    exit(0);
+}
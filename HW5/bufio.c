@@ -0,0 +1,155 @@
+// Jisang Park 2017-15108
+// Buffered reading without csapp's byte-at-a-time copying: lines are
+// found with memchr and handed out as views into the buffer. Also a
+// writev that finishes, so headers and body go out in one system call.
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "bufio.h"
+
+void bio_init(bio_t *bp, int fd)
+{
+    bp->fd = fd;
+    bp->pos = bp->end = 0;
+}
+
+// Read more after what is buffered, moving that to the front first if
+// the buffer is full. Returns the bytes read, 0 at EOF, -1 on error.
+static ssize_t fill(bio_t *bp)
+{
+    ssize_t n;
+
+    if(bp->pos == bp->end)
+        bp->pos = bp->end = 0;
+    else if(bp->end == BIO_BUFSIZE){
+        memmove(bp->buf, bp->buf + bp->pos, bp->end - bp->pos);
+        bp->end -= bp->pos;
+        bp->pos = 0;
+    }
+    while((n = read(bp->fd, bp->buf + bp->end, BIO_BUFSIZE - bp->end)) < 0)
+        if(errno != EINTR)
+            return -1;
+    bp->end += n;
+    return n;
+}
+
+// Point *line at the next line, line ending included; it is valid until
+// the next call. Returns its length, 0 at EOF, -1 on error. The last line
+// may lack its '\n', and a line longer than the buffer comes in pieces.
+ssize_t bio_line(bio_t *bp, char **line)
+{
+    size_t seen = 0, len;   // Unread bytes already searched
+    char *nl;
+    ssize_t n;
+
+    while(!(nl = memchr(bp->buf + bp->pos + seen, '\n', bp->end - bp->pos - seen))){
+        if((seen = bp->end - bp->pos) == BIO_BUFSIZE)
+            break;   // No room for more: return what there is
+        if((n = fill(bp)) < 0)
+            return -1;
+        if(n == 0)
+            break;
+    }
+    len = nl ? (size_t)(nl + 1 - (bp->buf + bp->pos)) : bp->end - bp->pos;
+    *line = bp->buf + bp->pos;
+    bp->pos += len;
+    return len;
+}
+
+// Point *data at up to n buffered bytes, reading if there are none.
+// Returns how many, 0 at EOF, -1 on error.
+ssize_t bio_read(bio_t *bp, char **data, size_t n)
+{
+    ssize_t k;
+
+    if(bp->pos == bp->end && (k = fill(bp)) <= 0)
+        return k;
+    if(n > bp->end - bp->pos)
+        n = bp->end - bp->pos;
+    *data = bp->buf + bp->pos;
+    bp->pos += n;
+    return n;
+}
+
+// Bytes read from the descriptor but not yet taken
+size_t bio_pending(bio_t *bp)
+{
+    return bp->end - bp->pos;
+}
+
+// As rio_readlineb: copy the next line, up to maxlen-1 bytes, and
+// terminate it. Returns its length, 0 at EOF, -1 on error.
+ssize_t bio_readlineb(bio_t *bp, void *usrbuf, size_t maxlen)
+{
+    char *out = usrbuf, *nl;
+    size_t got = 0, k;
+    ssize_t n;
+
+    while(got < maxlen - 1){
+        if(bp->pos == bp->end){
+            if((n = fill(bp)) < 0)
+                return -1;
+            if(n == 0)
+                break;
+        }
+        k = bp->end - bp->pos;
+        if(k > maxlen - 1 - got)
+            k = maxlen - 1 - got;
+        if((nl = memchr(bp->buf + bp->pos, '\n', k)))
+            k = nl + 1 - (bp->buf + bp->pos);
+        memcpy(out + got, bp->buf + bp->pos, k);
+        bp->pos += k;
+        got += k;
+        if(nl)
+            break;
+    }
+    out[got] = '\0';
+    return got;
+}
+
+// As rio_readnb: copy n bytes, fewer only at EOF
+ssize_t bio_readnb(bio_t *bp, void *usrbuf, size_t n)
+{
+    char *out = usrbuf, *data;
+    size_t got = 0;
+    ssize_t k;
+
+    while(got < n){
+        if((k = bio_read(bp, &data, n - got)) < 0)
+            return -1;
+        if(k == 0)
+            break;
+        memcpy(out + got, data, k);
+        got += k;
+    }
+    return got;
+}
+
+// Write all of iov[0..iovcnt) (which it uses up). Returns the bytes
+// written, -1 on error.
+ssize_t bio_writev(int fd, struct iovec *iov, int iovcnt)
+{
+    size_t total = 0;
+    ssize_t n;
+
+    while(iovcnt > 0){
+        if(iov->iov_len == 0){
+            iov++;
+            iovcnt--;
+            continue;
+        }
+        if((n = writev(fd, iov, iovcnt)) < 0){
+            if(errno == EINTR)
+                continue;
+            return -1;
+        }
+        total += n;
+        for(; iovcnt > 0 && (size_t)n >= iov->iov_len; iov++, iovcnt--)
+            n -= iov->iov_len;
+        if(iovcnt > 0){
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return total;
+}
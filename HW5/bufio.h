@@ -0,0 +1,28 @@
+// Jisang Park 2017-15108
+#ifndef __BUFIO_H__
+#define __BUFIO_H__
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#define BIO_BUFSIZE 8192   // As csapp's RIO_BUFSIZE: longer lines come in pieces
+
+// Buffered reader. Unread bytes are buf[pos, end).
+typedef struct{
+    int fd;
+    size_t pos, end;
+    char buf[BIO_BUFSIZE];
+} bio_t;
+
+void bio_init(bio_t *bp, int fd);
+ssize_t bio_line(bio_t *bp, char **line);
+ssize_t bio_read(bio_t *bp, char **data, size_t n);
+size_t bio_pending(bio_t *bp);
+
+// Drop-in replacements for csapp's rio_readlineb and rio_readnb
+ssize_t bio_readlineb(bio_t *bp, void *usrbuf, size_t maxlen);
+ssize_t bio_readnb(bio_t *bp, void *usrbuf, size_t n);
+
+ssize_t bio_writev(int fd, struct iovec *iov, int iovcnt);
+
+#endif /* __BUFIO_H__ */
@@ -0,0 +1,168 @@
+// Jisang Park 2017-15108
+// Object cache: URIs hash into NSHARDS shards, each with its own lock,
+// hash table and CLOCK ring. Hits only take their shard's read lock, and
+// the bytes are sent after it is released, from a reference-counted
+// object that no one modifies.
+#include "csapp.h"
+#include "cache.h"
+
+#ifndef NSHARDS
+#define NSHARDS 16    // Independent locks; build with -DNSHARDS=1 to compare
+#endif
+#define NBUCKETS 256  // Hash buckets per shard
+
+typedef struct{
+    pthread_rwlock_t lock;
+    cobj_t *buckets[NBUCKETS];
+    cobj_t *hand;     // CLOCK hand, NULL if the shard is empty
+} shard_t;
+
+static shard_t shards[NSHARDS];
+static size_t cache_size = 0;       // Total bytes cached or being inserted
+static unsigned int next_victim = 0; // Shard the next eviction starts at
+
+// djb2 string hash
+static unsigned long hash(char *key){
+    unsigned long h = 5381;
+    while(*key)
+        h = h * 33 + (unsigned char)*key++;
+    return h;
+}
+
+void cache_init(void){
+    int i;
+
+    for(i = 0; i < NSHARDS; i++)
+        pthread_rwlock_init(&shards[i].lock, NULL);
+}
+
+// Look up key. On a hit, returns the object with a reference taken for
+// the caller, who sends obj->data and then calls cache_put(obj).
+cobj_t *cache_get(char *key){
+    unsigned long h = hash(key);
+    shard_t *s = &shards[h % NSHARDS];
+    cobj_t *obj;
+
+    pthread_rwlock_rdlock(&s->lock);
+    for(obj = s->buckets[(h / NSHARDS) % NBUCKETS]; obj; obj = obj->hnext){
+        if(strcmp(obj->key, key) == 0){
+            __atomic_add_fetch(&obj->refs, 1, __ATOMIC_RELAXED);
+            // Recency is one bit, so a hit never needs the write lock.
+            // Skip the store when set to keep the line shared.
+            if(!__atomic_load_n(&obj->ref_bit, __ATOMIC_RELAXED))
+                __atomic_store_n(&obj->ref_bit, 1, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&s->lock);
+    return obj;
+}
+
+// Drop a reference; the last one frees the object
+void cache_put(cobj_t *obj){
+    if(__atomic_sub_fetch(&obj->refs, 1, __ATOMIC_ACQ_REL) == 0){
+        Free(obj->key);
+        Free(obj->data);
+        Free(obj);
+    }
+}
+
+// Unlink obj from shard s. Called with the write lock held.
+static void unlink_obj(shard_t *s, cobj_t *obj, unsigned long h){
+    cobj_t **pp;
+
+    for(pp = &s->buckets[(h / NSHARDS) % NBUCKETS]; *pp != obj; pp = &(*pp)->hnext)
+        ;
+    *pp = obj->hnext;
+    if(obj->next == obj){
+        s->hand = NULL;
+    }
+    else{
+        obj->prev->next = obj->next;
+        obj->next->prev = obj->prev;
+        if(s->hand == obj)
+            s->hand = obj->next;
+    }
+}
+
+// Evict one object, trying the shards round robin. In a shard, the hand
+// skips (and clears) objects hit since it last passed: CLOCK, an
+// approximation of LRU. Returns 0 if the cache is empty.
+static int evict_one(void){
+    shard_t *s;
+    cobj_t *victim;
+    int i;
+
+    for(i = 0; i < NSHARDS; i++){
+        s = &shards[__atomic_fetch_add(&next_victim, 1, __ATOMIC_RELAXED) % NSHARDS];
+        pthread_rwlock_wrlock(&s->lock);
+        if(!s->hand){
+            pthread_rwlock_unlock(&s->lock);
+            continue;
+        }
+        while(s->hand->ref_bit){
+            s->hand->ref_bit = 0;
+            s->hand = s->hand->next;
+        }
+        victim = s->hand;
+        unlink_obj(s, victim, hash(victim->key));
+        pthread_rwlock_unlock(&s->lock);
+
+        __atomic_sub_fetch(&cache_size, victim->size, __ATOMIC_RELAXED);
+        cache_put(victim);  // Readers still sending it keep it alive
+        return 1;
+    }
+    return 0;
+}
+
+// Cache a copy of buf under key, evicting objects to make room
+void cache_insert(char *key, char *buf, size_t size){
+    unsigned long h = hash(key);
+    shard_t *s = &shards[h % NSHARDS];
+    cobj_t *obj, *p;
+
+    if(size > MAX_OBJECT_SIZE)
+        return;
+
+    // 1. Reserve the space first, so concurrent inserts can't overshoot
+    // MAX_CACHE_SIZE together
+    if(__atomic_add_fetch(&cache_size, size, __ATOMIC_RELAXED) > MAX_CACHE_SIZE)
+        while(__atomic_load_n(&cache_size, __ATOMIC_RELAXED) > MAX_CACHE_SIZE && evict_one())
+            ;
+
+    // 2. Build the object outside any lock
+    obj = Malloc(sizeof(cobj_t));
+    obj->key = Malloc(strlen(key) + 1);
+    strcpy(obj->key, key);
+    obj->data = Malloc(size);
+    memcpy(obj->data, buf, size);
+    obj->size = size;
+    obj->refs = 1;
+    obj->ref_bit = 1;
+
+    // 3. Link it in, unless another thread cached the same URI meanwhile
+    pthread_rwlock_wrlock(&s->lock);
+    for(p = s->buckets[(h / NSHARDS) % NBUCKETS]; p; p = p->hnext)
+        if(strcmp(p->key, key) == 0)
+            break;
+    if(p){
+        pthread_rwlock_unlock(&s->lock);
+        __atomic_sub_fetch(&cache_size, size, __ATOMIC_RELAXED);
+        cache_put(obj);
+        return;
+    }
+    obj->hnext = s->buckets[(h / NSHARDS) % NBUCKETS];
+    s->buckets[(h / NSHARDS) % NBUCKETS] = obj;
+    // Just behind the hand: the last object it reaches
+    if(s->hand){
+        obj->next = s->hand;
+        obj->prev = s->hand->prev;
+        s->hand->prev->next = obj;
+        s->hand->prev = obj;
+    }
+    else{
+        obj->next = obj->prev = obj;
+        s->hand = obj;
+    }
+    pthread_rwlock_unlock(&s->lock);
+}
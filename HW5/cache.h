@@ -0,0 +1,29 @@
+// Jisang Park 2017-15108
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Recommended max cache and object sizes */
+#define MAX_CACHE_SIZE 1049000
+#define MAX_OBJECT_SIZE 102400
+
+// Cached web object. data and size never change once it is cached, so a
+// holder of a reference may read them without any lock.
+typedef struct cobj{
+    char *key;              // Request URI
+    char *data;             // Whole response, headers included
+    size_t size;
+    int refs;               // The cache's own reference plus one per reader
+    int ref_bit;            // CLOCK: set by hits, cleared by the hand
+    struct cobj *hnext;     // Hash chain
+    struct cobj *prev, *next;  // CLOCK ring of the shard
+} cobj_t;
+
+void cache_init(void);
+cobj_t *cache_get(char *key);
+void cache_put(cobj_t *obj);
+void cache_insert(char *key, char *buf, size_t size);
+
+#endif /* __CACHE_H__ */
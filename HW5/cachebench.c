@@ -0,0 +1,130 @@
+// Jisang Park 2017-15108
+// Cache hit throughput with 1 to 64 client threads. Each lookup copies
+// the object out, as sending it would, after the lock is released.
+//   usage: cachebench [-t seconds] [-o objects] [-z object size] [-m miss %]
+#include "csapp.h"
+#include "cache.h"
+
+#define MAXTHREADS 64
+
+static int nobjs = 256, objsize = 4096, miss_pct = 0;
+static double seconds = 1.0;
+static char **keys;
+static char *body;
+static volatile int stop;
+
+typedef struct{
+    unsigned long hits, misses;
+    unsigned int seed;
+    char pad[64];   // Keep counters of different threads on different lines
+} worker_t;
+
+static worker_t workers[MAXTHREADS];
+
+static double now(void){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *client(void *vargp){
+    worker_t *w = vargp;
+    char *out = Malloc(objsize), key[MAXLINE];
+    unsigned int x = w->seed;
+    cobj_t *obj;
+
+    while(!stop){
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        // miss_pct% of lookups go to URIs outside the hot set; those are
+        // inserted, so eviction runs alongside the hits
+        if(miss_pct && x % 100 < (unsigned int)miss_pct){
+            sprintf(key, "http://localhost:80/cold/%u", x);
+            if((obj = cache_get(key)))
+                cache_put(obj);
+            else
+                cache_insert(key, body, objsize);
+            w->misses++;
+            continue;
+        }
+        if((obj = cache_get(keys[x % nobjs]))){
+            memcpy(out, obj->data, obj->size);
+            cache_put(obj);
+            w->hits++;
+        }
+        else{
+            cache_insert(keys[x % nobjs], body, objsize);
+            w->misses++;
+        }
+    }
+    Free(out);
+    return NULL;
+}
+
+int main(int argc, char **argv){
+    pthread_t tids[MAXTHREADS];
+    unsigned long hits, misses;
+    double start, elapsed;
+    int i, n, c;
+
+    while((c = getopt(argc, argv, "t:o:z:m:")) != -1){
+        switch(c){
+        case 't':
+            seconds = atof(optarg);
+            break;
+        case 'o':
+            nobjs = atoi(optarg);
+            break;
+        case 'z':
+            objsize = atoi(optarg);
+            break;
+        case 'm':
+            miss_pct = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t seconds] [-o objects] [-z object size] [-m miss %%]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if(nobjs <= 0 || objsize <= 0 || objsize > MAX_OBJECT_SIZE || miss_pct < 0 || miss_pct > 100){
+        fprintf(stderr, "bad arguments\n");
+        exit(1);
+    }
+
+    // Hot set: nobjs objects (only as many as fit stay cached)
+    cache_init();
+    body = Malloc(objsize);
+    memset(body, 'x', objsize);
+    keys = Malloc(nobjs * sizeof(char *));
+    for(i = 0; i < nobjs; i++){
+        keys[i] = Malloc(MAXLINE);
+        sprintf(keys[i], "http://localhost:80/hot/%d.html", i);
+        cache_insert(keys[i], body, objsize);
+    }
+
+    printf("%d objects of %d bytes, %d%% misses, %.1fs per run\n",
+           nobjs, objsize, miss_pct, seconds);
+    printf("%8s %14s %14s %10s\n", "threads", "hits/s", "hits/s/thread", "misses");
+    for(n = 1; n <= MAXTHREADS; n *= 2){
+        memset(workers, 0, sizeof(workers));
+        stop = 0;
+        start = now();
+        for(i = 0; i < n; i++){
+            workers[i].seed = 2463534242u + i * 7919;
+            Pthread_create(&tids[i], NULL, client, &workers[i]);
+        }
+        usleep(seconds * 1e6);
+        stop = 1;
+        hits = misses = 0;
+        for(i = 0; i < n; i++){
+            Pthread_join(tids[i], NULL);
+            hits += workers[i].hits;
+            misses += workers[i].misses;
+        }
+        elapsed = now() - start;
+        printf("%8d %14.0f %14.0f %10lu\n", n, hits / elapsed, hits / elapsed / n, misses);
+    }
+    exit(0);
+}
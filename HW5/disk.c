@@ -0,0 +1,394 @@
+// Jisang Park 2017-15108
+// Disk tier of the cache (-d dir): responses too big for memory, and
+// everything else worth keeping across restarts.
+//
+// Responses are appended to segment files (dir/seg-<n>) of DISK_SEG_SIZE
+// bytes, each as a record: a header, the URI, then the response. An
+// in-memory hash index maps URIs to where their response is. When the
+// tier is full, the oldest segment goes as a whole, along with the index
+// entries into it: no per-object bookkeeping, and all writes sequential.
+//
+// A record's header is written (uncommitted) when its space is reserved
+// and committed once the whole response is in, so on startup the index
+// is rebuilt by reading headers only, skipping over responses and over
+// records that never completed.
+#include "csapp.h"
+#include <dirent.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "disk.h"
+#include "pool.h"
+
+#define DISK_MAGIC   0x31435850   // "PXC1"
+#define DISK_BUCKETS 4096
+#define REC_PENDING  0
+#define REC_DONE     1
+
+// Record header, followed by keylen bytes of URI and size bytes of response
+typedef struct{
+    uint32_t magic;
+    uint32_t state;     // REC_*
+    uint32_t keylen;
+    uint32_t hlen;      // Status line and headers, at the start of the response
+    uint64_t size;
+} drec_t;
+
+typedef struct dseg{
+    unsigned int seq;
+    int fd;
+    off_t end;           // Space handed out so far
+    int refs;            // Readers and writers using it
+    int dead;            // Evicted: close once refs reach 0
+    struct dseg *next;   // Oldest first
+} dseg_t;
+
+typedef struct dentry{
+    char *key;
+    dseg_t *seg;
+    off_t off;
+    size_t hlen, size;
+    struct dentry *next;
+} dentry_t;
+
+static char *disk_dir;
+static size_t max_segs;
+static dseg_t *segs, *active;        // Oldest, newest
+static size_t nsegs;
+static dentry_t *index_[DISK_BUCKETS];
+static size_t nentries, stored;      // Stored: bytes of live responses
+static pthread_mutex_t disk_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned long hash(char *key)
+{
+    unsigned long h = 5381;
+    while(*key)
+        h = h * 33 + (unsigned char)*key++;
+    return h;
+}
+
+static void seg_path(char *path, unsigned int seq)
+{
+    snprintf(path, MAXLINE, "%s/seg-%08u", disk_dir, seq);
+}
+
+static void seg_release(dseg_t *s)
+{
+    if(--s->refs == 0 && s->dead){
+        close(s->fd);
+        Free(s);
+    }
+}
+
+// Point key at the response at off in s, replacing an older entry.
+// Called with disk_lock held.
+static void index_set(char *key, dseg_t *s, off_t off, size_t hlen, size_t size)
+{
+    dentry_t *e, **head = &index_[hash(key) % DISK_BUCKETS];
+
+    for(e = *head; e; e = e->next)
+        if(!strcmp(e->key, key))
+            break;
+    if(e)
+        stored -= e->size;
+    else{
+        e = Malloc(sizeof(dentry_t));
+        e->key = Malloc(strlen(key) + 1);
+        strcpy(e->key, key);
+        e->next = *head;
+        *head = e;
+        nentries++;
+    }
+    e->seg = s;
+    e->off = off;
+    e->hlen = hlen;
+    e->size = size;
+    stored += size;
+}
+
+// Drop the oldest segment and everything in it. Called with disk_lock held.
+static void evict_oldest(void)
+{
+    char path[MAXLINE];
+    dentry_t *e, **pp;
+    dseg_t *s = segs;
+    int i;
+
+    for(i = 0; i < DISK_BUCKETS; i++){
+        for(pp = &index_[i]; (e = *pp); ){
+            if(e->seg == s){
+                *pp = e->next;
+                stored -= e->size;
+                nentries--;
+                Free(e->key);
+                Free(e);
+            }
+            else
+                pp = &e->next;
+        }
+    }
+    segs = s->next;
+    nsegs--;
+    seg_path(path, s->seq);
+    unlink(path);
+    s->dead = 1;
+    if(s->refs == 0){
+        close(s->fd);
+        Free(s);
+    }
+}
+
+// Start a new segment after the newest. Called with disk_lock held.
+static dseg_t *seg_new(unsigned int seq, int fd, off_t end)
+{
+    dseg_t *s = Calloc(1, sizeof(dseg_t));
+
+    s->seq = seq;
+    s->fd = fd;
+    s->end = end;
+    if(active)
+        active->next = s;
+    else
+        segs = s;
+    active = s;
+    nsegs++;
+    while(nsegs > max_segs)
+        evict_oldest();
+    return s;
+}
+
+// Index the committed records of segment s. Stops at the first header
+// that isn't one: the end, or space reserved when the proxy stopped.
+// Records that were never committed are skipped over.
+static void seg_scan(dseg_t *s)
+{
+    char key[MAXLINE];
+    off_t off = 0;
+    drec_t r;
+
+    while(pread(s->fd, &r, sizeof(r), off) == sizeof(r) && r.magic == DISK_MAGIC){
+        if(r.keylen >= MAXLINE || r.size > DISK_SEG_SIZE)
+            break;
+        if(r.state == REC_DONE){
+            if(pread(s->fd, key, r.keylen, off + sizeof(r)) != r.keylen)
+                break;
+            key[r.keylen] = '\0';
+            index_set(key, s, off + sizeof(r) + r.keylen, r.hlen, r.size);
+        }
+        off += sizeof(r) + r.keylen + r.size;
+    }
+    s->end = off;
+}
+
+static int seq_cmp(const void *a, const void *b)
+{
+    unsigned int x = *(unsigned int *)a, y = *(unsigned int *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Open the tier in dir, of about mb megabytes, indexing what is already
+// there. Returns -1 if dir can't be used.
+int disk_init(char *dir, size_t mb)
+{
+    unsigned int *seqs = NULL, seq, next = 0;
+    size_t n = 0, cap = 0, i;
+    char path[MAXLINE];
+    struct dirent *de;
+    struct timespec t0, t1;
+    struct stat st;
+    DIR *dp;
+    int fd;
+
+    mkdir(dir, 0755);
+    if(!(dp = opendir(dir)))
+        return -1;
+    disk_dir = strdup(dir);
+    max_segs = mb * (1UL << 20) / DISK_SEG_SIZE;
+    if(max_segs < 2)
+        max_segs = 2;
+
+    // Existing segments, oldest first
+    while((de = readdir(dp))){
+        if(sscanf(de->d_name, "seg-%u", &seq) != 1)
+            continue;
+        if(n == cap){
+            cap = cap ? 2 * cap : 64;
+            seqs = Realloc(seqs, cap * sizeof(unsigned int));
+        }
+        seqs[n++] = seq;
+    }
+    closedir(dp);
+    qsort(seqs, n, sizeof(unsigned int), seq_cmp);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pthread_mutex_lock(&disk_lock);
+    for(i = 0; i < n; i++){
+        seg_path(path, seqs[i]);
+        next = seqs[i] + 1;
+        if((fd = open(path, O_RDWR | O_CLOEXEC)) < 0)
+            continue;
+        if(fstat(fd, &st) == 0 && st.st_size == 0){
+            close(fd);   // Never used: don't let it take the place of one that was
+            unlink(path);
+            continue;
+        }
+        seg_scan(seg_new(seqs[i], fd, 0));
+    }
+    pthread_mutex_unlock(&disk_lock);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if(n)
+        fprintf(stderr, "disk: %zu objects (%zu MB) in %zu segments, indexed in %.1f ms\n",
+               nentries, stored >> 20, nsegs, (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+    Free(seqs);
+
+    // New responses go after the last complete record of the newest
+    // segment, over whatever was being written when the proxy stopped
+    if(active)
+        return ftruncate(active->fd, active->end);
+    seg_path(path, next);
+    if((fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+        return -1;
+    pthread_mutex_lock(&disk_lock);
+    seg_new(next, fd, 0);
+    pthread_mutex_unlock(&disk_lock);
+    return 0;
+}
+
+int disk_enabled(void)
+{
+    return disk_dir != NULL;
+}
+
+// Look key up. On a hit, fill in d and return 1; disk_put(d) when done.
+int disk_get(char *key, dobj_t *d)
+{
+    dentry_t *e;
+
+    if(!disk_dir)
+        return 0;
+    pthread_mutex_lock(&disk_lock);
+    for(e = index_[hash(key) % DISK_BUCKETS]; e; e = e->next)
+        if(!strcmp(e->key, key))
+            break;
+    if(e){
+        d->seg = e->seg;
+        d->fd = e->seg->fd;
+        d->off = e->off;
+        d->hlen = e->hlen;
+        d->size = e->size;
+        e->seg->refs++;
+        STAT_ADD(disk_hits, 1);
+    }
+    pthread_mutex_unlock(&disk_lock);
+    return e != NULL;
+}
+
+void disk_put(dobj_t *d)
+{
+    pthread_mutex_lock(&disk_lock);
+    seg_release(d->seg);
+    pthread_mutex_unlock(&disk_lock);
+}
+
+// Reserve room for a response of size bytes (hlen of them headers) to
+// key. Returns NULL if it can't be stored.
+dwriter_t *disk_begin(char *key, size_t hlen, size_t size)
+{
+    size_t keylen = strlen(key), need = sizeof(drec_t) + keylen + size;
+    char path[MAXLINE];
+    dwriter_t *w;
+    drec_t r;
+    int fd;
+
+    if(!disk_dir || need > DISK_SEG_SIZE || keylen >= MAXLINE)
+        return NULL;
+    pthread_mutex_lock(&disk_lock);
+    if(active->end + need > DISK_SEG_SIZE){
+        seg_path(path, active->seq + 1);
+        if((fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0){
+            pthread_mutex_unlock(&disk_lock);
+            return NULL;
+        }
+        seg_new(active->seq + 1, fd, 0);
+    }
+    w = Malloc(sizeof(dwriter_t));
+    w->seg = active;
+    w->rec = active->end;
+    active->end += need;
+    active->refs++;
+    pthread_mutex_unlock(&disk_lock);
+
+    w->key = Malloc(keylen + 1);
+    strcpy(w->key, key);
+    w->off = w->rec + sizeof(drec_t) + keylen;
+    w->hlen = hlen;
+    w->size = size;
+    w->got = 0;
+    r.magic = DISK_MAGIC;
+    r.state = REC_PENDING;
+    r.keylen = keylen;
+    r.hlen = hlen;
+    r.size = size;
+    w->failed = pwrite(w->seg->fd, &r, sizeof(r), w->rec) != sizeof(r) ||
+                pwrite(w->seg->fd, key, keylen, w->rec + sizeof(r)) != (ssize_t)keylen;
+    return w;
+}
+
+// The next n bytes of the response
+void disk_write(dwriter_t *w, char *buf, size_t n)
+{
+    ssize_t k;
+
+    if(w->failed || w->got + n > w->size){
+        w->failed = 1;
+        return;
+    }
+    while(n > 0){
+        if((k = pwrite(w->seg->fd, buf, n, w->off + w->got)) <= 0){
+            if(k < 0 && errno == EINTR)
+                continue;
+            w->failed = 1;
+            return;
+        }
+        buf += k;
+        n -= k;
+        w->got += k;
+    }
+}
+
+// The response is over: if all of it arrived (ok) and was written,
+// commit it and make it visible. Frees w.
+void disk_end(dwriter_t *w, int ok)
+{
+    uint32_t state = REC_DONE;
+
+    ok = ok && !w->failed && w->got == w->size &&
+         pwrite(w->seg->fd, &state, sizeof(state), w->rec + offsetof(drec_t, state)) == sizeof(state);
+    pthread_mutex_lock(&disk_lock);
+    if(ok && !w->seg->dead){
+        index_set(w->key, w->seg, w->off, w->hlen, w->size);
+        STAT_ADD(disk_stored, 1);
+    }
+    seg_release(w->seg);
+    pthread_mutex_unlock(&disk_lock);
+    Free(w->key);
+    Free(w);
+}
+
+// For the stats page
+int disk_format(char *buf, size_t size)
+{
+    int len;
+
+    if(!disk_dir)
+        len = snprintf(buf, size, "disk tier            off\n");
+    else{
+        pthread_mutex_lock(&disk_lock);
+        len = snprintf(buf, size,
+                       "disk objects         %zu (%zu MB in %zu of %zu segments)\n"
+                       "disk hits            %lu\n"
+                       "disk stored          %lu\n",
+                       nentries, stored >> 20, nsegs, max_segs, stats.disk_hits, stats.disk_stored);
+        pthread_mutex_unlock(&disk_lock);
+    }
+    return len < (int)size ? len : (int)size - 1;
+}
@@ -0,0 +1,41 @@
+// Jisang Park 2017-15108
+#ifndef __DISK_H__
+#define __DISK_H__
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define DISK_SEG_SIZE (64UL << 20)  // Bytes per segment file, and the largest object
+#define DISK_DEF_MB   1024          // Default size of the disk tier (-D)
+
+struct dseg;
+
+// A response found on disk: size bytes at off in fd, the first hlen
+// being the status line and headers. Holding it keeps the segment open.
+typedef struct{
+    int fd;
+    off_t off;
+    size_t hlen, size;
+    struct dseg *seg;
+} dobj_t;
+
+// A response being written to disk
+typedef struct{
+    char *key;
+    struct dseg *seg;
+    off_t rec;        // Where its record starts
+    off_t off;        // Where its bytes go
+    size_t hlen, size, got;
+    int failed;
+} dwriter_t;
+
+int disk_init(char *dir, size_t mb);
+int disk_enabled(void);
+int disk_get(char *key, dobj_t *d);
+void disk_put(dobj_t *d);
+dwriter_t *disk_begin(char *key, size_t hlen, size_t size);
+void disk_write(dwriter_t *w, char *buf, size_t n);
+void disk_end(dwriter_t *w, int ok);
+int disk_format(char *buf, size_t size);
+
+#endif /* __DISK_H__ */
@@ -0,0 +1,767 @@
+// Jisang Park 2017-15108
+// Event-driven engine: one epoll loop per core. Each loop has its own
+// SO_REUSEPORT listening socket, buffer pool and connections, so loops
+// share nothing but the cache.
+#include "csapp.h"
+#include "cache.h"
+#include "http.h"
+#include "event.h"
+#include "flight.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <netinet/tcp.h>
+
+#define MAXEVENTS 256
+#define BACKLOG   4096
+
+// Connection states
+#define S_REQ     0  // Reading the client's request
+#define S_CONNECT 1  // Waiting for the origin to accept
+#define S_SEND    2  // Sending the request to the origin
+#define S_RELAY   3  // Copying the response to the client
+#define S_HIT     4  // Sending a cached object
+#define S_ERROR   5  // Sending an error response, then closing
+#define S_WAIT    6  // Following another connection's fetch (flight)
+#define S_CLOSED  7  // Freed at the end of the current batch of events
+
+// I/O buffer; all of a loop's buffers come from its pool
+typedef struct buf{
+    struct buf *next;   // Free list or cache copy chain
+    size_t len;
+    char data[EV_BUFSIZE];
+} buf_t;
+
+struct conn;
+struct loop;
+
+// What an epoll event points at: one side of a connection
+typedef struct{
+    struct conn *c;     // NULL for the listening socket
+    int fd;
+    unsigned int ev;    // Events currently watched
+} end_t;
+
+typedef struct conn{
+    end_t cli, srv;
+    int state;
+    buf_t *b;           // I/O buffer, NULL until the client sends data
+    size_t off;         // Next byte of b to send
+    size_t scanned;     // Bytes of the request already searched for its end
+    char *key;          // Absolute URI (cache key)
+    cobj_t *obj;        // S_HIT: cached object, referenced while it is sent
+    size_t sent;        // S_HIT: bytes of obj sent
+    buf_t *chain, *tail;  // Copy of the response kept for the cache
+    size_t clen;
+    int cacheable;
+    frame_t *fr;        // S_RELAY: where the response ends
+    flight_t *flight;   // S_CONNECT..S_RELAY: flight we lead
+    freader_t rd;       // S_WAIT: reader of the flight we follow
+    struct loop *lp;
+    int woken;          // On lp->woken
+    struct conn *wnext;
+    struct conn *next;  // Buffer wait list or dead list
+} conn_t;
+
+typedef struct loop{
+    int epfd;
+    end_t listen;
+    end_t wake;         // eventfd: flights have news for our readers
+    pthread_mutex_t wlock;
+    conn_t *woken;      // Readers to serve, pushed by other loops' leaders
+    buf_t *free;        // Pool free list
+    int nfree, nbufs;
+    conn_t *waith, *waitt;  // Connections waiting for a buffer, FIFO
+    conn_t *dead;           // Closed during this batch
+} loop_t;
+
+static char *listen_port;
+static int pool_size;
+
+// Take a buffer from the pool; NULL if it is empty
+static buf_t *buf_get(loop_t *lp){
+    buf_t *b = lp->free;
+
+    if(!b)
+        return NULL;
+    lp->free = b->next;
+    lp->nfree--;
+    b->next = NULL;
+    b->len = 0;
+    return b;
+}
+
+static void watch(loop_t *lp, end_t *e, unsigned int ev){
+    struct epoll_event event = { .events = ev, .data.ptr = e };
+
+    if(e->ev == ev)
+        return;
+    e->ev = ev;
+    epoll_ctl(lp->epfd, EPOLL_CTL_MOD, e->fd, &event);
+}
+
+// Give a buffer back: straight to the longest-waiting connection if any
+static void buf_put(loop_t *lp, buf_t *b){
+    conn_t *c = lp->waith;
+
+    if(c){
+        lp->waith = c->next;
+        if(!lp->waith)
+            lp->waitt = NULL;
+        b->next = NULL;
+        b->len = 0;
+        c->b = b;
+        watch(lp, &c->cli, EPOLLIN);
+        return;
+    }
+    b->next = lp->free;
+    lp->free = b;
+    lp->nfree++;
+}
+
+static void drop_chain(loop_t *lp, conn_t *c){
+    buf_t *b;
+
+    while((b = c->chain)){
+        c->chain = b->next;
+        buf_put(lp, b);
+    }
+    c->tail = NULL;
+    c->clen = 0;
+    c->cacheable = 0;
+}
+
+// Close both sides now; the memory goes at the end of the batch, since
+// later events of the same batch may still point at it
+static void conn_close(loop_t *lp, conn_t *c){
+    conn_t *w, *prev = NULL;
+
+    if(c->state == S_CLOSED)
+        return;
+    // Still waiting for a buffer?
+    for(w = lp->waith; w; prev = w, w = w->next){
+        if(w == c){
+            if(prev)
+                prev->next = c->next;
+            else
+                lp->waith = c->next;
+            if(lp->waitt == c)
+                lp->waitt = prev;
+            break;
+        }
+    }
+    // Lost the leader: followers see the response end early
+    if(c->flight)
+        flight_finish(c->flight, 0);
+    c->flight = NULL;
+    if(c->rd.f){
+        flight_leave(&c->rd);  // No wakes after this...
+        pthread_mutex_lock(&lp->wlock);  // ...but one may be queued
+        if(c->woken){
+            conn_t **pp;
+            for(pp = &lp->woken; *pp != c; pp = &(*pp)->wnext)
+                ;
+            *pp = c->wnext;
+        }
+        pthread_mutex_unlock(&lp->wlock);
+    }
+    if(c->cli.fd >= 0)
+        close(c->cli.fd);
+    if(c->srv.fd >= 0)
+        close(c->srv.fd);
+    drop_chain(lp, c);
+    Free(c->fr);
+    c->fr = NULL;
+    if(c->obj)
+        cache_put(c->obj);
+    c->obj = NULL;
+    if(c->b)
+        buf_put(lp, c->b);
+    c->b = NULL;
+    Free(c->key);
+    c->key = NULL;
+    c->state = S_CLOSED;
+    c->next = lp->dead;
+    lp->dead = c;
+}
+
+// Write b[off..len] to fd. Returns 1 when all is sent, 0 if fd is full,
+// -1 on error.
+static int flush(conn_t *c, int fd){
+    ssize_t n;
+
+    while(c->off < c->b->len){
+        n = write(fd, c->b->data + c->off, c->b->len - c->off);
+        if(n < 0){
+            if(errno == EINTR)
+                continue;
+            return errno == EAGAIN ? 0 : -1;
+        }
+        c->off += n;
+    }
+    return 1;
+}
+
+// The client went away. A leader whose response others follow, or may
+// still join or find cached, goes on fetching without it; anything else
+// is closed (-1).
+static int client_gone(loop_t *lp, conn_t *c){
+    if(!c->flight || c->cli.fd < 0)
+        return -1;
+    if(c->state == S_RELAY && !c->cacheable && !flight_wanted(c->flight))
+        return -1;
+    close(c->cli.fd);
+    c->cli.fd = -1;
+    if(c->state == S_RELAY){
+        c->b->len = c->off = 0;
+        watch(lp, &c->srv, EPOLLIN);
+    }
+    return 0;
+}
+
+// Reply with an error and close. The request (or nothing) is in b.
+static int fail(loop_t *lp, conn_t *c, char *cause, char *errnum,
+                char *shortmsg, char *longmsg){
+    if(c->srv.fd >= 0){
+        close(c->srv.fd);
+        c->srv.fd = -1;
+    }
+    if(c->cli.fd < 0)
+        return -1;  // No one to tell
+    c->b->len = error_response(c->b->data, EV_BUFSIZE, cause, errnum, shortmsg, longmsg);
+    c->off = 0;
+    c->state = S_ERROR;
+    watch(lp, &c->cli, EPOLLOUT);
+    return flush(c, c->cli.fd) == 0 ? 0 : -1;
+}
+
+// S_HIT: send the rest of the object. Our reference keeps it alive even
+// if it is evicted meanwhile. Returns -1 (close) once it is all sent.
+static int hit_write(conn_t *c){
+    ssize_t n;
+
+    while(c->sent < c->obj->size){
+        n = write(c->cli.fd, c->obj->data + c->sent, c->obj->size - c->sent);
+        if(n < 0){
+            if(errno == EINTR)
+                continue;
+            return errno == EAGAIN ? 0 : -1;
+        }
+        c->sent += n;
+    }
+    return -1;
+}
+
+// Flight news for c, possibly from another loop's thread: queue c and
+// kick its loop
+static void wake_conn(void *arg){
+    conn_t *c = arg;
+    loop_t *lp = c->lp;
+    uint64_t one = 1;
+
+    pthread_mutex_lock(&lp->wlock);
+    if(!c->woken){
+        c->woken = 1;
+        c->wnext = lp->woken;
+        lp->woken = c;
+    }
+    pthread_mutex_unlock(&lp->wlock);
+    if(write(lp->wake.fd, &one, sizeof(one)) < 0)
+        ;  // Counter full: a wakeup is pending anyway
+}
+
+// S_WAIT: pass on what the leader has fetched so far. Returns -1 (close)
+// at the end of the response.
+static int wait_write(loop_t *lp, conn_t *c){
+    ssize_t n;
+    int r;
+
+    while(1){
+        if((r = flush(c, c->cli.fd)) <= 0){
+            if(r == 0)
+                watch(lp, &c->cli, EPOLLOUT);
+            return r;
+        }
+        n = flight_read(&c->rd, c->b->data, EV_BUFSIZE, 0);
+        if(n == FLIGHT_AGAIN){
+            watch(lp, &c->cli, 0);  // Until wake_conn
+            return 0;
+        }
+        if(n < 0 && c->sent == 0)
+            return fail(lp, c, c->key, "502", "Bad Gateway", "Proxy could not fetch the object");
+        if(n <= 0)
+            return -1;
+        c->b->len = n;
+        c->off = 0;
+        c->sent += n;
+    }
+}
+
+// Serve the readers other threads queued for this loop
+static void do_wake(loop_t *lp){
+    uint64_t cnt;
+    conn_t *c, *list;
+
+    if(read(lp->wake.fd, &cnt, sizeof(cnt)) < 0)
+        ;  // Spurious: nothing to drain
+    pthread_mutex_lock(&lp->wlock);
+    list = lp->woken;
+    lp->woken = NULL;
+    for(c = list; c; c = c->wnext)
+        c->woken = 0;
+    pthread_mutex_unlock(&lp->wlock);
+
+    while((c = list)){
+        list = c->wnext;
+        if(c->state == S_WAIT && wait_write(lp, c) < 0)
+            conn_close(lp, c);
+    }
+}
+
+// Start a non-blocking connect to host:port. Returns the socket or -1.
+static int connect_origin(char *host, char *port){
+    struct addrinfo hints, *list, *p;
+    int fd = -1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+    if(getaddrinfo(host, port, &hints, &list) != 0)
+        return -1;
+    for(p = list; p; p = p->ai_next){
+        fd = socket(p->ai_family, p->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, p->ai_protocol);
+        if(fd < 0)
+            continue;
+        if(connect(fd, p->ai_addr, p->ai_addrlen) == 0 || errno == EINPROGRESS)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(list);
+    return fd;
+}
+
+// The whole request is in b: parse it, then serve from the cache or
+// start the connection to the origin
+static int start_request(loop_t *lp, conn_t *c){
+    char method[MAXLINE], uri[MAXLINE], version[MAXLINE];
+    char host[MAXLINE], port[MAXLINE], path[MAXLINE];
+    char *line = c->b->data, *eol;
+    static __thread reqhdrs_t rh;
+    struct epoll_event event;
+    int len;
+
+    // 1. Request line
+    eol = strchr(line, '\n');
+    *eol = '\0';
+    if(eol - line >= MAXLINE || sscanf(line, "%s %s %s", method, uri, version) != 3)
+        return fail(lp, c, "", "400", "Bad Request", "Proxy could not parse the request");
+    if(strcasecmp(method, "GET"))
+        return fail(lp, c, method, "501", "Not Implemented", "Proxy does not implement this method");
+    if(parse_uri(uri, host, port, path) < 0)
+        return fail(lp, c, uri, "400", "Bad Request", "Proxy could not parse the URI");
+
+    // 2. Headers, one line at a time, up to the blank line
+    req_init(&rh);
+    for(line = eol + 1; (eol = strchr(line, '\n')) && eol - line > 1; line = eol + 1){
+        if(req_header(&rh, line, eol + 1 - line) < 0)
+            return fail(lp, c, uri, "400", "Bad Request", "Request headers too long");
+    }
+    if(rh.body)
+        return fail(lp, c, uri, "400", "Bad Request", "Proxy does not accept a body with GET");
+    c->key = Malloc(strlen(uri) + 1);
+    strcpy(c->key, uri);
+
+    // 3. Cached: send straight from the object, so b goes back to the pool
+    if((c->obj = cache_get(c->key))){
+        buf_put(lp, c->b);
+        c->b = NULL;
+        c->sent = 0;
+        c->state = S_HIT;
+        watch(lp, &c->cli, EPOLLOUT);
+        return hit_write(c);
+    }
+
+    // 4. Not cached: the rewritten request replaces the original in b
+    if((len = req_format(&rh, c->b->data, EV_BUFSIZE, host, port, path, 0)) < 0)
+        return fail(lp, c, uri, "400", "Bad Request", "Request headers too long");
+
+    // 5. Someone already fetching it? Then follow their response.
+    c->rd.wake = wake_conn;
+    c->rd.arg = c;
+    if(!flight_join(c->key, &c->flight, &c->rd)){
+        c->flight = NULL;
+        c->b->len = c->off = 0;
+        c->sent = 0;
+        c->state = S_WAIT;
+        return wait_write(lp, c);
+    }
+    // It may have been cached between our miss and the join
+    if((c->obj = cache_get(c->key))){
+        flight_append(c->flight, c->obj->data, c->obj->size);
+        flight_finish(c->flight, 1);
+        c->flight = NULL;
+        buf_put(lp, c->b);
+        c->b = NULL;
+        c->sent = 0;
+        c->state = S_HIT;
+        watch(lp, &c->cli, EPOLLOUT);
+        return hit_write(c);
+    }
+
+    c->b->len = len;
+    c->off = 0;
+    if((c->srv.fd = connect_origin(host, port)) < 0)
+        return fail(lp, c, host, "502", "Bad Gateway", "Proxy could not connect to the server");
+    c->srv.ev = EPOLLOUT;
+    event.events = EPOLLOUT;
+    event.data.ptr = &c->srv;
+    epoll_ctl(lp->epfd, EPOLL_CTL_ADD, c->srv.fd, &event);
+    watch(lp, &c->cli, 0);
+    c->state = S_CONNECT;
+    return 0;
+}
+
+// S_REQ: read until the blank line that ends the headers
+static int read_request(loop_t *lp, conn_t *c){
+    size_t from;
+    ssize_t n;
+    char *end;
+
+    // Buffers are only taken once there is data, so idle connections
+    // cost nothing but their conn_t. None left: wait for one.
+    if(!c->b && !(c->b = buf_get(lp))){
+        c->next = NULL;
+        if(lp->waitt)
+            lp->waitt->next = c;
+        else
+            lp->waith = c;
+        lp->waitt = c;
+        watch(lp, &c->cli, 0);
+        return 0;
+    }
+
+    while(c->b->len < EV_BUFSIZE - 1){
+        n = read(c->cli.fd, c->b->data + c->b->len, EV_BUFSIZE - 1 - c->b->len);
+        if(n == 0)
+            return -1;
+        if(n < 0){
+            if(errno == EINTR)
+                continue;
+            if(errno == EAGAIN)
+                break;
+            return -1;
+        }
+        c->b->len += n;
+    }
+    c->b->data[c->b->len] = '\0';
+
+    // Only search what is new (plus the last 3 bytes, which may begin
+    // the terminator)
+    from = c->scanned > 3 ? c->scanned - 3 : 0;
+    c->scanned = c->b->len;
+    end = strstr(c->b->data + from, "\r\n\r\n");
+    if(!end)
+        end = strstr(c->b->data + from, "\n\n");
+    if(end)
+        return start_request(lp, c);
+    if(c->b->len == EV_BUFSIZE - 1)
+        return fail(lp, c, "", "400", "Bad Request", "Request too long");
+    return 0;
+}
+
+// Keep a copy of n new bytes of the response for the cache, in pool
+// buffers. Gives up once the object is too big or the pool runs low, so
+// caching never starves new connections of buffers.
+static void keep_copy(loop_t *lp, conn_t *c, char *data, size_t n){
+    buf_t *b;
+    size_t k;
+
+    if(!c->cacheable)
+        return;
+    if(c->clen + n > MAX_OBJECT_SIZE){
+        drop_chain(lp, c);
+        return;
+    }
+    c->clen += n;
+    while(n > 0){
+        if(!c->tail || c->tail->len == EV_BUFSIZE){
+            if(lp->nfree <= lp->nbufs / 4 || !(b = buf_get(lp))){
+                drop_chain(lp, c);
+                return;
+            }
+            if(c->tail)
+                c->tail->next = b;
+            else
+                c->chain = b;
+            c->tail = b;
+        }
+        k = EV_BUFSIZE - c->tail->len < n ? EV_BUFSIZE - c->tail->len : n;
+        memcpy(c->tail->data + c->tail->len, data, k);
+        c->tail->len += k;
+        data += k;
+        n -= k;
+    }
+}
+
+// Response complete: hand the copy to the cache
+static void cache_copy(conn_t *c){
+    char *obj, *p;
+    buf_t *b;
+
+    if(!c->cacheable || c->clen == 0)
+        return;
+    p = obj = Malloc(c->clen);
+    for(b = c->chain; b; b = b->next){
+        memcpy(p, b->data, b->len);
+        p += b->len;
+    }
+    cache_insert(c->key, obj, c->clen);
+    Free(obj);
+}
+
+// S_RELAY: b is empty; read the next piece of the response and pass it on.
+// Like fetch(), only a response that ends where its framing says (or a
+// close-delimited one that ends with the connection) is cached and
+// passed to followers as complete.
+static int relay_read(loop_t *lp, conn_t *c){
+    ssize_t n = read(c->srv.fd, c->b->data, EV_BUFSIZE);
+    int r;
+
+    if(n == 0){
+        if(c->fr->state == F_EOF)
+            cache_copy(c);
+        flight_finish(c->flight, c->fr->state == F_EOF);
+        c->flight = NULL;
+        return -1;
+    }
+    if(n < 0)
+        return errno == EAGAIN || errno == EINTR ? 0 : -1;
+    c->b->len = frame_feed(c->fr, c->b->data, n);  // Nothing past its end
+    c->off = 0;
+    keep_copy(lp, c, c->b->data, c->b->len);
+    flight_append(c->flight, c->b->data, c->b->len);
+
+    // All of it: no need to wait for the origin to close
+    if(c->fr->state == F_DONE){
+        cache_copy(c);
+        flight_finish(c->flight, 1);
+        c->flight = NULL;
+        close(c->srv.fd);
+        c->srv.fd = -1;
+    }
+
+    // Client gone: fetch on while the response is still of use
+    if(c->cli.fd < 0){
+        c->b->len = 0;
+        if(c->srv.fd < 0 || (!c->cacheable && !flight_wanted(c->flight)))
+            return -1;
+        return 0;
+    }
+
+    // Client can't take it all: stop reading until it can
+    if((r = flush(c, c->cli.fd)) == 0){
+        if(c->srv.fd >= 0)
+            watch(lp, &c->srv, 0);
+        watch(lp, &c->cli, EPOLLOUT);
+    }
+    if(r < 0)
+        return c->srv.fd < 0 ? -1 : client_gone(lp, c);
+    return r == 1 && c->srv.fd < 0 ? -1 : 0;
+}
+
+// S_RELAY: the client can take more
+static int relay_write(loop_t *lp, conn_t *c){
+    int r = flush(c, c->cli.fd);
+
+    if(r == 1 && c->srv.fd < 0)
+        return -1;  // That was the end of the response
+    if(r == 1){
+        c->b->len = c->off = 0;
+        watch(lp, &c->cli, 0);
+        watch(lp, &c->srv, EPOLLIN);
+    }
+    if(r < 0)
+        return c->srv.fd < 0 ? -1 : client_gone(lp, c);
+    return 0;
+}
+
+// Dispatch one event on one side of a connection. Returns -1 to close it.
+static int handle(loop_t *lp, end_t *e, unsigned int events){
+    conn_t *c = e->c;
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    // Left over from a side closed earlier in this batch
+    if(e->fd < 0)
+        return 0;
+    // Client gone (only the error reply may still be flushing into it)
+    if(e == &c->cli && (events & (EPOLLERR | EPOLLHUP)))
+        return client_gone(lp, c);
+
+    switch(c->state){
+    case S_REQ:
+        return read_request(lp, c);
+    case S_CONNECT:
+        if(getsockopt(c->srv.fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err)
+            return fail(lp, c, "", "502", "Bad Gateway", "Proxy could not connect to the server");
+        c->state = S_SEND;
+        /* Fall through */
+    case S_SEND:
+        switch(flush(c, c->srv.fd)){
+        case -1:
+            return fail(lp, c, "", "502", "Bad Gateway", "Proxy could not send the request");
+        case 1:
+            c->state = S_RELAY;
+            c->b->len = c->off = 0;
+            c->cacheable = 1;
+            c->fr = Malloc(sizeof(frame_t));
+            frame_init(c->fr);
+            watch(lp, &c->srv, EPOLLIN);
+        }
+        return 0;
+    case S_RELAY:
+        return e == &c->srv ? relay_read(lp, c) : relay_write(lp, c);
+    case S_HIT:
+        return hit_write(c);
+    case S_WAIT:
+        return wait_write(lp, c);
+    case S_ERROR:
+        return flush(c, c->cli.fd) == 0 ? 0 : -1;
+    }
+    return 0;
+}
+
+// Accept everything pending on this loop's listening socket
+static void do_accept(loop_t *lp){
+    struct epoll_event event;
+    conn_t *c;
+    int fd, one = 1;
+
+    while((fd = accept(lp->listen.fd, NULL, NULL)) >= 0){
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        if(!(c = calloc(1, sizeof(conn_t)))){
+            close(fd);
+            continue;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        c->cli.c = c->srv.c = c;
+        c->lp = lp;
+        c->cli.fd = fd;
+        c->srv.fd = -1;
+        c->cli.ev = EPOLLIN;
+        c->state = S_REQ;
+        event.events = EPOLLIN;
+        event.data.ptr = &c->cli;
+        if(epoll_ctl(lp->epfd, EPOLL_CTL_ADD, fd, &event) < 0){
+            close(fd);
+            free(c);
+        }
+    }
+}
+
+// Listening socket of one loop; with SO_REUSEPORT the kernel spreads
+// incoming connections over the loops
+static int open_reuseport(char *port){
+    struct addrinfo hints, *list, *p;
+    int fd = -1, one = 1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_ADDRCONFIG | AI_NUMERICSERV;
+    if(getaddrinfo(NULL, port, &hints, &list) != 0)
+        return -1;
+    for(p = list; p; p = p->ai_next){
+        fd = socket(p->ai_family, p->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, p->ai_protocol);
+        if(fd < 0)
+            continue;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+        if(bind(fd, p->ai_addr, p->ai_addrlen) == 0 && listen(fd, BACKLOG) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(list);
+    return fd;
+}
+
+static void *loop_main(void *vargp){
+    loop_t *lp = vargp;
+    struct epoll_event events[MAXEVENTS], event;
+    buf_t *bufs;
+    conn_t *c;
+    int i, n;
+
+    // 1. Buffer pool (pages are only touched once a buffer is used)
+    bufs = Malloc(sizeof(buf_t) * pool_size);
+    lp->nbufs = lp->nfree = pool_size;
+    for(i = 0; i < pool_size; i++){
+        bufs[i].next = i + 1 < pool_size ? &bufs[i + 1] : NULL;
+    }
+    lp->free = bufs;
+
+    // 2. Listening socket and epoll
+    if((lp->listen.fd = open_reuseport(listen_port)) < 0)
+        unix_error("open_reuseport error");
+    lp->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if(lp->epfd < 0)
+        unix_error("epoll_create1 error");
+    event.events = EPOLLIN;
+    event.data.ptr = &lp->listen;
+    epoll_ctl(lp->epfd, EPOLL_CTL_ADD, lp->listen.fd, &event);
+    pthread_mutex_init(&lp->wlock, NULL);
+    if((lp->wake.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+        unix_error("eventfd error");
+    event.data.ptr = &lp->wake;
+    epoll_ctl(lp->epfd, EPOLL_CTL_ADD, lp->wake.fd, &event);
+
+    // 3. Event loop
+    while(1){
+        n = epoll_wait(lp->epfd, events, MAXEVENTS, -1);
+        for(i = 0; i < n; i++){
+            end_t *e = events[i].data.ptr;
+
+            if(e == &lp->listen){
+                do_accept(lp);
+                continue;
+            }
+            if(e == &lp->wake){
+                do_wake(lp);
+                continue;
+            }
+            if(e->c->state == S_CLOSED)
+                continue;
+            if(handle(lp, e, events[i].events) < 0)
+                conn_close(lp, e->c);
+        }
+        while((c = lp->dead)){
+            lp->dead = c->next;
+            free(c);
+        }
+    }
+    return NULL;
+}
+
+void event_main(char *port, int nloops, int nbufs){
+    struct rlimit rl;
+    pthread_t tid;
+    loop_t *loops;
+    int i;
+
+    listen_port = port;
+    pool_size = nbufs;
+    if(nloops <= 0)
+        nloops = sysconf(_SC_NPROCESSORS_ONLN);
+
+    // One descriptor per client and one per origin connection
+    if(getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max){
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    loops = Calloc(nloops, sizeof(loop_t));
+    for(i = 1; i < nloops; i++)
+        Pthread_create(&tid, NULL, loop_main, &loops[i]);
+    loop_main(&loops[0]);
+}
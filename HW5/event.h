@@ -0,0 +1,10 @@
+// Jisang Park 2017-15108
+#ifndef __EVENT_H__
+#define __EVENT_H__
+
+#define EV_BUFSIZE 16384  // Bytes per I/O buffer (also the max request size)
+#define EV_NBUFS   4096   // Default I/O buffers per loop
+
+void event_main(char *port, int nloops, int nbufs);
+
+#endif /* __EVENT_H__ */
@@ -0,0 +1,284 @@
+// Jisang Park 2017-15108
+// Single-flight table for origin fetches; see flight.h.
+//
+// The response is kept as a list of chunks, one per append. Each chunk
+// counts its users: every reader that has not read past it, plus the
+// flight itself while it is joinable (a joiner starts from byte 0). So
+// chunks are freed from the head as the slowest reader moves on.
+#include "csapp.h"
+#include "cache.h"
+#include "flight.h"
+
+#define NFLIGHTS 256   // Hash buckets
+
+#define F_RUN  0
+#define F_DONE 1
+#define F_FAIL 2
+
+struct fchunk{
+    struct fchunk *next;
+    int refs;
+    size_t len;
+    char data[];
+};
+
+struct flight{
+    char *key;
+    pthread_mutex_t lock;   // Everything below
+    pthread_cond_t more;    // Blocking readers wait here
+    fchunk_t *head, *tail;
+    size_t total;           // Bytes appended
+    int state;
+    int joinable;           // In the table; also guarded by table_lock
+    int refs;               // Leader (until finished) plus readers
+    int nreaders;           // Readers not dropped
+    freader_t *readers;
+    struct flight *hnext;
+};
+
+static flight_t *table[NFLIGHTS];
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// djb2 string hash
+static unsigned long hash(char *key){
+    unsigned long h = 5381;
+    while(*key)
+        h = h * 33 + (unsigned char)*key++;
+    return h;
+}
+
+// Free the chunks no one needs any more (always a prefix of the list)
+static void trim(flight_t *f){
+    fchunk_t *c;
+
+    while((c = f->head) && c->refs == 0){
+        f->head = c->next;
+        if(!f->head)
+            f->tail = NULL;
+        Free(c);
+    }
+}
+
+static void wake_all(flight_t *f){
+    freader_t *r;
+
+    pthread_cond_broadcast(&f->more);
+    for(r = f->readers; r; r = r->next)
+        if(r->wake)
+            r->wake(r->arg);
+}
+
+static void put_flight(flight_t *f){
+    int last;
+
+    pthread_mutex_lock(&f->lock);
+    last = --f->refs == 0;
+    pthread_mutex_unlock(&f->lock);
+    if(!last)
+        return;
+    trim(f);
+    pthread_mutex_destroy(&f->lock);
+    pthread_cond_destroy(&f->more);
+    Free(f->key);
+    Free(f);
+}
+
+// Take f out of the table: no new readers, and it stops holding the
+// chunks for them
+static void unjoin(flight_t *f){
+    flight_t **pp;
+    fchunk_t *c;
+
+    pthread_mutex_lock(&table_lock);
+    if(f->joinable){
+        for(pp = &table[hash(f->key) % NFLIGHTS]; *pp != f; pp = &(*pp)->hnext)
+            ;
+        *pp = f->hnext;
+        pthread_mutex_lock(&f->lock);
+        f->joinable = 0;
+        for(c = f->head; c; c = c->next)
+            c->refs--;
+        trim(f);
+        pthread_mutex_unlock(&f->lock);
+    }
+    pthread_mutex_unlock(&table_lock);
+}
+
+// Find the flight for key. Returns 1 if there was none: the caller
+// leads a new one (*fp) and must fetch and flight_finish() it. Returns 0
+// if one is under way: r (whose wake and arg the caller set) now reads it.
+int flight_join(char *key, flight_t **fp, freader_t *r){
+    unsigned long h = hash(key) % NFLIGHTS;
+    flight_t *f;
+    fchunk_t *c;
+
+    pthread_mutex_lock(&table_lock);
+    for(f = table[h]; f; f = f->hnext)
+        if(strcmp(f->key, key) == 0)
+            break;
+    if(f){
+        pthread_mutex_lock(&f->lock);
+        r->f = f;
+        r->chunk = NULL;
+        r->off = 0;
+        r->pos = 0;
+        r->dropped = 0;
+        for(c = f->head; c; c = c->next)
+            c->refs++;
+        r->next = f->readers;
+        f->readers = r;
+        f->nreaders++;
+        f->refs++;
+        pthread_mutex_unlock(&f->lock);
+        pthread_mutex_unlock(&table_lock);
+        *fp = f;
+        return 0;
+    }
+
+    f = Calloc(1, sizeof(flight_t));
+    f->key = Malloc(strlen(key) + 1);
+    strcpy(f->key, key);
+    pthread_mutex_init(&f->lock, NULL);
+    pthread_cond_init(&f->more, NULL);
+    f->state = F_RUN;
+    f->joinable = 1;
+    f->refs = 1;
+    f->hnext = table[h];
+    table[h] = f;
+    pthread_mutex_unlock(&table_lock);
+    *fp = f;
+    return 1;
+}
+
+// Release every chunk r still holds. Called with f locked.
+static void release(flight_t *f, freader_t *r){
+    fchunk_t *c;
+
+    for(c = r->chunk ? r->chunk : f->head; c; c = c->next)
+        c->refs--;
+    r->chunk = NULL;
+    trim(f);
+}
+
+// Leader: n more bytes of the response arrived
+void flight_append(flight_t *f, char *buf, size_t n){
+    freader_t *r;
+    fchunk_t *c;
+    int over;
+
+    pthread_mutex_lock(&f->lock);
+    if(f->nreaders == 0 && !f->joinable){
+        pthread_mutex_unlock(&f->lock);
+        return;
+    }
+    c = Malloc(sizeof(fchunk_t) + n);
+    c->next = NULL;
+    c->refs = f->nreaders + f->joinable;
+    c->len = n;
+    memcpy(c->data, buf, n);
+    if(f->tail)
+        f->tail->next = c;
+    else
+        f->head = c;
+    f->tail = c;
+    f->total += n;
+    over = f->joinable && f->total > MAX_OBJECT_SIZE;
+
+    // Drop readers too far behind rather than buffer for them
+    for(r = f->readers; r; r = r->next){
+        if(!r->dropped && f->total - r->pos > FLIGHT_MAX_LAG){
+            release(f, r);
+            r->dropped = 1;
+            f->nreaders--;
+        }
+    }
+    wake_all(f);
+    pthread_mutex_unlock(&f->lock);
+
+    // Too big to keep from the start: readers in already keep streaming
+    if(over)
+        unjoin(f);
+}
+
+// Leader: the response is complete (ok) or broken off. Drops the
+// leader's reference.
+void flight_finish(flight_t *f, int ok){
+    unjoin(f);
+    pthread_mutex_lock(&f->lock);
+    f->state = ok ? F_DONE : F_FAIL;
+    wake_all(f);
+    pthread_mutex_unlock(&f->lock);
+    put_flight(f);
+}
+
+// Leader: whether anyone may still read the response, now or by joining
+int flight_wanted(flight_t *f){
+    int wanted;
+
+    pthread_mutex_lock(&f->lock);
+    wanted = f->nreaders > 0 || f->joinable;
+    pthread_mutex_unlock(&f->lock);
+    return wanted;
+}
+
+// Reader: copy up to len bytes of the response. Returns the count, 0 at
+// the end, -1 if the leader failed or r was dropped, or FLIGHT_AGAIN if
+// there is nothing new and block is 0.
+ssize_t flight_read(freader_t *r, char *buf, size_t len, int block){
+    flight_t *f = r->f;
+    fchunk_t *c;
+    size_t k;
+    int state;
+
+    pthread_mutex_lock(&f->lock);
+    while(1){
+        if(r->dropped){
+            pthread_mutex_unlock(&f->lock);
+            return -1;
+        }
+        if(!r->chunk && f->head){
+            r->chunk = f->head;
+            r->off = 0;
+        }
+        c = r->chunk;
+        if(c && r->off < c->len){
+            k = c->len - r->off < len ? c->len - r->off : len;
+            memcpy(buf, c->data + r->off, k);
+            r->off += k;
+            r->pos += k;
+            pthread_mutex_unlock(&f->lock);
+            return k;
+        }
+        if(c && c->next){
+            r->chunk = c->next;
+            r->off = 0;
+            c->refs--;
+            trim(f);
+            continue;
+        }
+        if(f->state != F_RUN || !block)
+            break;
+        pthread_cond_wait(&f->more, &f->lock);
+    }
+    state = f->state;
+    pthread_mutex_unlock(&f->lock);
+    return state == F_DONE ? 0 : state == F_FAIL ? -1 : FLIGHT_AGAIN;
+}
+
+// Reader: stop reading (at the end or not). No wake calls follow.
+void flight_leave(freader_t *r){
+    flight_t *f = r->f;
+    freader_t **pp;
+
+    pthread_mutex_lock(&f->lock);
+    if(!r->dropped){
+        release(f, r);
+        f->nreaders--;
+    }
+    for(pp = &f->readers; *pp != r; pp = &(*pp)->next)
+        ;
+    *pp = r->next;
+    pthread_mutex_unlock(&f->lock);
+    put_flight(f);
+    r->f = NULL;
+}
@@ -0,0 +1,44 @@
+// Jisang Park 2017-15108
+#ifndef __FLIGHT_H__
+#define __FLIGHT_H__
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// In-flight origin fetches (single-flight). The first miss on a URI
+// leads: it fetches and appends the response as it arrives. Later misses
+// join as readers and stream the same bytes from the start instead of
+// fetching again. A flight stays joinable while it is no bigger than
+// MAX_OBJECT_SIZE; past that, readers already in keep streaming but new
+// misses start a fetch of their own.
+//
+// Chunks are held until the slowest reader is past them, so a reader that
+// falls more than FLIGHT_MAX_LAG bytes behind the leader is dropped: its
+// reads fail as if the fetch had, and the memory a flight holds stays
+// bounded whatever its readers' clients do.
+
+#define FLIGHT_AGAIN (-2)  // flight_read: no new data yet (non-blocking)
+#define FLIGHT_MAX_LAG (512 * 1024)  // Bytes a reader may fall behind
+
+typedef struct flight flight_t;
+typedef struct fchunk fchunk_t;
+
+typedef struct freader{
+    flight_t *f;
+    fchunk_t *chunk;    // Chunk being read, NULL before the first
+    size_t off;         // Next byte of chunk
+    size_t pos;         // Bytes read so far
+    int dropped;        // Fell too far behind; holds no chunks
+    void (*wake)(void *arg);  // Called (flight locked) when there is news
+    void *arg;
+    struct freader *next;
+} freader_t;
+
+int flight_join(char *key, flight_t **fp, freader_t *r);
+void flight_append(flight_t *f, char *buf, size_t n);
+void flight_finish(flight_t *f, int ok);
+int flight_wanted(flight_t *f);
+ssize_t flight_read(freader_t *r, char *buf, size_t len, int block);
+void flight_leave(freader_t *r);
+
+#endif /* __FLIGHT_H__ */
@@ -0,0 +1,142 @@
+// Jisang Park 2017-15108
+// Header parsing throughput: reading requests line by line as the proxy
+// does, with csapp's rio_readlineb, bufio's compatible bio_readlineb,
+// and bufio's zero-copy bio_line. The requests come from a file in the
+// page cache, so reading costs the same for each and the difference is
+// in the line handling.
+//   usage: hdrbench [-n requests] [-r rounds]
+#include "csapp.h"
+#include "bufio.h"
+#include "http.h"
+
+static const char *request =
+    "GET http://www.example.com:8080/images/logo.png?v=3 HTTP/1.1\r\n"
+    "Host: www.example.com:8080\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:10.0.3) Gecko/20120305 Firefox/10.0.3\r\n"
+    "Accept: image/avif,image/webp,image/apng,image/*,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.9,ko;q=0.8\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Referer: http://www.example.com:8080/index.html\r\n"
+    "Cookie: session=6f1c2a9e0b7d4c3a; theme=dark; lang=en\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Pragma: no-cache\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+typedef struct{
+    unsigned long reqs, lines;
+} count_t;
+
+static double now(void){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void with_rio(int fd, count_t *c){
+    char buf[MAXLINE];
+    reqhdrs_t rh;
+    rio_t rio;
+
+    rio_readinitb(&rio, fd);
+    while(rio_readlineb(&rio, buf, MAXLINE) > 0){
+        req_init(&rh);
+        while(rio_readlineb(&rio, buf, MAXLINE) > 0 && strcmp(buf, "\r\n")){
+            req_header(&rh, buf, strlen(buf));
+            c->lines++;
+        }
+        c->reqs++;
+    }
+}
+
+static void with_readlineb(int fd, count_t *c){
+    char buf[MAXLINE];
+    reqhdrs_t rh;
+    ssize_t n;
+    bio_t bio;
+
+    bio_init(&bio, fd);
+    while(bio_readlineb(&bio, buf, MAXLINE) > 0){
+        req_init(&rh);
+        while((n = bio_readlineb(&bio, buf, MAXLINE)) > 0 && strcmp(buf, "\r\n")){
+            req_header(&rh, buf, n);
+            c->lines++;
+        }
+        c->reqs++;
+    }
+}
+
+static void with_line(int fd, count_t *c){
+    reqhdrs_t rh;
+    char *line;
+    ssize_t n;
+    bio_t bio;
+
+    bio_init(&bio, fd);
+    while(bio_line(&bio, &line) > 0){
+        req_init(&rh);
+        while((n = bio_line(&bio, &line)) > 0 && !(n == 2 && line[0] == '\r')){
+            req_header(&rh, line, n);
+            c->lines++;
+        }
+        c->reqs++;
+    }
+}
+
+int main(int argc, char **argv){
+    struct{
+        char *name;
+        void (*run)(int, count_t *);
+    } modes[] = {
+        { "rio_readlineb", with_rio },
+        { "bio_readlineb", with_readlineb },
+        { "bio_line", with_line },
+    };
+    int nreqs = 20000, rounds = 5, c, i, m, fd;
+    size_t len = strlen(request);
+    double best, t;
+    count_t cnt;
+    FILE *fp;
+
+    while((c = getopt(argc, argv, "n:r:")) != -1){
+        switch(c){
+        case 'n': nreqs = atoi(optarg); break;
+        case 'r': rounds = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-n requests] [-r rounds]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    if(!(fp = tmpfile())){
+        perror("tmpfile");
+        exit(1);
+    }
+    for(i = 0; i < nreqs; i++)
+        fwrite(request, 1, len, fp);
+    fflush(fp);
+    fd = fileno(fp);
+
+    printf("%d requests of %zu bytes, best of %d rounds\n", nreqs, len, rounds);
+    printf("%-14s %12s %10s %10s\n", "", "requests/s", "MB/s", "ns/line");
+    for(m = 0; m < 3; m++){
+        best = 1e9;
+        for(i = 0; i < rounds; i++){
+            memset(&cnt, 0, sizeof(cnt));
+            lseek(fd, 0, SEEK_SET);
+            t = now();
+            modes[m].run(fd, &cnt);
+            t = now() - t;
+            if(cnt.reqs != (unsigned long)nreqs){
+                fprintf(stderr, "%s: read %lu requests, not %d\n", modes[m].name, cnt.reqs, nreqs);
+                exit(1);
+            }
+            if(t < best)
+                best = t;
+        }
+        printf("%-14s %12.0f %10.1f %10.1f\n", modes[m].name, nreqs / best,
+               nreqs * len / best / 1e6, best * 1e9 / (cnt.reqs + cnt.lines));
+    }
+    return 0;
+}
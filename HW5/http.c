@@ -0,0 +1,385 @@
+// Jisang Park 2017-15108
+// HTTP request parsing and rewriting, and response framing, shared by the
+// threaded and event engines
+#include "csapp.h"
+#include "http.h"
+
+/* You won't lose style points for including this long line in your code */
+static const char *user_agent_hdr = "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:10.0.3) Gecko/20120305 Firefox/10.0.3\r\n";
+
+// Split "http://host[:port][/path]" into its parts. Returns -1 if malformed.
+int parse_uri(char *uri, char *host, char *port, char *path)
+{
+    char *p, *slash, *colon;
+    size_t len;
+
+    if(strncasecmp(uri, "http://", 7))
+        return -1;
+    p = uri + 7;
+
+    // Path (default "/")
+    slash = strchr(p, '/');
+    if(strlen(slash ? slash : "/") >= MAXLINE)
+        return -1;
+    strcpy(path, slash ? slash : "/");
+    len = slash ? (size_t)(slash - p) : strlen(p);
+    if(len >= MAXLINE)
+        return -1;
+
+    // Host and port (default 80)
+    colon = memchr(p, ':', len);
+    if(colon){
+        memcpy(host, p, colon - p);
+        host[colon - p] = '\0';
+        memcpy(port, colon + 1, len - (colon - p) - 1);
+        port[len - (colon - p) - 1] = '\0';
+    }
+    else{
+        memcpy(host, p, len);
+        host[len] = '\0';
+        strcpy(port, "80");
+    }
+    return host[0] ? 0 : -1;
+}
+
+void req_init(reqhdrs_t *rh)
+{
+    rh->host[0] = '\0';
+    rh->other[0] = '\0';
+    rh->olen = 0;
+    rh->named[0] = '\0';
+    rh->nlen = 0;
+    rh->conn = CONN_NONE;
+    rh->body = 0;
+}
+
+// Does the header line (len bytes) list token (case-insensitively) in
+// its value?
+static int has_token(char *line, size_t len, char *token)
+{
+    size_t tlen = strlen(token);
+    char *end = line + len, *p = memchr(line, ':', len);
+
+    for(p = p ? p + 1 : line; p + tlen <= end; p++)
+        if(!strncasecmp(p, token, tlen))
+            return 1;
+    return 0;
+}
+
+// Is the line (len bytes) a header called name (with its colon)?
+static int is_header(char *line, size_t len, char *name)
+{
+    size_t n = strlen(name);
+
+    return len >= n && !strncasecmp(line, name, n);
+}
+
+// Is the header on line (len bytes) one whose name is in the
+// comma-separated list (case-insensitively)?
+static int is_listed(char *list, char *line, size_t len)
+{
+    char *colon = memchr(line, ':', len), *p, *q, *end;
+    size_t n;
+
+    if(!colon)
+        return 0;
+    n = colon - line;
+    for(p = list; *p; p = *end ? end + 1 : end){
+        while(*p == ' ' || *p == '\t')
+            p++;
+        for(end = p; *end && *end != ','; end++)
+            ;
+        if((size_t)(end - p) < n || strncasecmp(p, line, n))
+            continue;
+        for(q = p + n; q < end && strchr(" \t\r\n", *q); q++)
+            ;
+        if(q == end)
+            return 1;
+    }
+    return 0;
+}
+
+// Take one header line of len bytes (with its line ending, and not
+// necessarily terminated). Returns -1 if the headers no longer fit.
+//
+// Hop-by-hop headers stay here, and so do the framing headers: we only
+// forward GETs without a body (rh->body says if the client sent one),
+// and a Content-Length or Transfer-Encoding on those would make the
+// origin wait for a body, or read the next pooled request as one.
+int req_header(reqhdrs_t *rh, char *line, size_t len)
+{
+    char *colon, *end;
+    long long clen;
+
+    if(is_header(line, len, "Host:")){
+        if(len >= MAXLINE)
+            return -1;
+        memcpy(rh->host, line, len);
+        rh->host[len] = '\0';
+        return 0;
+    }
+    // Replaced by ours in req_format
+    if(is_header(line, len, "Connection:") || is_header(line, len, "Proxy-Connection:")){
+        if(has_token(line, len, "close"))
+            rh->conn = CONN_CLOSE;
+        else if(has_token(line, len, "keep-alive"))
+            rh->conn = CONN_KEEP;
+
+        // The headers it names are for this hop only; req_format drops them
+        colon = memchr(line, ':', len);
+        if(rh->nlen + len + 1 >= MAXLINE)
+            return -1;
+        rh->named[rh->nlen++] = ',';
+        memcpy(rh->named + rh->nlen, colon + 1, line + len - colon - 1);
+        rh->nlen += line + len - colon - 1;
+        rh->named[rh->nlen] = '\0';
+        return 0;
+    }
+    if(is_header(line, len, "Content-Length:")){
+        clen = strtoll(line + 15, &end, 10);
+        if(clen != 0 || end == line + 15)
+            rh->body = 1;
+        return 0;
+    }
+    if(is_header(line, len, "Transfer-Encoding:")){
+        rh->body = 1;
+        return 0;
+    }
+    if(is_header(line, len, "User-Agent:") || is_header(line, len, "Keep-Alive:") ||
+       is_header(line, len, "TE:") || is_header(line, len, "Trailer:") ||
+       is_header(line, len, "Upgrade:") || is_header(line, len, "Proxy-Authorization:"))
+        return 0;
+    if(rh->olen + len >= MAXBUF)
+        return -1;
+    memcpy(rh->other + rh->olen, line, len);
+    rh->olen += len;
+    rh->other[rh->olen] = '\0';
+    return 0;
+}
+
+// Build the request for the origin into req: the client's Host (or
+// ours), our User-Agent and Connection headers, then the client's
+// remaining headers but those its Connection header named. HTTP/1.0 and
+// Connection: close, or with keepalive, HTTP/1.1 on a connection we mean
+// to reuse. Returns its length, or -1 if it does not fit.
+int req_format(reqhdrs_t *rh, char *req, size_t size,
+               char *host, char *port, char *path, int keepalive)
+{
+    char hosthdr[MAXLINE], *line, *eol;
+    size_t len, n;
+
+    if(rh->host[0])
+        strcpy(hosthdr, rh->host);
+    else
+        snprintf(hosthdr, MAXLINE, "Host: %s%s%s\r\n", host,
+                 strcmp(port, "80") ? ":" : "", strcmp(port, "80") ? port : "");
+
+    if(keepalive)
+        len = snprintf(req, size, "GET %s HTTP/1.1\r\n%s%sConnection: keep-alive\r\n",
+                       path, hosthdr, user_agent_hdr);
+    else
+        len = snprintf(req, size, "GET %s HTTP/1.0\r\n%s%sConnection: close\r\n"
+                       "Proxy-Connection: close\r\n",
+                       path, hosthdr, user_agent_hdr);
+    if(len >= size)
+        return -1;
+
+    for(line = rh->other; *line; line = eol){
+        eol = strchr(line, '\n');
+        eol = eol ? eol + 1 : line + strlen(line);
+        n = eol - line;
+        if(rh->nlen && is_listed(rh->named, line, n))
+            continue;
+        if(len + n >= size)
+            return -1;
+        memcpy(req + len, line, n);
+        len += n;
+    }
+    if(len + 3 > size)
+        return -1;
+    memcpy(req + len, "\r\n", 3);
+    return len + 2;
+}
+
+void frame_init(frame_t *f)
+{
+    f->state = F_HEAD;
+    f->hlen = 0;
+    f->raw = 0;
+}
+
+// The headers are complete in f->head: pick how the body is framed
+static void frame_head(frame_t *f)
+{
+    char *line, *eol;
+    int keep = 0;
+
+    f->head[f->hlen] = '\0';
+    f->status = 0;
+    f->minor = 0;
+    f->chunked = 0;
+    f->clen = -1;
+    f->close = 0;
+    if(sscanf(f->head, "HTTP/1.%d %d", &f->minor, &f->status) != 2){
+        // Not a response we understand: relay it until the origin closes
+        f->close = 1;
+        f->state = F_EOF;
+        return;
+    }
+    for(line = strchr(f->head, '\n') + 1; (eol = strchr(line, '\n')); line = eol + 1){
+        if(!strncasecmp(line, "Content-Length:", 15))
+            f->clen = strtoll(line + 15, NULL, 10);
+        else if(!strncasecmp(line, "Transfer-Encoding:", 18))
+            f->chunked = has_token(line, eol - line, "chunked");
+        else if(!strncasecmp(line, "Connection:", 11)){
+            f->close |= has_token(line, eol - line, "close");
+            keep = has_token(line, eol - line, "keep-alive");
+        }
+    }
+    if(f->minor == 0 && !keep)
+        f->close = 1;
+
+    if(f->status / 100 == 1 || f->status == 204 || f->status == 304)
+        f->state = F_DONE;
+    else if(f->chunked){
+        f->state = F_CSIZE;
+        f->left = 0;
+    }
+    else if(f->clen >= 0){
+        f->state = f->clen ? F_LEN : F_DONE;
+        f->left = f->clen;
+    }
+    else{
+        f->close = 1;
+        f->state = F_EOF;
+    }
+}
+
+// Consume the next run of buf that is all in one part of the response,
+// and say whether it is body data (*data). Returns how much was used; 0
+// once the response is over.
+size_t frame_step(frame_t *f, char *buf, size_t n, int *data)
+{
+    size_t i, k, from;
+    char *end;
+    int v;
+
+    *data = 0;
+    switch(f->state){
+    case F_HEAD:
+        // Collect the headers, looking for the blank line that ends them
+        // (possibly split over calls, so look back 3 bytes)
+        from = f->hlen > 3 ? f->hlen - 3 : 0;
+        k = n < MAXBUF - 1 - f->hlen ? n : MAXBUF - 1 - f->hlen;
+        memcpy(f->head + f->hlen, buf, k);
+        f->head[f->hlen + k] = '\0';
+        for(i = from; i < f->hlen + k; i++){
+            if(f->head[i] == '\n' && (f->head[i + 1] == '\n' ||
+               (f->head[i + 1] == '\r' && f->head[i + 2] == '\n'))){
+                end = f->head + i + (f->head[i + 1] == '\n' ? 2 : 3);
+                k = end - (f->head + f->hlen);
+                f->hlen = end - f->head;
+                frame_head(f);
+                return k;
+            }
+        }
+        f->hlen += k;
+        if(f->hlen == MAXBUF - 1){
+            f->raw = 1;
+            f->close = 1;
+            f->state = F_EOF;
+        }
+        return k;
+    case F_LEN:
+    case F_CDATA:
+        k = (long long)n < f->left ? n : (size_t)f->left;
+        f->left -= k;
+        if(f->left == 0)
+            f->state = f->state == F_LEN ? F_DONE : F_CEND;
+        *data = 1;
+        return k;
+    case F_EOF:
+        *data = 1;
+        return n;
+    case F_CSIZE:
+        for(i = 0; i < n; i++){
+            v = buf[i];
+            if(isxdigit(v) && f->left < (1LL << 40))
+                f->left = f->left * 16 + (isdigit(v) ? v - '0' : (tolower(v) - 'a' + 10));
+            else if(v == '\n'){
+                f->state = f->left ? F_CDATA : F_TRAILER;
+                f->linelen = 0;
+                return i + 1;
+            }
+            else if(v == ';' || v == '\r' || v == ' ' || v == '\t'){
+                f->state = F_CEXT;
+                return i + 1;
+            }
+            else{
+                f->close = 1;   // Garbage: fall back to reading until EOF
+                f->state = F_EOF;
+                return i;
+            }
+        }
+        return n;
+    case F_CEXT:
+        if(!(end = memchr(buf, '\n', n)))
+            return n;
+        f->state = f->left ? F_CDATA : F_TRAILER;
+        f->linelen = 0;
+        return end - buf + 1;
+    case F_CEND:
+        if(!(end = memchr(buf, '\n', n)))
+            return n;
+        f->state = F_CSIZE;
+        f->left = 0;
+        return end - buf + 1;
+    case F_TRAILER:
+        for(i = 0; i < n; i++){
+            if(buf[i] == '\n'){
+                if(f->linelen == 0){
+                    f->state = F_DONE;
+                    return i + 1;
+                }
+                f->linelen = 0;
+            }
+            else if(buf[i] != '\r')
+                f->linelen++;
+        }
+        return n;
+    }
+    return 0;
+}
+
+// Consume as much of buf as belongs to this response. Returns how much:
+// less than n only if the response ended inside buf.
+size_t frame_feed(frame_t *f, char *buf, size_t n)
+{
+    size_t used = 0, k;
+    int data;
+
+    while(used < n && f->state != F_DONE){
+        k = frame_step(f, buf + used, n - used, &data);
+        used += k;
+    }
+    return used;
+}
+
+// Format an HTTP error response into buf. Returns its length.
+int error_response(char *buf, size_t size, char *cause, char *errnum,
+                   char *shortmsg, char *longmsg)
+{
+    char body[MAXBUF];
+    int len;
+
+    // Build the HTTP response body
+    snprintf(body, MAXBUF, "<html><title>Proxy Error</title>"
+             "<body bgcolor=\"ffffff\">\r\n%s: %s\r\n<p>%s: %.512s\r\n"
+             "<hr><em>The Proxy server</em>\r\n", errnum, shortmsg, longmsg, cause);
+
+    // Status line and headers, then the body
+    len = snprintf(buf, size, "HTTP/1.0 %s %s\r\nContent-type: text/html\r\n"
+                   "Content-length: %d\r\n\r\n%s", errnum, shortmsg,
+                   (int)strlen(body), body);
+    return len < (int)size ? len : (int)size - 1;
+}
@@ -0,0 +1,59 @@
+// Jisang Park 2017-15108
+#ifndef __HTTP_H__
+#define __HTTP_H__
+
+#include <stddef.h>
+#include "csapp.h"
+
+// Client's Connection / Proxy-Connection header
+#define CONN_NONE  0
+#define CONN_CLOSE 1
+#define CONN_KEEP  2
+
+// Headers of a client request, collected line by line
+typedef struct{
+    char host[MAXLINE];    // Client's Host header line, "" if none
+    char other[MAXBUF];    // Headers forwarded as they are
+    size_t olen;
+    char named[MAXLINE];   // Headers the client's Connection lists
+    size_t nlen;
+    int conn;              // CONN_*
+    int body;              // Content-Length > 0 or Transfer-Encoding
+} reqhdrs_t;
+
+// Response framing states: where frame_step() is in the response
+#define F_HEAD     0  // Status line and headers
+#define F_LEN      1  // Content-Length body
+#define F_CSIZE    2  // Chunk size (hex)
+#define F_CEXT     3  // Rest of the chunk size line
+#define F_CDATA    4  // Chunk data
+#define F_CEND     5  // CRLF after the chunk data
+#define F_TRAILER  6  // Trailer lines, up to an empty one
+#define F_EOF      7  // No framing: the body runs until the origin closes
+#define F_DONE     8
+
+// Tracks where a response ends, so connections can carry more than one
+typedef struct{
+    int state;
+    long long left;        // F_LEN, F_CDATA: body bytes to go
+    int linelen;           // F_TRAILER: length of the current line
+    int raw;               // Headers too long to parse: pass them through
+    int status, minor;     // HTTP/1.minor status
+    int chunked, close;    // Transfer-Encoding: chunked; origin won't reuse
+    long long clen;        // Content-Length, -1 if none
+    size_t hlen;
+    char head[MAXBUF];     // Status line and headers, once F_HEAD is over
+} frame_t;
+
+int parse_uri(char *uri, char *host, char *port, char *path);
+void req_init(reqhdrs_t *rh);
+int req_header(reqhdrs_t *rh, char *line, size_t len);
+int req_format(reqhdrs_t *rh, char *req, size_t size,
+               char *host, char *port, char *path, int keepalive);
+void frame_init(frame_t *f);
+size_t frame_step(frame_t *f, char *buf, size_t n, int *data);
+size_t frame_feed(frame_t *f, char *buf, size_t n);
+int error_response(char *buf, size_t size, char *cause, char *errnum,
+                   char *shortmsg, char *longmsg);
+
+#endif /* __HTTP_H__ */
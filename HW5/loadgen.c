@@ -0,0 +1,433 @@
+// Jisang Park 2017-15108
+// HTTP load generator for tiny, nop-server.py and the proxy.
+//   usage: loadgen [-c conns] [-d seconds] [-r rate] [-k] [-T timeout]
+//                  [-m mixfile] [-j] host port [uri ...]
+//
+// Closed loop (the default): each of conns connections sends its next
+// request as soon as the last response is in. Open loop (-r): requests
+// go out on a fixed schedule, rate per second over all connections, and
+// latency counts from when a request was due, not when it was sent, so
+// a stalled server shows up in the tail instead of slowing the client
+// down with it.
+//
+// URIs are picked at random for each request, each with weight 1, or as
+// given by mixfile ("weight uri" per line). To go through the proxy,
+// give absolute URIs: loadgen localhost 15213 http://localhost:8000/home.html
+// With -k, requests are HTTP/1.1 over kept-alive connections; otherwise
+// each one is HTTP/1.0 on a new connection, and connecting is part of
+// its latency. -j prints the results as one line of JSON.
+#include <poll.h>
+#include "csapp.h"
+#include "http.h"
+
+#define MAXURIS 256
+
+// Latency histogram, HDR style: exact below 2048 ns, then each power
+// of two split into 1024 buckets, so every value is kept to within 0.1%
+#define H_SUB    2048
+#define H_HALF   1024
+#define H_EXPS   40
+#define H_COUNTS (H_SUB + H_EXPS * H_HALF)
+
+typedef struct{
+    unsigned long counts[H_COUNTS];
+    unsigned long n, min, max;
+    double sum;
+} hist_t;
+
+typedef struct{
+    char *uri;       // Request target, as sent
+    char host[MAXLINE];
+    int weight;
+} target_t;
+
+typedef struct{
+    int id;
+    unsigned long reqs, errors, timeouts, connects, bytes;
+    unsigned long status[6];   // By class: 1xx .. 5xx, [0] unparsable
+    hist_t hist;
+} worker_t;
+
+static char *host, *port;
+static struct addrinfo *addr;   // Resolved once, not per connection
+static int nconns = 16, keepalive, json, timeout_ms = 2000;
+static double seconds = 5, rate;
+static target_t targets[MAXURIS];
+static int ntargets, total_weight;
+static double start, end;
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int hist_index(unsigned long v)
+{
+    int e;
+
+    if(v < H_SUB)
+        return v;
+    e = 63 - __builtin_clzl(v) - 10;   // v >> e is in [1024, 2048)
+    if(e > H_EXPS)
+        return H_COUNTS - 1;
+    return H_SUB + (e - 1) * H_HALF + (int)((v >> e) - H_HALF);
+}
+
+// Smallest value that falls in bucket i
+static unsigned long hist_value(int i)
+{
+    int e;
+
+    if(i < H_SUB)
+        return i;
+    e = (i - H_SUB) / H_HALF + 1;
+    return (unsigned long)((i - H_SUB) % H_HALF + H_HALF) << e;
+}
+
+static void hist_add(hist_t *h, unsigned long v)
+{
+    h->counts[hist_index(v)]++;
+    if(h->n == 0 || v < h->min)
+        h->min = v;
+    if(v > h->max)
+        h->max = v;
+    h->n++;
+    h->sum += v;
+}
+
+static void hist_merge(hist_t *to, hist_t *from)
+{
+    int i;
+
+    if(from->n == 0)
+        return;
+    for(i = 0; i < H_COUNTS; i++)
+        to->counts[i] += from->counts[i];
+    if(to->n == 0 || from->min < to->min)
+        to->min = from->min;
+    if(from->max > to->max)
+        to->max = from->max;
+    to->n += from->n;
+    to->sum += from->sum;
+}
+
+// Value at percentile p (0-100)
+static unsigned long hist_pct(hist_t *h, double p)
+{
+    unsigned long want, seen = 0;
+    int i;
+
+    if(h->n == 0)
+        return 0;
+    want = (unsigned long)(p / 100 * h->n + 0.5);
+    if(want < 1)
+        want = 1;
+    for(i = 0; i < H_COUNTS; i++){
+        seen += h->counts[i];
+        if(seen >= want)
+            return hist_value(i) > h->max ? h->max : hist_value(i);
+    }
+    return h->max;
+}
+
+static void add_target(char *uri, int weight)
+{
+    char port_[MAXLINE], path[MAXLINE];
+    target_t *t;
+
+    if(ntargets == MAXURIS){
+        fprintf(stderr, "too many URIs (max %d)\n", MAXURIS);
+        exit(1);
+    }
+    t = &targets[ntargets++];
+    t->uri = strdup(uri);
+    t->weight = weight;
+    // Absolute URIs (to a proxy) carry their own Host
+    if(!strncasecmp(uri, "http://", 7) && parse_uri(uri, t->host, port_, path) == 0){
+        if(strcmp(port_, "80")){
+            strcat(t->host, ":");
+            strcat(t->host, port_);
+        }
+    }
+    else
+        snprintf(t->host, MAXLINE, "%s:%s", host, port);
+    total_weight += weight;
+}
+
+static void read_mix(char *file)
+{
+    char line[MAXLINE], uri[MAXLINE];
+    int weight;
+    FILE *fp;
+
+    if(!(fp = fopen(file, "r"))){
+        perror(file);
+        exit(1);
+    }
+    while(fgets(line, MAXLINE, fp)){
+        if(line[0] == '#')
+            continue;
+        if(sscanf(line, "%d %s", &weight, uri) == 2 && weight > 0)
+            add_target(uri, weight);
+    }
+    fclose(fp);
+}
+
+static target_t *pick(unsigned int *x)
+{
+    int i, w;
+
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    w = *x % total_weight;
+    for(i = 0; w >= targets[i].weight; i++)
+        w -= targets[i].weight;
+    return &targets[i];
+}
+
+// Connect, giving up after the timeout: a server that stops accepting
+// (nop-server.py, with its backlog full) would otherwise block connect()
+// for minutes
+static int connect_to(worker_t *w)
+{
+    struct timeval tv = { timeout_ms / 1000, timeout_ms % 1000 * 1000 };
+    struct pollfd pfd;
+    socklen_t len = sizeof(int);
+    int fd, err = 0, flags;
+
+    if((fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol)) < 0)
+        return -1;
+    flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    if(connect(fd, addr->ai_addr, addr->ai_addrlen) < 0){
+        pfd.fd = fd;
+        pfd.events = POLLOUT;
+        if(errno != EINPROGRESS || poll(&pfd, 1, timeout_ms) <= 0 ||
+           getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err){
+            if(!err || err == ETIMEDOUT)
+                w->timeouts++;
+            close(fd);
+            return -1;
+        }
+    }
+    fcntl(fd, F_SETFL, flags);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    w->connects++;
+    return fd;
+}
+
+// One request on *fd, opening a connection if there is none. Returns
+// 0 on a complete response; the connection stays open (*fd) if it can
+// carry the next one.
+static int request(worker_t *w, int *fd, target_t *t)
+{
+    char buf[MAXBUF];
+    frame_t f;
+    ssize_t n;
+    int len, reused, got = 0;
+
+retry:
+    if(!(reused = *fd >= 0) && (*fd = connect_to(w)) < 0)
+        return -1;
+    if(keepalive)
+        len = snprintf(buf, MAXBUF, "GET %s HTTP/1.1\r\nHost: %s\r\n"
+                       "Connection: keep-alive\r\n\r\n", t->uri, t->host);
+    else
+        len = snprintf(buf, MAXBUF, "GET %s HTTP/1.0\r\nHost: %s\r\n"
+                       "Connection: close\r\n\r\n", t->uri, t->host);
+    if(rio_writen(*fd, buf, len) != len)
+        goto fail;
+
+    frame_init(&f);
+    while(f.state != F_DONE){
+        if((n = read(*fd, buf, MAXBUF)) < 0){
+            if(errno == EINTR)
+                continue;
+            if(errno == EAGAIN || errno == EWOULDBLOCK){
+                w->timeouts++;
+                reused = 0;   // Slow, not closed: don't send it again
+            }
+            goto fail;
+        }
+        if(n == 0){
+            if(f.state == F_EOF)   // Response ends with the connection
+                break;
+            goto fail;
+        }
+        got = 1;
+        w->bytes += n;
+        frame_feed(&f, buf, n);
+    }
+    w->status[f.status >= 100 && f.status < 600 ? f.status / 100 : 0]++;
+    if(!keepalive || f.state == F_EOF || f.close){
+        close(*fd);
+        *fd = -1;
+    }
+    return 0;
+
+fail:
+    close(*fd);
+    *fd = -1;
+    // A kept-alive connection the server closed before we sent on it
+    // (idle timeout, or its limit of requests per connection): try again
+    // on a new one, as browsers do
+    if(reused && !got)
+        goto retry;
+    return -1;
+}
+
+static void *client(void *vargp)
+{
+    worker_t *w = vargp;
+    unsigned int x = 2463534242u + w->id * 7919;
+    double due = start, interval = 0, t;
+    struct timespec ts;
+    int fd = -1;
+
+    if(rate > 0){
+        // Each connection takes every nconns-th slot of the schedule
+        interval = nconns / rate;
+        due = start + interval * w->id / nconns;
+    }
+    while(1){
+        if(rate > 0){
+            if(due >= end)
+                break;
+            t = now();
+            if(due > t){
+                ts.tv_sec = (time_t)due;
+                ts.tv_nsec = (long)((due - ts.tv_sec) * 1e9);
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+            }
+        }
+        else if((due = now()) >= end)
+            break;
+
+        if(request(w, &fd, pick(&x)) < 0)
+            w->errors++;
+        else{
+            w->reqs++;
+            hist_add(&w->hist, (unsigned long)((now() - due) * 1e9));
+        }
+        due += interval;
+    }
+    if(fd >= 0)
+        close(fd);
+    return NULL;
+}
+
+static void report(worker_t *ws, double elapsed)
+{
+    worker_t all;
+    hist_t *h = &all.hist;
+    int i, j;
+
+    memset(&all, 0, sizeof(all));
+    for(i = 0; i < nconns; i++){
+        all.reqs += ws[i].reqs;
+        all.errors += ws[i].errors;
+        all.timeouts += ws[i].timeouts;
+        all.connects += ws[i].connects;
+        all.bytes += ws[i].bytes;
+        for(j = 0; j < 6; j++)
+            all.status[j] += ws[i].status[j];
+        hist_merge(h, &ws[i].hist);
+    }
+
+    if(json){
+        printf("{\"mode\":\"%s\",\"conns\":%d,\"keepalive\":%d,\"rate\":%.0f,"
+               "\"seconds\":%.3f,\"requests\":%lu,\"errors\":%lu,\"timeouts\":%lu,"
+               "\"connects\":%lu,\"bytes\":%lu,\"rps\":%.1f,"
+               "\"status\":{\"1xx\":%lu,\"2xx\":%lu,\"3xx\":%lu,\"4xx\":%lu,\"5xx\":%lu,\"other\":%lu},"
+               "\"latency_us\":{\"min\":%.1f,\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,"
+               "\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}}\n",
+               rate > 0 ? "open" : "closed", nconns, keepalive, rate, elapsed,
+               all.reqs, all.errors, all.timeouts, all.connects, all.bytes,
+               all.reqs / elapsed, all.status[1], all.status[2], all.status[3],
+               all.status[4], all.status[5], all.status[0],
+               h->min / 1e3, h->n ? h->sum / h->n / 1e3 : 0,
+               hist_pct(h, 50) / 1e3, hist_pct(h, 90) / 1e3, hist_pct(h, 99) / 1e3,
+               hist_pct(h, 99.9) / 1e3, h->max / 1e3);
+        return;
+    }
+    printf("%s loop, %d connections%s, %.1f s",
+           rate > 0 ? "open" : "closed", nconns, keepalive ? " (keep-alive)" : "", elapsed);
+    if(rate > 0)
+        printf(", target %.0f req/s", rate);
+    printf("\n  requests   %lu (%.1f req/s, %.2f MB/s)\n",
+           all.reqs, all.reqs / elapsed, all.bytes / elapsed / 1e6);
+    printf("  errors     %lu (%lu timeouts), %lu connections opened\n",
+           all.errors, all.timeouts, all.connects);
+    printf("  status     2xx %lu, 3xx %lu, 4xx %lu, 5xx %lu, other %lu\n",
+           all.status[2], all.status[3], all.status[4], all.status[5],
+           all.status[0] + all.status[1]);
+    printf("  latency    min %.1f  mean %.1f  p50 %.1f  p90 %.1f  p99 %.1f  p999 %.1f  max %.1f (us)\n",
+           h->min / 1e3, h->n ? h->sum / h->n / 1e3 : 0,
+           hist_pct(h, 50) / 1e3, hist_pct(h, 90) / 1e3, hist_pct(h, 99) / 1e3,
+           hist_pct(h, 99.9) / 1e3, h->max / 1e3);
+}
+
+static void usage(char *prog)
+{
+    fprintf(stderr, "usage: %s [-c conns] [-d seconds] [-r rate] [-k] [-T timeout ms]\n"
+                    "       [-m mixfile] [-j] host port [uri ...]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    char *mixfile = NULL;
+    struct addrinfo hints;
+    pthread_t *tids;
+    worker_t *ws;
+    int c, i, rc;
+
+    while((c = getopt(argc, argv, "c:d:r:kT:m:j")) != -1){
+        switch(c){
+        case 'c': nconns = atoi(optarg); break;
+        case 'd': seconds = atof(optarg); break;
+        case 'r': rate = atof(optarg); break;
+        case 'k': keepalive = 1; break;
+        case 'T': timeout_ms = atoi(optarg); break;
+        case 'm': mixfile = optarg; break;
+        case 'j': json = 1; break;
+        default: usage(argv[0]);
+        }
+    }
+    if(argc - optind < 2 || nconns < 1 || seconds <= 0 || rate < 0 || timeout_ms < 1)
+        usage(argv[0]);
+    host = argv[optind];
+    port = argv[optind + 1];
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+    if((rc = getaddrinfo(host, port, &hints, &addr)) != 0){
+        fprintf(stderr, "%s:%s: %s\n", host, port, gai_strerror(rc));
+        exit(1);
+    }
+    if(mixfile)
+        read_mix(mixfile);
+    for(i = optind + 2; i < argc; i++)
+        add_target(argv[i], 1);
+    if(ntargets == 0)
+        add_target("/", 1);
+    Signal(SIGPIPE, SIG_IGN);
+
+    ws = Calloc(nconns, sizeof(worker_t));
+    tids = Malloc(nconns * sizeof(pthread_t));
+    start = now() + 0.01;
+    end = start + seconds;
+    for(i = 0; i < nconns; i++){
+        ws[i].id = i;
+        Pthread_create(&tids[i], NULL, client, &ws[i]);
+    }
+    for(i = 0; i < nconns; i++)
+        Pthread_join(tids[i], NULL);
+    report(ws, now() - start);
+    return 0;
+}
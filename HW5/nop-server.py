@@ -0,0 +1,20 @@
+#!/usr/bin/python3
+
+# nop-server.py - This is a server that we use to create head-of-line
+#                 blocking for the concurrency test. It accepts a
+#                 connection, and then spins forever.
+#
+# usage: nop-server.py <port>                
+#
+import socket
+import sys
+
+#create an INET, STREAMing socket
+serversocket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+serversocket.bind(('', int(sys.argv[1])))
+serversocket.listen(5)
+
+while 1:
+  channel, details = serversocket.accept()
+  while 1:
+    continue
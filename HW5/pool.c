@@ -0,0 +1,204 @@
+// Jisang Park 2017-15108
+// Idle origin connections, kept per origin (host:port) for reuse. Most
+// recently used first, since those are the least likely to have been
+// closed by the origin; each is checked before reuse all the same.
+#include "csapp.h"
+#include "pool.h"
+
+#define NORIGINS 64   // Hash buckets
+
+typedef struct origin{
+    char *key;                  // "host:port"
+    int n;                      // Idle connections, oldest first
+    int fds[POOL_MAX];
+    time_t since[POOL_MAX];     // When each went idle
+    struct origin *next;
+} origin_t;
+
+stats_t stats;
+
+static origin_t *origins[NORIGINS];
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static time_t now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+// djb2 string hash
+static unsigned long hash(char *key)
+{
+    unsigned long h = 5381;
+    while(*key)
+        h = h * 33 + (unsigned char)*key++;
+    return h;
+}
+
+// Find (or with create, add) the origin. Called with pool_lock held.
+static origin_t *find_origin(char *host, char *port, int create)
+{
+    char key[MAXLINE];
+    origin_t *o, **head;
+
+    snprintf(key, MAXLINE, "%s:%s", host, port);
+    head = &origins[hash(key) % NORIGINS];
+    for(o = *head; o; o = o->next)
+        if(!strcmp(o->key, key))
+            return o;
+    if(!create)
+        return NULL;
+    o = Calloc(1, sizeof(origin_t));
+    o->key = Malloc(strlen(key) + 1);
+    strcpy(o->key, key);
+    o->next = *head;
+    *head = o;
+    return o;
+}
+
+// Janitor: close connections idle for POOL_IDLE_SECS, forget empty origins
+static void *janitor(void *vargp)
+{
+    origin_t *o, **pp;
+    time_t t;
+    int i, j;
+
+    Pthread_detach(pthread_self());
+    while(1){
+        sleep(1);
+        t = now();
+        pthread_mutex_lock(&pool_lock);
+        for(i = 0; i < NORIGINS; i++){
+            for(pp = &origins[i]; (o = *pp); ){
+                for(j = 0; j < o->n && t - o->since[j] >= POOL_IDLE_SECS; j++){
+                    close(o->fds[j]);
+                    STAT_ADD(expired, 1);
+                }
+                o->n -= j;
+                memmove(o->fds, o->fds + j, o->n * sizeof(int));
+                memmove(o->since, o->since + j, o->n * sizeof(time_t));
+                if(o->n == 0){
+                    *pp = o->next;
+                    Free(o->key);
+                    Free(o);
+                }
+                else
+                    pp = &o->next;
+            }
+        }
+        pthread_mutex_unlock(&pool_lock);
+    }
+    return NULL;
+}
+
+void pool_init(void)
+{
+    pthread_t tid;
+
+    Pthread_create(&tid, NULL, janitor, NULL);
+}
+
+// Open a new connection to the origin, timing it. Reads on it time out
+// after ORIGIN_TIMEOUT_SECS, so a silent origin can't pin a worker.
+int pool_connect(char *host, char *port)
+{
+    struct timeval tv = { ORIGIN_TIMEOUT_SECS, 0 };
+    struct timespec t0, t1;
+    int fd;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    fd = open_clientfd(host, port);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if(fd >= 0){
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        STAT_ADD(opened, 1);
+        STAT_ADD(connect_ns, (t1.tv_sec - t0.tv_sec) * 1000000000UL + t1.tv_nsec - t0.tv_nsec);
+    }
+    return fd;
+}
+
+// A connection to host:port: a healthy idle one (*reused = 1) or else a
+// new one. Returns -1 if the origin can't be reached.
+int pool_get(char *host, char *port, int *reused)
+{
+    origin_t *o;
+    int fd;
+    char c;
+
+    STAT_ADD(upstream_reqs, 1);
+    while(1){
+        pthread_mutex_lock(&pool_lock);
+        o = find_origin(host, port, 0);
+        fd = o && o->n ? o->fds[--o->n] : -1;
+        pthread_mutex_unlock(&pool_lock);
+        if(fd < 0)
+            break;
+
+        // Healthy: nothing to read and not closed. Anything else (EOF,
+        // an error, or bytes no request asked for) means don't use it.
+        if(recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            STAT_ADD(reused, 1);
+            *reused = 1;
+            return fd;
+        }
+        close(fd);
+        STAT_ADD(stale, 1);
+    }
+    *reused = 0;
+    return pool_connect(host, port);
+}
+
+// Keep fd, which just finished a response, for the next request
+void pool_put(char *host, char *port, int fd)
+{
+    origin_t *o;
+
+    pthread_mutex_lock(&pool_lock);
+    o = find_origin(host, port, 1);
+    if(o->n == POOL_MAX){
+        close(o->fds[0]);  // Full: drop the one idle longest
+        o->n--;
+        memmove(o->fds, o->fds + 1, o->n * sizeof(int));
+        memmove(o->since, o->since + 1, o->n * sizeof(time_t));
+    }
+    o->fds[o->n] = fd;
+    o->since[o->n++] = now();
+    pthread_mutex_unlock(&pool_lock);
+}
+
+// Stats page body. Latency saved is estimated as one average connect
+// (DNS lookup and TCP handshake) per reused connection.
+int stats_format(char *buf, size_t size)
+{
+    stats_t s;
+    double avg_us, ratio;
+    int idle = 0, i, len;
+    origin_t *o;
+
+    memcpy(&s, &stats, sizeof(s));
+    pthread_mutex_lock(&pool_lock);
+    for(i = 0; i < NORIGINS; i++)
+        for(o = origins[i]; o; o = o->next)
+            idle += o->n;
+    pthread_mutex_unlock(&pool_lock);
+
+    avg_us = s.opened ? s.connect_ns / 1000.0 / s.opened : 0;
+    ratio = s.upstream_reqs ? (double)s.reused / s.upstream_reqs : 0;
+    len = snprintf(buf, size,
+                   "client connections   %lu\n"
+                   "client requests      %lu (%.2f per connection)\n"
+                   "upstream requests    %lu\n"
+                   "connections opened   %lu (avg connect %.1f us)\n"
+                   "connections reused   %lu (reuse ratio %.3f)\n"
+                   "stale on reuse       %lu\n"
+                   "closed idle          %lu\n"
+                   "idle now             %d\n"
+                   "latency saved        %.1f ms (est.)\n",
+                   s.client_conns, s.client_reqs,
+                   s.client_conns ? (double)s.client_reqs / s.client_conns : 0,
+                   s.upstream_reqs, s.opened, avg_us, s.reused, ratio,
+                   s.stale, s.expired, idle, s.reused * avg_us / 1000.0);
+    return len < (int)size ? len : (int)size - 1;
+}
@@ -0,0 +1,34 @@
+// Jisang Park 2017-15108
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <stddef.h>
+
+#define POOL_MAX       8   // Idle connections kept per origin
+#define POOL_IDLE_SECS 30  // Idle connections older than this are closed
+#define ORIGIN_TIMEOUT_SECS 30  // Give up on an origin silent this long
+
+// Counters for the stats page (GET /stats)
+typedef struct{
+    unsigned long client_conns;   // Client connections accepted
+    unsigned long client_reqs;    // Requests read from them
+    unsigned long upstream_reqs;  // Requests sent to origins
+    unsigned long opened;         // Origin connections opened
+    unsigned long reused;         // Requests sent on a pooled connection
+    unsigned long stale;          // Pooled connections found dead
+    unsigned long expired;        // Pooled connections closed for idling
+    unsigned long connect_ns;     // Time spent opening origin connections
+    unsigned long disk_hits;      // Responses served from the disk tier
+    unsigned long disk_stored;    // Responses written to it
+} stats_t;
+
+extern stats_t stats;
+#define STAT_ADD(field, n) __atomic_add_fetch(&stats.field, (n), __ATOMIC_RELAXED)
+
+void pool_init(void);
+int pool_connect(char *host, char *port);
+int pool_get(char *host, char *port, int *reused);
+void pool_put(char *host, char *port, int fd);
+int stats_format(char *buf, size_t size);
+
+#endif /* __POOL_H__ */
@@ -0,0 +1,603 @@
+// Jisang Park 2017-15108
+#include <stdio.h>
+#include <netinet/tcp.h>
+#include <sys/sendfile.h>
+#include "csapp.h"
+#include "bufio.h"
+#include "cache.h"
+#include "disk.h"
+#include "http.h"
+#include "event.h"
+#include "flight.h"
+#include "pool.h"
+
+#define NTHREADS 32   // Worker threads
+#define SBUFSIZE 64   // Accepted connections waiting for a worker
+#define CLIENT_IDLE_SECS 5   // Keep-alive: wait this long for the next request
+#define KEEPALIVE_MAX 100    // Requests per client connection
+
+// Bounded queue of connected descriptors (producer: main, consumers: workers)
+typedef struct{
+    int *buf;     // Buffer array
+    int n;        // Maximum number of slots
+    int front;    // buf[(front+1)%n] is first item
+    int rear;     // buf[rear%n] is last item
+    sem_t mutex;  // Protects accesses to buf
+    sem_t slots;  // Counts available slots
+    sem_t items;  // Counts available items
+} sbuf_t;
+
+sbuf_t sbuf;
+
+// A response on its way to the client
+typedef struct{
+    int fd;
+    int keep;      // Connection stays open after it
+    int dechunk;   // HTTP/1.0 client: unwrap chunked bodies
+    int failed;    // Client went away
+    frame_t fr;
+    size_t hlen;   // Rewritten headers, held back to go out with the body
+    char hdr[MAXBUF + MAXLINE];
+} reply_t;
+
+void sbuf_init(sbuf_t *sp, int n);
+void sbuf_insert(sbuf_t *sp, int item);
+int sbuf_remove(sbuf_t *sp);
+void *thread(void *vargp);
+void serve(int fd);
+int doit(int fd, bio_t *bp);
+int fetch(reply_t *reply, char *uri, char *host, char *port, char *req, flight_t *f);
+int follow(reply_t *reply, char *uri, freader_t *r);
+int read_headers(bio_t *bp, reqhdrs_t *rh);
+void reply_init(reply_t *rp, int fd, int minor, int keep);
+void reply_send(reply_t *rp, char *buf, size_t n);
+int reply_end(reply_t *rp);
+int disk_send(reply_t *rp, char *uri, dobj_t *d);
+dwriter_t *disk_start(char *uri, frame_t *up, char *body, size_t n);
+int send_stats(int fd, int keep);
+void clienterror(int fd, char *cause, char *errnum,
+                 char *shortmsg, char *longmsg);
+
+void usage(char *prog)
+{
+    fprintf(stderr, "usage: %s [-e [-n <loops>] [-b <buffers>] | -d <dir> [-D <MB>]] <port>\n", prog);
+    fprintf(stderr, "   -e   event-driven engine: one epoll loop per core\n");
+    fprintf(stderr, "   -n   number of event loops (default: number of CPUs)\n");
+    fprintf(stderr, "   -b   I/O buffers per loop (default: %d)\n", EV_NBUFS);
+    fprintf(stderr, "   -d   keep a disk tier of the cache in dir (threaded engine only)\n");
+    fprintf(stderr, "   -D   size of the disk tier in MB (default: %d)\n", DISK_DEF_MB);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int listenfd, connfd, i, c;
+    int event = 0, nloops = 0, nbufs = EV_NBUFS, disk_mb = DISK_DEF_MB;
+    char *disk_dir = NULL;
+    socklen_t clientlen;
+    struct sockaddr_storage clientaddr;
+    pthread_t tid;
+
+    // Parse command line args
+    while((c = getopt(argc, argv, "en:b:d:D:")) != -1){
+        switch(c){
+        case 'e':
+            event = 1;
+            break;
+        case 'n':
+            nloops = atoi(optarg);
+            break;
+        case 'b':
+            nbufs = atoi(optarg);
+            break;
+        case 'd':
+            disk_dir = optarg;
+            break;
+        case 'D':
+            disk_mb = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if(optind != argc - 1 || nbufs <= 0 || disk_mb <= 0 || (event && disk_dir))
+        usage(argv[0]);
+
+    // A client or server closing early must not kill the proxy
+    Signal(SIGPIPE, SIG_IGN);
+
+    cache_init();
+    if(event){
+        event_main(argv[optind], nloops, nbufs);
+        exit(0);
+    }
+
+    if(disk_dir && disk_init(disk_dir, disk_mb) < 0){
+        fprintf(stderr, "%s: can't use %s for the disk tier\n", argv[0], disk_dir);
+        exit(1);
+    }
+    pool_init();
+    sbuf_init(&sbuf, SBUFSIZE);
+    for(i = 0; i < NTHREADS; i++)
+        Pthread_create(&tid, NULL, thread, NULL);
+
+    // Main thread only accepts; a full queue blocks it (bounded backlog)
+    listenfd = Open_listenfd(argv[optind]);
+    while(1){
+        clientlen = sizeof(clientaddr);
+        if((connfd = accept(listenfd, (SA *)&clientaddr, &clientlen)) < 0)
+            continue;
+        sbuf_insert(&sbuf, connfd);
+    }
+}
+
+// Worker: serve connections from the queue one at a time
+void *thread(void *vargp)
+{
+    Pthread_detach(pthread_self());
+    while(1){
+        int connfd = sbuf_remove(&sbuf);
+        serve(connfd);
+        Close(connfd);
+    }
+    return NULL;
+}
+
+// Serve requests on one client connection until either side closes it.
+// Idle clients are dropped after CLIENT_IDLE_SECS, so they can't hold on
+// to a worker. Responses go out as headers, then body: without
+// TCP_NODELAY, the body of a kept-alive response waits for the client's
+// delayed ACK of the headers (about 40 ms).
+void serve(int fd)
+{
+    struct timeval tv = { CLIENT_IDLE_SECS, 0 };
+    bio_t bio;
+    int i, one = 1;
+
+    STAT_ADD(client_conns, 1);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    bio_init(&bio, fd);
+    for(i = 0; i < KEEPALIVE_MAX && doit(fd, &bio); i++)
+        ;
+}
+
+// Handle one HTTP request: answer from the cache or forward to the
+// origin. Returns 1 if the connection may carry another request.
+int doit(int fd, bio_t *bp)
+{
+    char buf[MAXLINE], method[MAXLINE], uri[MAXLINE], version[MAXLINE];
+    char host[MAXLINE], port[MAXLINE], path[MAXLINE], req[MAXBUF];
+    reqhdrs_t rh;
+    reply_t reply;
+    cobj_t *obj;
+    dobj_t d;
+    flight_t *f;
+    freader_t r;
+    int minor, keep;
+    char *line;
+    ssize_t n;
+
+    // 1. Request line and headers
+    if((n = bio_line(bp, &line)) <= 0)
+        return 0;
+    if(n >= MAXLINE)
+        n = MAXLINE - 1;
+    memcpy(buf, line, n);
+    buf[n] = '\0';
+    STAT_ADD(client_reqs, 1);
+    if(sscanf(buf, "%s %s %s", method, uri, version) != 3){
+        clienterror(fd, buf, "400", "Bad Request", "Proxy could not parse the request");
+        return 0;
+    }
+    if(read_headers(bp, &rh) < 0){
+        clienterror(fd, uri, "400", "Bad Request", "Request headers too long");
+        return 0;
+    }
+    minor = !strcasecmp(version, "HTTP/1.1");
+    keep = rh.conn == CONN_KEEP || (minor && rh.conn != CONN_CLOSE);
+    if(strcasecmp(method, "GET")){
+        clienterror(fd, method, "501", "Not Implemented", "Proxy does not implement this method");
+        return 0;
+    }
+    // Its body would be read as the next request: refuse it, and close
+    if(rh.body){
+        clienterror(fd, uri, "400", "Bad Request", "Proxy does not accept a body with GET");
+        return 0;
+    }
+    if(!strcmp(uri, "/stats"))
+        return send_stats(fd, keep);
+    if(parse_uri(uri, host, port, path) < 0){
+        clienterror(fd, uri, "400", "Bad Request", "Proxy could not parse the URI");
+        return 0;
+    }
+    reply_init(&reply, fd, minor, keep);
+
+    // 2. Cached? (key: absolute URI) Sent with no lock held
+    if((obj = cache_get(uri))){
+        reply_send(&reply, obj->data, obj->size);
+        cache_put(obj);
+        return reply_end(&reply);
+    }
+    if(disk_get(uri, &d))
+        return disk_send(&reply, uri, &d);
+
+    // 3. Rewrite the headers for the origin
+    if(req_format(&rh, req, MAXBUF, host, port, path, 1) < 0){
+        clienterror(fd, uri, "400", "Bad Request", "Request headers too long");
+        return 0;
+    }
+
+    // 4. Someone already fetching it? Then share their response.
+    r.wake = NULL;
+    if(!flight_join(uri, &f, &r))
+        return follow(&reply, uri, &r);
+    // It may have been cached between our miss and the join
+    if((obj = cache_get(uri))){
+        flight_append(f, obj->data, obj->size);
+        flight_finish(f, 1);
+        reply_send(&reply, obj->data, obj->size);
+        cache_put(obj);
+        return reply_end(&reply);
+    }
+    flight_finish(f, fetch(&reply, uri, host, port, req, f));
+    return reply_end(&reply);
+}
+
+// read() that retries on signals
+ssize_t read_some(int fd, char *buf, size_t n)
+{
+    ssize_t k;
+
+    while((k = read(fd, buf, n)) < 0 && errno == EINTR)
+        ;
+    return k;
+}
+
+// Lead a flight: send req to the origin, on a pooled connection if there
+// is one, and relay the response to the client and the flight, keeping
+// a copy for the cache while it still fits an object. The connection
+// goes back to the pool if the response ended cleanly. Returns 1 if the
+// whole response arrived.
+int fetch(reply_t *reply, char *uri, char *host, char *port, char *req, flight_t *f)
+{
+    char buf[MAXLINE], object[MAX_OBJECT_SIZE];
+    size_t size = 0, k, h;
+    ssize_t n;
+    int serverfd, reused, cacheable = 1, head, timedout;
+    dwriter_t *dw = NULL;
+    frame_t up;
+
+    // 1. Send the request. The origin may have closed a pooled connection
+    // at any time; then retry on a new one (GET is safe to repeat).
+    serverfd = pool_get(host, port, &reused);
+    while(1){
+        if(serverfd < 0){
+            clienterror(reply->fd, host, "502", "Bad Gateway", "Proxy could not connect to the server");
+            return 0;
+        }
+        n = -1;
+        if(rio_writen(serverfd, req, strlen(req)) >= 0 && (n = read_some(serverfd, buf, MAXLINE)) > 0)
+            break;
+        timedout = n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        Close(serverfd);
+        if(timedout){
+            clienterror(reply->fd, host, "504", "Gateway Timeout", "Proxy timed out waiting for the server");
+            return 0;
+        }
+        if(!reused){
+            clienterror(reply->fd, host, "502", "Bad Gateway", "Proxy got no response from the server");
+            return 0;
+        }
+        STAT_ADD(stale, 1);
+        serverfd = pool_connect(host, port);
+        reused = 0;
+    }
+
+    // 2. Relay exactly this response
+    frame_init(&up);
+    do{
+        head = up.state == F_HEAD;
+        h = up.hlen;
+        k = frame_feed(&up, buf, n);
+        if(head && up.state != F_HEAD)   // h: how much of buf was headers
+            dw = disk_start(uri, &up, buf + (up.hlen - h), k - (up.hlen - h));
+        else if(dw)
+            disk_write(dw, buf, k);
+        flight_append(f, buf, k);
+        reply_send(reply, buf, k);
+        if(cacheable && size + k <= MAX_OBJECT_SIZE)
+            memcpy(object + size, buf, k);
+        else
+            cacheable = 0;
+        size += k;
+    } while(up.state != F_DONE && (n = read_some(serverfd, buf, MAXLINE)) > 0);
+
+    // 3. Done cleanly, with nothing extra after it: reuse the connection
+    if(up.state == F_DONE && k == (size_t)n && !up.close)
+        pool_put(host, port, serverfd);
+    else
+        Close(serverfd);
+    if(dw)
+        disk_end(dw, up.state == F_DONE);
+    if(up.state != F_DONE && !(up.state == F_EOF && n == 0))
+        return 0;
+
+    if(cacheable && size > 0){
+        cache_insert(uri, object, size);
+        // Not stored as it came (no length up front): store it whole
+        if(!dw && disk_enabled() && !up.raw && up.status == 200 &&
+           (dw = disk_begin(uri, up.hlen, size))){
+            disk_write(dw, object, size);
+            disk_end(dw, 1);
+        }
+    }
+    return 1;
+}
+
+// Follow a flight: stream the leader's response to the client as it
+// arrives. Returns 1 if the connection may carry another request.
+int follow(reply_t *reply, char *uri, freader_t *r)
+{
+    char buf[MAXLINE];
+    size_t got = 0;
+    ssize_t n;
+
+    while(!reply->failed && (n = flight_read(r, buf, MAXLINE, 1)) > 0){
+        reply_send(reply, buf, n);
+        got += n;
+    }
+    flight_leave(r);
+    if(n < 0 && got == 0)
+        clienterror(reply->fd, uri, "502", "Bad Gateway", "Proxy could not fetch the object");
+    return n == 0 && reply_end(reply);
+}
+
+// Read the client's headers, up to the blank line. Returns -1 if they
+// do not fit. Each line is parsed where it lies in the read buffer.
+int read_headers(bio_t *bp, reqhdrs_t *rh)
+{
+    char *line;
+    ssize_t n;
+
+    req_init(rh);
+    while((n = bio_line(bp, &line)) > 0){
+        if((n == 2 && line[0] == '\r') || n == 1)
+            break;
+        if(req_header(rh, line, n) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+// Relaying a response to the client: the origin's bytes, with the
+// Connection header replaced by our own decision. For HTTP/1.0 clients,
+// chunked bodies are unwrapped (and the connection then closed).
+void reply_init(reply_t *rp, int fd, int minor, int keep)
+{
+    rp->fd = fd;
+    rp->keep = keep;
+    rp->dechunk = !minor;
+    rp->failed = 0;
+    rp->hlen = 0;
+    frame_init(&rp->fr);
+}
+
+// Send n bytes of body, after the headers if they are still held back:
+// both in one system call (and one packet, for small responses)
+static void reply_write(reply_t *rp, char *buf, size_t n)
+{
+    struct iovec iov[2] = { { rp->hdr, rp->hlen }, { buf, n } };
+
+    if(!rp->failed && (n || rp->hlen) && bio_writev(rp->fd, iov, 2) < 0)
+        rp->failed = 1;
+    rp->hlen = 0;
+}
+
+// The headers are in: send them rewritten
+static void reply_head(reply_t *rp)
+{
+    char *out = rp->hdr, *line, *eol;
+    frame_t *fr = &rp->fr;
+    size_t len;
+
+    if(fr->raw){
+        rp->keep = 0;
+        reply_write(rp, fr->head, fr->hlen);
+        return;
+    }
+    if(fr->chunked && rp->dechunk)
+        rp->keep = 0;   // Unwrapped: only the close marks the end
+    if(fr->state == F_EOF)
+        rp->keep = 0;
+
+    eol = strchr(fr->head, '\n');
+    len = eol + 1 - fr->head;
+    memcpy(out, fr->head, len);
+    for(line = eol + 1; (eol = strchr(line, '\n')) && eol - line > 1; line = eol + 1){
+        if(!strncasecmp(line, "Connection:", 11) || !strncasecmp(line, "Keep-Alive:", 11) ||
+           !strncasecmp(line, "Proxy-Connection:", 17))
+            continue;
+        if(rp->dechunk && fr->chunked && !strncasecmp(line, "Transfer-Encoding:", 18))
+            continue;
+        memcpy(out + len, line, eol + 1 - line);
+        len += eol + 1 - line;
+    }
+    len += sprintf(out + len, "Connection: %s\r\n\r\n", rp->keep ? "keep-alive" : "close");
+    rp->hlen = len;
+}
+
+// n more bytes of the origin's response
+void reply_send(reply_t *rp, char *buf, size_t n)
+{
+    frame_t *fr = &rp->fr;
+    size_t k;
+    int data;
+
+    while(n && fr->state != F_DONE){
+        if(fr->state == F_HEAD){
+            k = frame_step(fr, buf, n, &data);
+            if(fr->state != F_HEAD)
+                reply_head(rp);
+        }
+        else if(rp->dechunk && fr->chunked){
+            k = frame_step(fr, buf, n, &data);
+            if(data)
+                reply_write(rp, buf, k);
+        }
+        else{
+            k = frame_feed(fr, buf, n);
+            reply_write(rp, buf, k);
+        }
+        buf += k;
+        n -= k;
+    }
+}
+
+// The response is over. Returns 1 if the connection may carry another
+// request.
+int reply_end(reply_t *rp)
+{
+    // Cut off inside the headers: pass on what there is
+    if(rp->fr.state == F_HEAD)
+        reply_write(rp, rp->fr.head, rp->fr.hlen);
+    else if(rp->hlen)   // No body
+        reply_write(rp, NULL, 0);
+    return rp->keep && !rp->failed && rp->fr.state == F_DONE;
+}
+
+// Serve a response from the disk tier. The headers go through
+// reply_send, to be rewritten as any others are; a Content-Length body
+// then goes straight from the segment file with sendfile. Responses
+// small enough for the memory cache are read in and cached there too.
+int disk_send(reply_t *rp, char *uri, dobj_t *d)
+{
+    char buf[MAXBUF], *data;
+    off_t off = d->off + d->hlen;
+    size_t left = d->size - d->hlen;
+    ssize_t n;
+
+    if(d->size <= MAX_OBJECT_SIZE){
+        data = Malloc(d->size ? d->size : 1);
+        if(pread(d->fd, data, d->size, d->off) == (ssize_t)d->size){
+            cache_insert(uri, data, d->size);
+            reply_send(rp, data, d->size);
+            left = 0;
+        }
+        else
+            rp->failed = 1;
+        Free(data);
+    }
+    else if(d->hlen < MAXBUF && pread(d->fd, buf, d->hlen, d->off) == (ssize_t)d->hlen){
+        reply_send(rp, buf, d->hlen);
+        if(rp->fr.state == F_LEN && !rp->failed){
+            reply_write(rp, NULL, 0);   // The headers
+            while(!rp->failed && left > 0){
+                if((n = sendfile(rp->fd, d->fd, &off, left)) <= 0){
+                    if(n < 0 && errno == EINTR)
+                        continue;
+                    rp->failed = 1;
+                }
+                else
+                    left -= n;
+            }
+            rp->fr.state = F_DONE;
+        }
+    }
+    else
+        rp->failed = 1;
+
+    // Any other body (chunked, or up to the close) is relayed as it was stored
+    while(!rp->failed && rp->fr.state != F_DONE && left > 0){
+        if((n = pread(d->fd, buf, left < MAXBUF ? left : MAXBUF, off)) <= 0){
+            rp->failed = 1;
+            break;
+        }
+        reply_send(rp, buf, n);
+        off += n;
+        left -= n;
+    }
+    disk_put(d);
+    if(rp->failed && rp->fr.state == F_HEAD){
+        clienterror(rp->fd, uri, "500", "Internal Error", "Proxy could not read the cached object");
+        return 0;
+    }
+    return reply_end(rp);
+}
+
+// Once a response's headers are in (up), start storing it on disk, with
+// the first n bytes of its body. Only 200 responses of known length are
+// stored as they arrive. Returns NULL if it isn't being stored.
+dwriter_t *disk_start(char *uri, frame_t *up, char *body, size_t n)
+{
+    dwriter_t *dw;
+
+    if(!disk_enabled() || up->raw || up->status != 200 || up->chunked || up->clen < 0)
+        return NULL;
+    if(!(dw = disk_begin(uri, up->hlen, up->hlen + up->clen)))
+        return NULL;
+    disk_write(dw, up->head, up->hlen);
+    disk_write(dw, body, n);
+    return dw;
+}
+
+// GET /stats, addressed to the proxy itself rather than through it
+int send_stats(int fd, int keep)
+{
+    char body[MAXBUF], hdr[MAXLINE];
+    int len = stats_format(body, MAXBUF);
+    struct iovec iov[2];
+
+    len += disk_format(body + len, MAXBUF - len);
+    iov[0].iov_base = hdr;
+    iov[1].iov_base = body;
+    iov[1].iov_len = len;
+    iov[0].iov_len = sprintf(hdr, "HTTP/1.0 200 OK\r\nContent-type: text/plain\r\n"
+                             "Content-length: %d\r\nConnection: %s\r\n\r\n", len, keep ? "keep-alive" : "close");
+    if(bio_writev(fd, iov, 2) < 0)
+        return 0;
+    return keep;
+}
+
+// Return an error message to the client
+void clienterror(int fd, char *cause, char *errnum,
+                 char *shortmsg, char *longmsg)
+{
+    char buf[MAXBUF];
+    int len = error_response(buf, MAXBUF, cause, errnum, shortmsg, longmsg);
+
+    rio_writen(fd, buf, len);
+}
+
+// Create an empty, bounded, shared FIFO buffer with n slots
+void sbuf_init(sbuf_t *sp, int n)
+{
+    sp->buf = Calloc(n, sizeof(int));
+    sp->n = n;
+    sp->front = sp->rear = 0;
+    Sem_init(&sp->mutex, 0, 1);
+    Sem_init(&sp->slots, 0, n);
+    Sem_init(&sp->items, 0, 0);
+}
+
+// Insert item onto the rear of shared buffer sp
+void sbuf_insert(sbuf_t *sp, int item)
+{
+    P(&sp->slots);
+    P(&sp->mutex);
+    sp->buf[(++sp->rear) % (sp->n)] = item;
+    V(&sp->mutex);
+    V(&sp->items);
+}
+
+// Remove and return the first item from buffer sp
+int sbuf_remove(sbuf_t *sp)
+{
+    int item;
+    P(&sp->items);
+    P(&sp->mutex);
+    item = sp->buf[(++sp->front) % (sp->n)];
+    V(&sp->mutex);
+    V(&sp->slots);
+    return item;
+}
@@ -0,0 +1,42 @@
+/*
+ * adder.c - a minimal CGI program that adds two numbers together.
+ *     Also runs as a persistent worker for tiny -w (see cgiw.h).
+ */
+/* $begin adder */
+#include "csapp.h"
+#include "cgiw.h"
+
+int main(void) {
+    char *buf, *p;
+    char arg1[MAXLINE], arg2[MAXLINE], content[MAXLINE];
+    int n1, n2, len;
+
+    while (cgiw_next()) {
+	n1 = n2 = 0;
+
+	/* Extract the two arguments (a worker outlives a bad request) */
+	if ((buf = getenv("QUERY_STRING")) != NULL && (p = strchr(buf, '&'))) {
+	    *p = '\0';
+	    strcpy(arg1, buf);
+	    strcpy(arg2, p+1);
+	    n1 = atoi(arg1);
+	    n2 = atoi(arg2);
+	}
+
+	/* Make the response body, each piece appended at len */
+	len = sprintf(content, "Welcome to add.com: ");
+	len += sprintf(content+len, "THE Internet addition portal.\r\n<p>");
+	len += sprintf(content+len, "The answer is: %d + %d = %d\r\n<p>", 
+		       n1, n2, n1 + n2);
+	sprintf(content+len, "Thanks for visiting!\r\n");
+  
+	/* Generate the HTTP response */
+	printf("Connection: close\r\n");
+	printf("Content-length: %d\r\n", (int)strlen(content));
+	printf("Content-type: text/html\r\n\r\n");
+	printf("%s", content);
+	cgiw_done();
+    }
+    exit(0);
+}
+/* $end adder */
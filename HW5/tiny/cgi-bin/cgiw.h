@@ -0,0 +1,182 @@
+/*
+ * cgiw.h - persistent CGI workers for tiny (tiny -w).
+ *
+ * Instead of a fork and exec per request, tiny keeps each CGI program
+ * running and hands it requests over a Unix socket, which the worker
+ * gets as its stdin. Frames (integers are 4 bytes, host order: both ends
+ * are on the same machine):
+ *   request:  count, then count "NAME=VALUE" strings, each length + bytes
+ *   response: length + bytes, what a CGI program writes to stdout
+ * A worker serves one request at a time until tiny closes the socket.
+ *
+ * A CGI program becomes a worker by looping over its body with
+ * cgiw_next() and cgiw_done(). Run by fork and exec as plain CGI (no
+ * TINY_WORKER in the environment), the loop runs once.
+ */
+#ifndef __CGIW_H__
+#define __CGIW_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define CGIW_ENV     "TINY_WORKER"
+#define CGIW_MAXVARS 32
+#define CGIW_MAXLEN  (1 << 24)   /* Largest string or response accepted */
+
+static inline int cgiw_readn(int fd, void *buf, size_t n)
+{
+    char *p = buf;
+    ssize_t k;
+
+    while (n > 0) {
+	if ((k = read(fd, p, n)) <= 0) {
+	    if (k < 0 && errno == EINTR)
+		continue;
+	    return -1;
+	}
+	p += k;
+	n -= k;
+    }
+    return 0;
+}
+
+static inline int cgiw_writen(int fd, const void *buf, size_t n)
+{
+    const char *p = buf;
+    ssize_t k;
+
+    while (n > 0) {
+	if ((k = write(fd, p, n)) <= 0) {
+	    if (k < 0 && errno == EINTR)
+		continue;
+	    return -1;
+	}
+	p += k;
+	n -= k;
+    }
+    return 0;
+}
+
+/* tiny: send a request frame of n variables, in one write */
+static inline int cgiw_request(int fd, char **vars, int n)
+{
+    size_t len = 4, off;
+    uint32_t k;
+    char *buf;
+    int i, rc;
+
+    for (i = 0; i < n; i++)
+	len += 4 + strlen(vars[i]);
+    if (!(buf = malloc(len)))
+	return -1;
+    k = n;
+    memcpy(buf, &k, 4);
+    for (i = 0, off = 4; i < n; i++) {
+	k = strlen(vars[i]);
+	memcpy(buf + off, &k, 4);
+	memcpy(buf + off + 4, vars[i], k);
+	off += 4 + k;
+    }
+    rc = cgiw_writen(fd, buf, len);
+    free(buf);
+    return rc;
+}
+
+/* tiny: read a response frame into a new buffer */
+static inline int cgiw_response(int fd, char **buf, uint32_t *len)
+{
+    if (cgiw_readn(fd, len, 4) < 0 || *len > CGIW_MAXLEN)
+	return -1;
+    if (!(*buf = malloc(*len ? *len : 1)))
+	return -1;
+    if (cgiw_readn(fd, *buf, *len) < 0) {
+	free(*buf);
+	return -1;
+    }
+    return 0;
+}
+
+/* Worker side. The state lives in a function so that tiny, which only
+   uses the functions above, doesn't get unused statics. */
+struct cgiw_state {
+    int mode;                   /* 1: worker, 0: plain CGI, -1: unknown */
+    int runs;
+    char *names[CGIW_MAXVARS];  /* Variables set for the current request */
+    int nnames;
+    FILE *stdout_;              /* The real stdout while capturing */
+    char *out;
+    size_t outlen;
+};
+
+static inline struct cgiw_state *cgiw_state(void)
+{
+    static struct cgiw_state s = { .mode = -1 };
+    return &s;
+}
+
+/* Wait for the next request and set up its environment, with stdout
+   captured for the response. Returns 0 when there are no more. */
+static inline int cgiw_next(void)
+{
+    struct cgiw_state *s = cgiw_state();
+    uint32_t n, len, i;
+    char *var, *eq;
+
+    if (s->mode < 0)
+	s->mode = getenv(CGIW_ENV) != NULL;
+    if (!s->mode)
+	return s->runs++ == 0;
+
+    /* The last request's variables don't carry over */
+    while (s->nnames > 0) {
+	unsetenv(s->names[--s->nnames]);
+	free(s->names[s->nnames]);
+    }
+    if (cgiw_readn(STDIN_FILENO, &n, 4) < 0)
+	return 0;
+    for (i = 0; i < n; i++) {
+	if (cgiw_readn(STDIN_FILENO, &len, 4) < 0 || len > CGIW_MAXLEN ||
+	    !(var = malloc(len + 1)) || cgiw_readn(STDIN_FILENO, var, len) < 0)
+	    return 0;
+	var[len] = '\0';
+	if ((eq = strchr(var, '=')) && s->nnames < CGIW_MAXVARS) {
+	    *eq = '\0';
+	    setenv(var, eq + 1, 1);
+	    s->names[s->nnames++] = var;
+	}
+	else
+	    free(var);
+    }
+
+    s->stdout_ = stdout;
+    if (!(stdout = open_memstream(&s->out, &s->outlen))) {
+	stdout = s->stdout_;
+	return 0;
+    }
+    return 1;
+}
+
+/* The response is complete: send it */
+static inline void cgiw_done(void)
+{
+    struct cgiw_state *s = cgiw_state();
+    uint32_t len;
+
+    if (!s->mode) {
+	fflush(stdout);
+	return;
+    }
+    fclose(stdout);
+    stdout = s->stdout_;
+    len = s->outlen;
+    if (cgiw_writen(STDIN_FILENO, &len, 4) < 0 ||
+	cgiw_writen(STDIN_FILENO, s->out, len) < 0)
+	exit(1);                    /* tiny is gone */
+    free(s->out);
+}
+
+#endif /* __CGIW_H__ */
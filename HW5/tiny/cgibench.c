@@ -0,0 +1,122 @@
+/*
+ * cgibench.c - requests per second against one tiny URI
+ *
+ * usage: cgibench [-c <clients>] [-t <secs>] <host> <port> <uri>
+ *
+ * Each client thread sends GET <uri> over a new connection (tiny closes
+ * after every response) and reads to EOF, as fast as it can. Run it
+ * against tiny and tiny -w to compare a fork and exec per request with
+ * persistent workers, e.g.
+ *     cgibench -c 8 localhost 8000 '/cgi-bin/adder?1&2'
+ */
+#include "csapp.h"
+
+static char *host, *port, *uri;
+static volatile int done;
+
+typedef struct {
+    unsigned long reqs, errors;
+    double lat;              /* Total seconds spent in requests */
+} result_t;
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* One request, 0 if a 200 came back */
+static int request(void)
+{
+    char buf[MAXBUF];
+    int fd, n, len, ok;
+
+    if ((fd = open_clientfd(host, port)) < 0)
+	return -1;
+    len = snprintf(buf, sizeof(buf), "GET %s HTTP/1.0\r\nHost: %s\r\n\r\n",
+		   uri, host);
+    if (rio_writen(fd, buf, len) != len) {
+	close(fd);
+	return -1;
+    }
+    ok = 0;
+    for (len = 0; (n = read(fd, buf, sizeof(buf))) > 0; len += n)
+	if (len == 0)
+	    ok = n >= 12 && !strncmp(buf + 9, "200", 3);
+    close(fd);
+    return ok && n == 0 ? 0 : -1;
+}
+
+static void *client(void *vargp)
+{
+    result_t *r = vargp;
+    double t;
+
+    while (!done) {
+	t = now();
+	if (request() < 0)
+	    r->errors++;
+	else {
+	    r->reqs++;
+	    r->lat += now() - t;
+	}
+    }
+    return NULL;
+}
+
+static void usage(char *prog)
+{
+    fprintf(stderr, "usage: %s [-c <clients>] [-t <secs>] <host> <port> <uri>\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int nclients = 4, secs = 5, c, i;
+    unsigned long reqs = 0, errors = 0;
+    double lat = 0, t0, t1;
+    pthread_t *tids;
+    result_t *res;
+
+    while ((c = getopt(argc, argv, "c:t:")) != -1) {
+	switch (c) {
+	case 'c':
+	    nclients = atoi(optarg);
+	    break;
+	case 't':
+	    secs = atoi(optarg);
+	    break;
+	default:
+	    usage(argv[0]);
+	}
+    }
+    if (optind != argc - 3 || nclients < 1 || secs < 1)
+	usage(argv[0]);
+    host = argv[optind];
+    port = argv[optind + 1];
+    uri = argv[optind + 2];
+    Signal(SIGPIPE, SIG_IGN);
+
+    tids = Malloc(nclients * sizeof(pthread_t));
+    res = Calloc(nclients, sizeof(result_t));
+    t0 = now();
+    for (i = 0; i < nclients; i++)
+	Pthread_create(&tids[i], NULL, client, &res[i]);
+    sleep(secs);
+    done = 1;
+    for (i = 0; i < nclients; i++) {
+	Pthread_join(tids[i], NULL);
+	reqs += res[i].reqs;
+	errors += res[i].errors;
+	lat += res[i].lat;
+    }
+    t1 = now();
+
+    printf("%s: %d clients, %.1f s\n", uri, nclients, t1 - t0);
+    printf("  requests  %lu (%lu errors)\n", reqs, errors);
+    printf("  req/s     %.0f\n", reqs / (t1 - t0));
+    printf("  latency   %.3f ms avg\n", reqs ? lat / reqs * 1000 : 0);
+    exit(0);
+}
@@ -0,0 +1,723 @@
+/* $begin tinymain */
+/*
+ * tiny.c - A simple HTTP/1.0 Web server that uses the GET method to
+ *     serve static and dynamic content. Iterative by default; -p forks
+ *     worker processes and -t runs a thread pool in each. Static files
+ *     go out with sendfile from a cache of open descriptors that inotify
+ *     keeps up to date. With -w, CGI programs run as persistent workers
+ *     (cgi-bin/cgiw.h) instead of a fork and exec per request.
+ */
+#include "csapp.h"
+#include <sys/sendfile.h>
+#include <sys/inotify.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+#include "../bufio.h"
+#include "cgi-bin/cgiw.h"
+
+#define FC_BUCKETS 1024  /* Hash buckets of the open-file cache */
+#define FC_MAX     1024  /* Most files kept open */
+#define SBUFSIZE   256   /* Accepted connections waiting for a thread */
+
+/* Open-file cache entry: an open descriptor and its stat result */
+typedef struct fentry {
+    char *name;              /* Key: the file name as requested */
+    int fd;
+    struct stat st;
+    int wd;                  /* inotify watch on its directory */
+    char *base;              /* Name within that directory */
+    int refs;                /* The cache's own plus one per request */
+    struct fentry *next;
+} fentry_t;
+
+/* Persistent workers running one CGI program */
+typedef struct cgipool {
+    char *prog;
+    pid_t *pids;
+    int *fds;                /* Socket to each worker, -1 if it died */
+    int *idle, nidle;        /* Stack of idle workers */
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    struct cgipool *next;
+} cgipool_t;
+
+/* Bounded queue of connected descriptors, as in the proxy */
+typedef struct {
+    int *buf, n, front, rear;
+    sem_t mutex, slots, items;
+} sbuf_t;
+
+void doit(int fd);
+void read_requesthdrs(bio_t *bp);
+int parse_uri(char *uri, char *filename, char *cgiargs);
+void serve_static(int fd, fentry_t *fe, char *filename);
+void get_filetype(char *filename, char *filetype);
+void serve_dynamic(int fd, char *filename, char *cgiargs);
+void serve_worker(int fd, char *filename, char *cgiargs);
+void clienterror(int fd, char *cause, char *errnum, 
+		 char *shortmsg, char *longmsg);
+void fc_init(void);
+fentry_t *fc_get(char *filename);
+void fc_put(fentry_t *fe);
+
+static int verbose = 1;      /* Log requests (-q turns it off) */
+static int cgi_workers;      /* Persistent workers per CGI program (-w) */
+static sbuf_t sbuf;
+
+static void sbuf_init(sbuf_t *sp, int n)
+{
+    sp->buf = Calloc(n, sizeof(int));
+    sp->n = n;
+    sp->front = sp->rear = 0;
+    Sem_init(&sp->mutex, 0, 1);
+    Sem_init(&sp->slots, 0, n);
+    Sem_init(&sp->items, 0, 0);
+}
+
+static void sbuf_insert(sbuf_t *sp, int item)
+{
+    P(&sp->slots);
+    P(&sp->mutex);
+    sp->buf[(++sp->rear) % (sp->n)] = item;
+    V(&sp->mutex);
+    V(&sp->items);
+}
+
+static int sbuf_remove(sbuf_t *sp)
+{
+    int item;
+    P(&sp->items);
+    P(&sp->mutex);
+    item = sp->buf[(++sp->front) % (sp->n)];
+    V(&sp->mutex);
+    V(&sp->slots);
+    return item;
+}
+
+static void *worker(void *vargp)
+{
+    Pthread_detach(pthread_self());
+    while (1) {
+	int connfd = sbuf_remove(&sbuf);
+	doit(connfd);
+	Close(connfd);
+    }
+    return NULL;
+}
+
+void usage(char *prog)
+{
+    fprintf(stderr, "usage: %s [-p <procs>] [-t <threads>] [-w <workers>] [-q] <port>\n", prog);
+    fprintf(stderr, "   -p   worker processes sharing the listening socket (default: 1)\n");
+    fprintf(stderr, "   -t   threads per process (default: none, iterative)\n");
+    fprintf(stderr, "   -w   persistent workers per CGI program, per process (default: fork per request)\n");
+    fprintf(stderr, "   -q   don't log requests\n");
+    exit(1);
+}
+
+int main(int argc, char **argv) 
+{
+    int listenfd, connfd, c, i, nprocs = 1, nthreads = 0;
+    char hostname[MAXLINE], port[MAXLINE];
+    socklen_t clientlen;
+    struct sockaddr_storage clientaddr;
+    pthread_t tid;
+
+    /* Check command line args */
+    while ((c = getopt(argc, argv, "p:t:w:q")) != -1) {
+	switch (c) {
+	case 'p':
+	    nprocs = atoi(optarg);
+	    break;
+	case 't':
+	    nthreads = atoi(optarg);
+	    break;
+	case 'w':
+	    cgi_workers = atoi(optarg);
+	    break;
+	case 'q':
+	    verbose = 0;
+	    break;
+	default:
+	    usage(argv[0]);
+	}
+    }
+    if (optind != argc - 1 || nprocs < 1 || nthreads < 0 || cgi_workers < 0)
+	usage(argv[0]);
+
+    /* A client closing early must not kill the server */
+    Signal(SIGPIPE, SIG_IGN);
+
+    listenfd = Open_listenfd(argv[optind]);
+
+    /* Prefork: the children all accept on the same socket */
+    if (nprocs > 1) {
+	for (i = 0; i < nprocs; i++)
+	    if (Fork() == 0)
+		break;
+	if (i == nprocs) {
+	    while (wait(NULL) > 0 || errno == EINTR)
+		;
+	    exit(0);
+	}
+    }
+
+    fc_init();
+    if (nthreads) {
+	sbuf_init(&sbuf, SBUFSIZE);
+	for (i = 0; i < nthreads; i++)
+	    Pthread_create(&tid, NULL, worker, NULL);
+    }
+
+    while (1) {
+	clientlen = sizeof(clientaddr);
+	connfd = accept(listenfd, (SA *)&clientaddr, &clientlen); //line:netp:tiny:accept
+	if (connfd < 0)
+	    continue;
+	if (verbose) {
+	    Getnameinfo((SA *) &clientaddr, clientlen, hostname, MAXLINE, 
+			port, MAXLINE, 0);
+	    printf("Accepted connection from (%s, %s)\n", hostname, port);
+	}
+	if (nthreads) {
+	    sbuf_insert(&sbuf, connfd);
+	    continue;
+	}
+	doit(connfd);                                             //line:netp:tiny:doit
+	Close(connfd);                                            //line:netp:tiny:close
+    }
+}
+/* $end tinymain */
+
+/*
+ * doit - handle one HTTP request/response transaction
+ */
+/* $begin doit */
+void doit(int fd) 
+{
+    int is_static;
+    struct stat sbuf;
+    char buf[MAXLINE], method[MAXLINE], uri[MAXLINE], version[MAXLINE];
+    char filename[MAXLINE], cgiargs[MAXLINE], *line;
+    bio_t bio;
+    ssize_t n;
+    fentry_t *fe;
+
+    /* Read request line and headers */
+    bio_init(&bio, fd);
+    if ((n = bio_line(&bio, &line)) <= 0)  //line:netp:doit:readrequest
+        return;
+    if (n >= MAXLINE)
+	n = MAXLINE - 1;
+    memcpy(buf, line, n);
+    buf[n] = '\0';
+    if (verbose)
+	printf("%s", buf);
+    if (sscanf(buf, "%s %s %s", method, uri, version) != 3) //line:netp:doit:parserequest
+        return;
+    if (strcasecmp(method, "GET")) {                     //line:netp:doit:beginrequesterr
+        clienterror(fd, method, "501", "Not Implemented",
+                    "Tiny does not implement this method");
+        return;
+    }                                                    //line:netp:doit:endrequesterr
+    read_requesthdrs(&bio);                              //line:netp:doit:readrequesthdrs
+
+    /* Parse URI from GET request */
+    is_static = parse_uri(uri, filename, cgiargs);       //line:netp:doit:staticcheck
+    if (is_static) { /* Serve static content */          
+	/* Open (or cached) file: its stat result comes with it */
+	if (!(fe = fc_get(filename))) {
+	    if (errno == ENOENT || errno == ENOTDIR)
+		clienterror(fd, filename, "404", "Not found",
+			    "Tiny couldn't find this file");
+	    else
+		clienterror(fd, filename, "403", "Forbidden",
+			    "Tiny couldn't read the file");
+	    return;
+	}
+	if (!(S_ISREG(fe->st.st_mode)) || !(S_IRUSR & fe->st.st_mode)) { //line:netp:doit:readable
+	    clienterror(fd, filename, "403", "Forbidden",
+			"Tiny couldn't read the file");
+	    fc_put(fe);
+	    return;
+	}
+	serve_static(fd, fe, filename);                  //line:netp:doit:servestatic
+	fc_put(fe);
+    }
+    else { /* Serve dynamic content */
+	if (stat(filename, &sbuf) < 0) {                 //line:netp:doit:beginnotfound
+	    clienterror(fd, filename, "404", "Not found",
+			"Tiny couldn't find this file");
+	    return;
+	}                                                //line:netp:doit:endnotfound
+	if (!(S_ISREG(sbuf.st_mode)) || !(S_IXUSR & sbuf.st_mode)) { //line:netp:doit:executable
+	    clienterror(fd, filename, "403", "Forbidden",
+			"Tiny couldn't run the CGI program");
+	    return;
+	}
+	serve_dynamic(fd, filename, cgiargs);            //line:netp:doit:servedynamic
+    }
+}
+/* $end doit */
+
+/*
+ * read_requesthdrs - read HTTP request headers, looking at each where
+ *     it lies in the read buffer
+ */
+/* $begin read_requesthdrs */
+void read_requesthdrs(bio_t *bp) 
+{
+    char *line;
+    ssize_t n;
+
+    do {                                  //line:netp:readhdrs:checkterm
+	if ((n = bio_line(bp, &line)) <= 0)
+	    return;
+	if (verbose)
+	    fwrite(line, 1, n, stdout);
+    } while (!(n == 2 && line[0] == '\r'));
+    return;
+}
+/* $end read_requesthdrs */
+
+/*
+ * parse_uri - parse URI into filename and CGI args
+ *             return 0 if dynamic content, 1 if static
+ */
+/* $begin parse_uri */
+int parse_uri(char *uri, char *filename, char *cgiargs) 
+{
+    char *ptr;
+
+    if (!strstr(uri, "cgi-bin")) {  /* Static content */ //line:netp:parseuri:isstatic
+	strcpy(cgiargs, "");                             //line:netp:parseuri:clearcgi
+	strcpy(filename, ".");                           //line:netp:parseuri:beginconvert1
+	strcat(filename, uri);                           //line:netp:parseuri:endconvert1
+	if (uri[strlen(uri)-1] == '/')                   //line:netp:parseuri:slashcheck
+	    strcat(filename, "home.html");               //line:netp:parseuri:appenddefault
+	return 1;
+    }
+    else {  /* Dynamic content */                        //line:netp:parseuri:isdynamic
+	ptr = index(uri, '?');                           //line:netp:parseuri:beginextract
+	if (ptr) {
+	    strcpy(cgiargs, ptr+1);
+	    *ptr = '\0';
+	}
+	else 
+	    strcpy(cgiargs, "");                         //line:netp:parseuri:endextract
+	strcpy(filename, ".");                           //line:netp:parseuri:beginconvert2
+	strcat(filename, uri);                           //line:netp:parseuri:endconvert2
+	return 0;
+    }
+}
+/* $end parse_uri */
+
+/*
+ * serve_static - send an open file back to the client. The headers are
+ *     corked so they leave in the same segment as the start of the file,
+ *     which sendfile copies to the socket inside the kernel.
+ */
+/* $begin serve_static */
+void serve_static(int fd, fentry_t *fe, char *filename) 
+{
+    char filetype[32], buf[MAXBUF];
+    off_t off = 0, filesize = fe->st.st_size;
+    ssize_t n;
+    int cork = 1;
+ 
+    /* Send response headers to client */
+    get_filetype(filename, filetype);       //line:netp:servestatic:getfiletype
+    snprintf(buf, MAXBUF, "HTTP/1.0 200 OK\r\n" //line:netp:servestatic:beginserve
+	    "Server: Tiny Web Server\r\n"
+	    "Connection: close\r\n"
+	    "Content-length: %lld\r\n"
+	    "Content-type: %s\r\n\r\n", (long long)filesize, filetype);
+    setsockopt(fd, IPPROTO_TCP, TCP_CORK, &cork, sizeof(cork));
+    if (rio_writen(fd, buf, strlen(buf)) < 0) //line:netp:servestatic:endserve
+	return;
+    if (verbose) {
+	printf("Response headers:\n");
+	printf("%s", buf);
+    }
+
+    /* Send response body to client (our own offset: fe->fd is shared) */
+    while (off < filesize) {
+	if ((n = sendfile(fd, fe->fd, &off, filesize - off)) <= 0) {
+	    if (n < 0 && errno == EINTR)
+		continue;
+	    break;                          /* Client gone or file shrank */
+	}
+    }
+    cork = 0;                               /* Uncork: flush the tail */
+    setsockopt(fd, IPPROTO_TCP, TCP_CORK, &cork, sizeof(cork));
+}
+
+/*
+ * get_filetype - derive file type from file name
+ */
+void get_filetype(char *filename, char *filetype) 
+{
+    if (strstr(filename, ".html"))
+	strcpy(filetype, "text/html");
+    else if (strstr(filename, ".gif"))
+	strcpy(filetype, "image/gif");
+    else if (strstr(filename, ".png"))
+	strcpy(filetype, "image/png");
+    else if (strstr(filename, ".jpg"))
+	strcpy(filetype, "image/jpeg");
+    else
+	strcpy(filetype, "text/plain");
+}  
+/* $end serve_static */
+
+/*
+ * serve_dynamic - run a CGI program on behalf of the client
+ */
+/* $begin serve_dynamic */
+void serve_dynamic(int fd, char *filename, char *cgiargs) 
+{
+    char buf[MAXLINE], *emptylist[] = { NULL };
+    pid_t pid;
+
+    if (cgi_workers) {
+	serve_worker(fd, filename, cgiargs);
+	return;
+    }
+
+    /* Return first part of HTTP response */
+    sprintf(buf, "HTTP/1.0 200 OK\r\nServer: Tiny Web Server\r\n"); 
+    if (rio_writen(fd, buf, strlen(buf)) < 0)
+	return;
+  
+    if ((pid = Fork()) == 0) { /* Child */ //line:netp:servedynamic:fork
+	/* Real server would set all CGI vars here */
+	setenv("QUERY_STRING", cgiargs, 1); //line:netp:servedynamic:setenv
+	Dup2(fd, STDOUT_FILENO);         /* Redirect stdout to client */ //line:netp:servedynamic:dup2
+	Execve(filename, emptylist, environ); /* Run CGI program */ //line:netp:servedynamic:execve
+    }
+    /* Reap our own child only: other threads have theirs */
+    Waitpid(pid, NULL, 0); //line:netp:servedynamic:wait
+}
+/* $end serve_dynamic */
+
+/*
+ * cgi_spawn - start worker i of pool cp: the program, with a socket to
+ *     us as its stdin and TINY_WORKER set. Returns -1 if it can't.
+ */
+static int cgi_spawn(cgipool_t *cp, int i)
+{
+    char *argv[] = { cp->prog, NULL }, **envp;
+    int sv[2], n, fd, maxfd = sysconf(_SC_OPEN_MAX);
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+	return -1;
+
+    /* The environment is built before forking: between fork and exec,
+       other threads' locks may be held, so the child only makes system
+       calls. It closes what it inherited too, or a client connection
+       would stay open for as long as the worker runs. */
+    for (n = 0; environ[n]; n++)
+	;
+    envp = Malloc((n + 2) * sizeof(char *));
+    memcpy(envp, environ, n * sizeof(char *));
+    envp[n] = CGIW_ENV "=1";
+    envp[n + 1] = NULL;
+
+    if ((cp->pids[i] = fork()) == 0) {
+	dup2(sv[1], STDIN_FILENO);
+	for (fd = STDERR_FILENO + 1; fd < maxfd; fd++)
+	    close(fd);
+	execve(cp->prog, argv, envp);
+	_exit(127);
+    }
+    Free(envp);
+    close(sv[1]);
+    if (cp->pids[i] < 0) {
+	close(sv[0]);
+	return -1;
+    }
+    cp->fds[i] = sv[0];
+    return 0;
+}
+
+/*
+ * cgi_pool - the worker pool for prog, created on first use. Workers
+ *     start when first needed.
+ */
+static cgipool_t *cgi_pool(char *prog)
+{
+    static cgipool_t *pools;
+    static pthread_mutex_t pools_lock = PTHREAD_MUTEX_INITIALIZER;
+    cgipool_t *cp;
+    int i;
+
+    pthread_mutex_lock(&pools_lock);
+    for (cp = pools; cp; cp = cp->next)
+	if (!strcmp(cp->prog, prog))
+	    break;
+    if (!cp) {
+	cp = Malloc(sizeof(cgipool_t));
+	cp->prog = Malloc(strlen(prog) + 1);
+	strcpy(cp->prog, prog);
+	cp->pids = Calloc(cgi_workers, sizeof(pid_t));
+	cp->fds = Malloc(cgi_workers * sizeof(int));
+	cp->idle = Malloc(cgi_workers * sizeof(int));
+	for (i = 0; i < cgi_workers; i++) {
+	    cp->fds[i] = -1;
+	    cp->idle[i] = i;
+	}
+	cp->nidle = cgi_workers;
+	pthread_mutex_init(&cp->lock, NULL);
+	pthread_cond_init(&cp->ready, NULL);
+	cp->next = pools;
+	pools = cp;
+    }
+    pthread_mutex_unlock(&pools_lock);
+    return cp;
+}
+
+/*
+ * serve_worker - run a CGI request on a persistent worker: the
+ *     environment goes in one frame, the program's output comes back in
+ *     another. A worker that dies is restarted by the next request.
+ */
+void serve_worker(int fd, char *filename, char *cgiargs)
+{
+    char hdr[] = "HTTP/1.0 200 OK\r\nServer: Tiny Web Server\r\n";
+    char query[MAXLINE + 16], *vars[] = { query, "REQUEST_METHOD=GET" };
+    struct iovec iov[2];
+    cgipool_t *cp = cgi_pool(filename);
+    uint32_t len;
+    char *resp;
+    int i, ok, tries;
+
+    /* 1. Take an idle worker */
+    pthread_mutex_lock(&cp->lock);
+    while (cp->nidle == 0)
+	pthread_cond_wait(&cp->ready, &cp->lock);
+    i = cp->idle[--cp->nidle];
+    pthread_mutex_unlock(&cp->lock);
+
+    /* 2. Request and response. A worker that was already running may
+       have died since its last request, so it gets a second try. */
+    snprintf(query, sizeof(query), "QUERY_STRING=%s", cgiargs);
+    for (ok = 0, tries = cp->fds[i] >= 0 ? 2 : 1; !ok && tries > 0; tries--) {
+	ok = (cp->fds[i] >= 0 || cgi_spawn(cp, i) == 0) &&
+	    cgiw_request(cp->fds[i], vars, 2) == 0 &&
+	    cgiw_response(cp->fds[i], &resp, &len) == 0;
+	if (!ok && cp->fds[i] >= 0) {
+	    close(cp->fds[i]);
+	    cp->fds[i] = -1;
+	    waitpid(cp->pids[i], NULL, 0);
+	}
+    }
+
+    /* 3. Give the worker back */
+    pthread_mutex_lock(&cp->lock);
+    cp->idle[cp->nidle++] = i;
+    pthread_cond_signal(&cp->ready);
+    pthread_mutex_unlock(&cp->lock);
+
+    if (!ok) {
+	clienterror(fd, filename, "502", "Bad Gateway",
+		    "Tiny's CGI worker failed");
+	return;
+    }
+
+    /* Status line and output in one go */
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = strlen(hdr);
+    iov[1].iov_base = resp;
+    iov[1].iov_len = len;
+    bio_writev(fd, iov, 2);
+    Free(resp);
+}
+
+/*
+ * clienterror - returns an error message to the client
+ */
+/* $begin clienterror */
+void clienterror(int fd, char *cause, char *errnum, 
+		 char *shortmsg, char *longmsg) 
+{
+    char buf[MAXLINE], body[MAXBUF];
+    struct iovec iov[2];
+    int len;
+
+    /* Build the HTTP response body, each piece appended at len (the
+     * cause is a client's URI, so it is cut short to stay in body) */
+    len = snprintf(body, MAXBUF, "<html><title>Tiny Error</title>");
+    len += snprintf(body+len, MAXBUF-len, "<body bgcolor=""ffffff"">\r\n");
+    len += snprintf(body+len, MAXBUF-len, "%s: %s\r\n", errnum, shortmsg);
+    len += snprintf(body+len, MAXBUF-len, "<p>%.512s: %.4096s\r\n",
+		    longmsg, cause);
+    snprintf(body+len, MAXBUF-len, "<hr><em>The Tiny Web server</em>\r\n");
+
+
+
+    /* Print the HTTP response, headers and body in one write */
+    sprintf(buf, "HTTP/1.0 %s %s\r\nContent-type: text/html\r\n"
+	    "Content-length: %d\r\n\r\n", errnum, shortmsg, (int)strlen(body));
+    iov[0].iov_base = buf;
+    iov[0].iov_len = strlen(buf);
+    iov[1].iov_base = body;
+    iov[1].iov_len = strlen(body);
+    bio_writev(fd, iov, 2);
+}
+/* $end clienterror */
+
+/*
+ * Open-file cache. Lookups share a read lock, and each request holds a
+ * reference, so an entry dropped in the middle of a sendfile stays open
+ * until that request is done. A thread reads inotify events for the
+ * directories of cached files and drops the entries of files that change.
+ */
+static fentry_t *fc_table[FC_BUCKETS];
+static int fc_count;
+static unsigned long fc_gen;     /* Bumped by every invalidation */
+static pthread_rwlock_t fc_lock = PTHREAD_RWLOCK_INITIALIZER;
+static int fc_ifd = -1;          /* inotify instance, -1 if none */
+
+static unsigned long fc_hash(char *s)
+{
+    unsigned long h = 5381;
+    while (*s)
+	h = h * 33 + (unsigned char)*s++;
+    return h;
+}
+
+/* Drop the entries for base in watched directory wd (any file if base is
+   NULL, any directory if wd < 0) */
+static void fc_invalidate(int wd, char *base)
+{
+    fentry_t **pp, *fe, *dead = NULL;
+    int i;
+
+    pthread_rwlock_wrlock(&fc_lock);
+    fc_gen++;
+    for (i = 0; i < FC_BUCKETS; i++) {
+	for (pp = &fc_table[i]; (fe = *pp); ) {
+	    if ((wd < 0 || fe->wd == wd) && (!base || !strcmp(fe->base, base))) {
+		*pp = fe->next;
+		fc_count--;
+		fe->next = dead;
+		dead = fe;
+	    }
+	    else
+		pp = &fe->next;
+	}
+    }
+    pthread_rwlock_unlock(&fc_lock);
+    while ((fe = dead)) {
+	dead = fe->next;
+	fc_put(fe);
+    }
+}
+
+static void *fc_watcher(void *vargp)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct inotify_event *ev;
+    ssize_t n;
+    char *p;
+
+    Pthread_detach(pthread_self());
+    while (1) {
+	if ((n = read(fc_ifd, buf, sizeof(buf))) <= 0) {
+	    if (n < 0 && errno == EINTR)
+		continue;
+	    return NULL;
+	}
+	for (p = buf; p < buf + n; p += sizeof(struct inotify_event) + ev->len) {
+	    ev = (struct inotify_event *)p;
+	    if (ev->mask & IN_Q_OVERFLOW)
+		fc_invalidate(-1, NULL);        /* Lost events: start over */
+	    else if (ev->mask & IN_IGNORED)
+		fc_invalidate(ev->wd, NULL);    /* Directory gone */
+	    else if (ev->len)
+		fc_invalidate(ev->wd, ev->name);
+	}
+    }
+    return NULL;
+}
+
+/* Per process: call after forking */
+void fc_init(void)
+{
+    pthread_t tid;
+
+    if ((fc_ifd = inotify_init1(IN_CLOEXEC)) < 0)
+	return;                                 /* Then nothing is cached */
+    Pthread_create(&tid, NULL, fc_watcher, NULL);
+}
+
+/*
+ * fc_get - the open file and its stat result, with a reference for the
+ *     caller to fc_put. NULL (and errno) if it can't be opened.
+ */
+fentry_t *fc_get(char *filename)
+{
+    unsigned long h = fc_hash(filename) % FC_BUCKETS, gen;
+    char dir[MAXLINE], *slash = strrchr(filename, '/');
+    fentry_t *fe, *p;
+    int fd, wd = -1;
+
+    pthread_rwlock_rdlock(&fc_lock);
+    for (fe = fc_table[h]; fe; fe = fe->next) {
+	if (!strcmp(fe->name, filename)) {
+	    __atomic_add_fetch(&fe->refs, 1, __ATOMIC_RELAXED);
+	    break;
+	}
+    }
+    gen = fc_gen;
+    pthread_rwlock_unlock(&fc_lock);
+    if (fe)
+	return fe;
+
+    /* Watch the directory before opening, so no change goes unseen */
+    if (fc_ifd >= 0 && slash) {
+	snprintf(dir, sizeof(dir), "%.*s", (int)(slash - filename), filename);
+	wd = inotify_add_watch(fc_ifd, dir, IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+			       IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+    }
+    if ((fd = open(filename, O_RDONLY | O_CLOEXEC)) < 0)
+	return NULL;
+    fe = Malloc(sizeof(fentry_t));
+    if (fstat(fd, &fe->st) < 0) {
+	close(fd);
+	Free(fe);
+	return NULL;
+    }
+    fe->name = Malloc(strlen(filename) + 1);
+    strcpy(fe->name, filename);
+    fe->base = slash ? fe->name + (slash - filename) + 1 : fe->name;
+    fe->fd = fd;
+    fe->wd = wd;
+    fe->refs = 1;
+    if (wd < 0 || !S_ISREG(fe->st.st_mode))
+	return fe;                              /* Used once, not cached */
+
+    /* Cache it, unless something changed since we looked (it might be
+       this file, opened before the change) or the cache is full */
+    pthread_rwlock_wrlock(&fc_lock);
+    for (p = fc_table[h]; p; p = p->next)
+	if (!strcmp(p->name, filename))
+	    break;
+    if (!p && gen == fc_gen && fc_count < FC_MAX) {
+	fe->refs++;
+	fe->next = fc_table[h];
+	fc_table[h] = fe;
+	fc_count++;
+    }
+    pthread_rwlock_unlock(&fc_lock);
+    return fe;
+}
+
+void fc_put(fentry_t *fe)
+{
+    if (__atomic_sub_fetch(&fe->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+	close(fe->fd);
+	Free(fe->name);
+	Free(fe);
+    }
+}
@@ -0,0 +1,233 @@
+#ifndef DBFS_RING_H
+#define DBFS_RING_H
+
+// Single-producer/single-consumer record ring shared with user space.
+//
+// The kernel side allocates the ring with vmalloc_user() and exposes it
+// through an mmap-able debugfs file. Page 0 holds struct dbfs_ring_hdr and
+// the records start at data_off. The module produces records in place and
+// publishes them by advancing head. User space reads them straight out of
+// the mapping and frees them by advancing tail, with no syscalls. poll()
+// reports the file readable while head != tail.
+//
+// The header page is writable by anyone who maps the ring, so the kernel
+// keeps its own copy of the geometry, head and drop count. It publishes
+// them there but never reads them back, and the only field it reads is
+// tail, which it clamps.
+//
+// Both modules include this header on its own, so everything here is
+// static. User-space programs get the consumer half.
+
+#include <linux/types.h>
+
+#define DBFS_RING_MAGIC 0x676e6972      // "ring"
+
+struct dbfs_ring_hdr {
+        __u32 magic;
+        __u32 rec_size;                 // bytes per record
+        __u32 nrecs;                    // records in the ring, a power of 2
+        __u32 data_off;                 // offset of record 0 in the mapping
+        __u64 size;                     // bytes to mmap
+        __u64 dropped;                  // records the producer had no room for
+        // Producer and consumer indices on their own cache lines; they only
+        // grow, the slot is index & (nrecs - 1)
+        __u64 head __attribute__((aligned(64)));
+        __u64 tail __attribute__((aligned(64)));
+};
+
+#ifdef __KERNEL__
+
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+#include <linux/log2.h>
+
+struct dbfs_ring {
+        struct dbfs_ring_hdr *hdr;      // start of the vmalloc_user() area
+        char *data;                     // record 0
+        u32 rec_size, nrecs;            // the kernel's copies; see above
+        size_t size;
+        u64 head;                       // last published head
+        u64 reserved;                   // head plus records handed out, not yet committed
+        u64 dropped;
+        wait_queue_head_t wait;
+};
+
+// Allocate a ring of at least nrecs records of rec_size bytes
+static inline int dbfs_ring_init(struct dbfs_ring *r, u32 rec_size, u32 nrecs)
+{
+        size_t size;
+
+        nrecs = roundup_pow_of_two(max(nrecs, 2U));
+        size = PAGE_SIZE + PAGE_ALIGN((size_t)rec_size * nrecs);
+        r->hdr = vmalloc_user(size);
+        if (!r->hdr)
+                return -ENOMEM;
+
+        r->rec_size = rec_size;
+        r->nrecs = nrecs;
+        r->size = size;
+        r->head = r->reserved = r->dropped = 0;
+        r->hdr->magic = DBFS_RING_MAGIC;
+        r->hdr->rec_size = rec_size;
+        r->hdr->nrecs = nrecs;
+        r->hdr->data_off = PAGE_SIZE;
+        r->hdr->size = size;
+        r->data = (char *)r->hdr + PAGE_SIZE;
+        init_waitqueue_head(&r->wait);
+        return 0;
+}
+
+static inline void dbfs_ring_free(struct dbfs_ring *r)
+{
+        vfree(r->hdr);
+        r->hdr = NULL;
+}
+
+// Hand out up to want free records that are contiguous in the ring.
+// Returns the first and sets *got, or returns NULL (and counts the records
+// as dropped) when the ring is full. Nothing is visible to the consumer
+// until dbfs_ring_commit(). Never sleeps; the caller serializes producers.
+static inline void *dbfs_ring_reserve(struct dbfs_ring *r, u64 want, u64 *got)
+{
+        u64 tail = smp_load_acquire(&r->hdr->tail);
+        u64 free, wrap;
+
+        // tail is written by user space: one that is ahead of head or more
+        // than a ring behind it is taken as a full ring
+        if (tail > r->head || r->reserved - tail > r->nrecs)
+                tail = r->reserved - r->nrecs;
+        free = r->nrecs - (r->reserved - tail);
+        wrap = r->nrecs - (r->reserved & (r->nrecs - 1));
+        *got = min3(want, free, wrap);
+        if (*got == 0) {
+                r->dropped += want;
+                WRITE_ONCE(r->hdr->dropped, r->dropped);
+                return NULL;
+        }
+        r->reserved += *got;
+        return r->data + ((r->reserved - *got) & (r->nrecs - 1)) * r->rec_size;
+}
+
+// Publish every reserved record and wake a consumer sleeping in poll()
+static inline void dbfs_ring_commit(struct dbfs_ring *r)
+{
+        if (r->reserved == r->head)
+                return;
+        WRITE_ONCE(r->head, r->reserved);
+        smp_store_release(&r->hdr->head, r->head);
+        if (wq_has_sleeper(&r->wait))
+                wake_up_interruptible(&r->wait);
+}
+
+static inline int dbfs_ring_mmap(struct file *fp, struct vm_area_struct *vma)
+{
+        struct dbfs_ring *r = fp->private_data;
+
+        if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start > r->size)
+                return -EINVAL;
+        return remap_vmalloc_range(vma, r->hdr, 0);
+}
+
+static inline __poll_t dbfs_ring_poll(struct file *fp, poll_table *wait)
+{
+        struct dbfs_ring *r = fp->private_data;
+
+        poll_wait(fp, &r->wait, wait);
+        return READ_ONCE(r->head) != READ_ONCE(r->hdr->tail) ?
+               EPOLLIN | EPOLLRDNORM : 0;
+}
+
+// debugfs_create_file_unsafe(name, S_IRUSR | S_IWUSR, dir, &ring, &dbfs_ring_fops)
+//
+// Not debugfs_create_file(): its proxy fops have no ->mmap. Without the
+// proxy nothing stops the file from outliving debugfs_remove(), so owner
+// pins the module instead. An open file, and so a mapping of the ring,
+// holds a reference, and the ring is only freed at module exit.
+static const struct file_operations dbfs_ring_fops __maybe_unused = {
+        .owner = THIS_MODULE,
+        .open = simple_open,
+        .mmap = dbfs_ring_mmap,
+        .poll = dbfs_ring_poll,
+};
+
+#else   // user space consumer
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+struct dbfs_ring_user {
+        int fd;
+        struct dbfs_ring_hdr *hdr;
+        char *data;
+        size_t size;
+        __u32 rec_size, nrecs;
+};
+
+// Map the ring behind path; returns 0, or -1 with errno set
+static inline int dbfs_ring_open(struct dbfs_ring_user *u, const char *path)
+{
+        struct dbfs_ring_hdr *hdr;
+        size_t size;
+
+        if ((u->fd = open(path, O_RDWR)) < 0)
+                return -1;
+
+        // The header says how big the whole mapping is
+        hdr = mmap(NULL, sizeof(*hdr), PROT_READ, MAP_SHARED, u->fd, 0);
+        if (hdr == MAP_FAILED)
+                goto fail;
+        size = hdr->size;
+        munmap(hdr, sizeof(*hdr));
+
+        u->hdr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, u->fd, 0);
+        if (u->hdr == MAP_FAILED)
+                goto fail;
+        u->size = size;
+        u->rec_size = u->hdr->rec_size;
+        u->nrecs = u->hdr->nrecs;
+        u->data = (char *)u->hdr + u->hdr->data_off;
+        return 0;
+
+fail:
+        close(u->fd);
+        return -1;
+}
+
+static inline void dbfs_ring_close(struct dbfs_ring_user *u)
+{
+        munmap(u->hdr, u->size);
+        close(u->fd);
+}
+
+// Next unread record, or NULL if the ring is empty
+static inline void *dbfs_ring_peek(struct dbfs_ring_user *u)
+{
+        __u64 tail = u->hdr->tail;
+
+        if (tail == __atomic_load_n(&u->hdr->head, __ATOMIC_ACQUIRE))
+                return NULL;
+        return u->data + (tail & (u->nrecs - 1)) * u->rec_size;
+}
+
+// Give the record returned by dbfs_ring_peek() back to the producer
+static inline void dbfs_ring_consume(struct dbfs_ring_user *u)
+{
+        __atomic_store_n(&u->hdr->tail, u->hdr->tail + 1, __ATOMIC_RELEASE);
+}
+
+// Sleep until a record is available; returns poll()'s result
+static inline int dbfs_ring_wait(struct dbfs_ring_user *u, int timeout_ms)
+{
+        struct pollfd pfd = { .fd = u->fd, .events = POLLIN };
+
+        return poll(&pfd, 1, timeout_ms);
+}
+
+#endif  // __KERNEL__
+
+#endif  // DBFS_RING_H
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "dbfs_ring.h"
+
+#define DBFS_FILE_PATH  "/sys/kernel/debug/paddr/output"
+#define DBFS_BATCH_PATH "/sys/kernel/debug/paddr/batch"
+#define DBFS_RING_PATH  "/sys/kernel/debug/paddr/ring"
+#define PAGE_SIZE       4096
+#define BATCH_LIST      0
+#define BATCH_RANGE     1
+#define BATCH_RING      2
+
+struct packet {
+        pid_t pid;
+        unsigned long vaddr;
+        unsigned long paddr;
+};
+
+struct xpacket {
+        pid_t pid;
+        unsigned long vaddr;
+        unsigned long paddr;
+        unsigned long size;
+        unsigned long flags;
+};
+
+struct batch {
+        int mode;
+        pid_t pid;
+        unsigned long vaddr;
+        unsigned long count;
+};
+
+static double now(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, unsigned long n, double secs)
+{
+        printf("%-8s %8lu translations in %.3f s: %12.0f /s\n",
+               name, n, secs, n / secs);
+}
+
+// usage: bench [MB] [thp]  (default 64MB of touched anonymous memory,
+// backed by 4KB pages unless "thp" is given)
+int main(int argc, char **argv)
+{
+        unsigned long mb = argc > 1 ? strtoul(argv[1], NULL, 0) : 64;
+        unsigned long npages = mb * 1024 * 1024 / PAGE_SIZE;
+        unsigned long i, *single, bad = 0, small = 0, huge = 0, gig = 0;
+        unsigned long queued, consumed;
+        struct dbfs_ring_user ru;
+        struct xpacket *x;
+        int thp = argc > 2 && strcmp(argv[2], "thp") == 0;
+        struct packet pckt;
+        struct xpacket *pckts;
+        struct batch *hdr;
+        size_t size;
+        char *mem;
+        int fd, bfd;
+        double t;
+
+        mem = mmap(NULL, npages * PAGE_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem != MAP_FAILED) {
+                madvise(mem, npages * PAGE_SIZE, thp ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+                for (i = 0; i < npages; i++)
+                        mem[i * PAGE_SIZE] = 1;
+        }
+        fd = open(DBFS_FILE_PATH, O_RDWR);
+        bfd = open(DBFS_BATCH_PATH, O_RDWR);
+        if (mem == MAP_FAILED || fd < 0 || bfd < 0) {
+                printf("setup failed (is dbfs_paddr loaded?)\n");
+                exit(-1);
+        }
+
+        size = sizeof(struct batch) + npages * sizeof(struct xpacket);
+        hdr = malloc(size);
+        single = malloc(npages * sizeof(unsigned long));
+        pckts = (struct xpacket *)(hdr + 1);
+
+        // 1. One read() per address
+        t = now();
+        for (i = 0; i < npages; i++) {
+                pckt.pid = getpid();
+                pckt.vaddr = (unsigned long)(mem + i * PAGE_SIZE);
+                pckt.paddr = 0;
+                if (read(fd, &pckt, sizeof(pckt)) < 0) {
+                        printf("single read failed\n");
+                        exit(-1);
+                }
+                single[i] = pckt.paddr;
+        }
+        report("single", npages, now() - t);
+
+        // 2. One read() for an array of (pid, vaddr)
+        hdr->mode = BATCH_LIST;
+        hdr->count = npages;
+        for (i = 0; i < npages; i++) {
+                pckts[i].pid = getpid();
+                pckts[i].vaddr = (unsigned long)(mem + i * PAGE_SIZE);
+        }
+        t = now();
+        if (read(bfd, hdr, size) < 0) {
+                printf("batch list read failed\n");
+                exit(-1);
+        }
+        report("list", npages, now() - t);
+        for (i = 0; i < npages; i++)
+                bad += pckts[i].paddr != single[i];
+
+        // 3. One read() for a contiguous range
+        hdr->mode = BATCH_RANGE;
+        hdr->pid = getpid();
+        hdr->vaddr = (unsigned long)mem;
+        hdr->count = npages;
+        t = now();
+        if (read(bfd, hdr, size) < 0) {
+                printf("batch range read failed\n");
+                exit(-1);
+        }
+        report("range", npages, now() - t);
+        for (i = 0; i < npages; i++) {
+                bad += pckts[i].paddr != single[i];
+                small += pckts[i].size == 4096UL;
+                huge += pckts[i].size == 2UL << 20;
+                gig += pckts[i].size == 1UL << 30;
+        }
+        printf("pages    4KB %lu, 2MB %lu, 1GB %lu (%.1f%% huge)\n", small,
+               huge, gig, 100.0 * (huge + gig) / npages);
+
+        // 4. Range into the shared ring, consumed from the mapping.
+        // Each read() queues as much as fits; we drain it and ask again.
+        if (dbfs_ring_open(&ru, DBFS_RING_PATH) < 0) {
+                printf("ring     not available\n");
+        } else {
+                // Skip whatever an earlier run left behind
+                while (dbfs_ring_peek(&ru))
+                        dbfs_ring_consume(&ru);
+                t = now();
+                for (queued = consumed = 0; consumed < npages; ) {
+                        if (queued < npages) {
+                                hdr->mode = BATCH_RING;
+                                hdr->pid = getpid();
+                                hdr->vaddr = (unsigned long)(mem + queued * PAGE_SIZE);
+                                hdr->count = npages - queued;
+                                if (read(bfd, hdr, sizeof(*hdr)) < 0) {
+                                        printf("batch ring read failed\n");
+                                        exit(-1);
+                                }
+                                queued += hdr->count;
+                        }
+                        while ((x = dbfs_ring_peek(&ru)) != NULL) {
+                                bad += consumed >= npages || x->paddr != single[consumed];
+                                consumed++;
+                                dbfs_ring_consume(&ru);
+                        }
+                }
+                report("ring", npages, now() - t);
+                dbfs_ring_close(&ru);
+        }
+
+        printf("[BENCH]    %s (%lu mismatches)\n", bad ? "FAIL" : "PASS", bad);
+
+        close(fd);
+        close(bfd);
+        munmap(mem, npages * PAGE_SIZE);
+        free(hdr);
+        free(single);
+
+        return bad != 0;
+}
@@ -2,13 +2,38 @@
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/uaccess.h>
+#include <linux/mm.h>
+#include <linux/sched/mm.h>
+#include <linux/slab.h>
+#include <linux/seq_file.h>
 #include <asm/pgtable.h>
 #include <linux/pgtable.h>
+#include <linux/mutex.h>
+#include "dbfs_ring.h"
 
 MODULE_LICENSE("GPL");
 
-static struct dentry *dir, *output;
-static struct task_struct *task;
+#define BATCH_LIST      0               // translate each packet's (pid, vaddr)
+#define BATCH_RANGE     1               // translate count pages from vaddr
+#define BATCH_RING      2               // like BATCH_RANGE, results go to the ring
+#define BATCH_MAX       (1UL << 20)     // max packets per read
+
+// xpacket.flags
+#define PADDR_PRESENT   0x01
+#define PADDR_WRITE     0x02
+#define PADDR_USER      0x04
+#define PADDR_ACCESSED  0x08
+#define PADDR_DIRTY     0x10
+#define PADDR_NX        0x20
+
+static struct dentry *dir, *output, *batchfile, *pidfile, *pagemap, *ringfile;
+static pid_t map_pid;                   // process exported by pagemap
+
+// xpackets produced by BATCH_RING, mmap-ed by the consumer
+static unsigned int ring_records = 65536;
+module_param(ring_records, uint, 0444);
+static struct dbfs_ring ring;
+static DEFINE_MUTEX(ring_lock);         // one producer at a time
 
 struct packet {
         pid_t pid;
@@ -16,42 +41,535 @@ struct packet {
         unsigned long paddr;
 };
 
+// Extended packet: a read() of at least this size also gets size and flags
+struct xpacket {
+        pid_t pid;
+        unsigned long vaddr;
+        unsigned long paddr;
+        unsigned long size;     // 4KB, 2MB or 1GB; 0 if vaddr is not mapped
+        unsigned long flags;    // PADDR_* bits of the leaf entry
+};
+
+// Header of a read() on the batch file, followed by count xpackets
+struct batch {
+        int mode;               // BATCH_LIST, BATCH_RANGE or BATCH_RING
+        pid_t pid;              // BATCH_RANGE/RING: process to translate
+        unsigned long vaddr;    // BATCH_RANGE/RING: first address
+        unsigned long count;    // number of xpackets after the header
+                                // (BATCH_RING: pages to translate, and on
+                                // return the number queued in the ring)
+};
+
+// One pagemap record: a mapped page or huge page
+struct map_rec {
+        unsigned long vaddr;
+        unsigned long pfn;
+        unsigned int size;      // 4KB, 2MB or 1GB
+        unsigned int flags;     // PADDR_* bits of the leaf entry
+        int nid;                // NUMA node of the frame, -1 if unknown
+        int pad;
+};
+
+// pagemap seq_file cursor: rec is record number pos, next is where the
+// scan for record pos + 1 starts
+struct map_iter {
+        struct mm_struct *mm;   // mm of map_pid at open, NULL if none
+        loff_t pos;             // index of rec, -1 before the first scan
+        int valid;              // rec holds record pos (0 at the end)
+        unsigned long next;     // first vaddr after rec
+        struct map_rec rec;
+};
+
+// Upper-level walk state reused by neighbouring addresses
+struct walk_cache {
+        pid_t pid;              // process whose mm is held, 0 if none
+        struct mm_struct *mm;   // mm of pid, read-locked
+        unsigned long pud_base; // vaddr & PUD_MASK of pud
+        pud_t *pud;             // pud entry covering pud_base, NULL if none
+        unsigned long pmd_base; // vaddr & PMD_MASK of pmd
+        pmd_t *pmd;             // pmd entry covering pmd_base, NULL if none
+};
+
+// Drop the mm held by the cache
+static void walk_release(struct walk_cache *wc)
+{
+        if (wc->mm) {
+                mmap_read_unlock(wc->mm);
+                mmput(wc->mm);
+        }
+        wc->pid = 0;
+        wc->mm = NULL;
+        wc->pud = NULL;
+        wc->pmd = NULL;
+}
+
+// Switch the cache to pid's mm; returns 0 if the process has no mm.
+// The mmap read lock keeps the upper levels of the tables in place for
+// as long as the cache holds them.
+static int walk_attach(struct walk_cache *wc, pid_t pid)
+{
+        struct task_struct *t;
+        struct pid *p;
+
+        if (wc->mm && wc->pid == pid)
+                return 1;
+        walk_release(wc);
+
+        p = find_get_pid(pid);
+        t = p ? get_pid_task(p, PIDTYPE_PID) : NULL;
+        put_pid(p);
+        if (!t)
+                return 0;
+        wc->mm = get_task_mm(t);
+        put_task_struct(t);
+        if (!wc->mm)
+                return 0;
+
+        mmap_read_lock(wc->mm);
+        wc->pid = pid;
+        return 1;
+}
+
+// Find the pud entry for vaddr, walking pgd->p4d only on a new 1GB region
+static pud_t *walk_pud(struct walk_cache *wc, unsigned long vaddr)
+{
+        pgd_t *pgd;
+        p4d_t *p4d;
+
+        if (wc->pud && (vaddr & PUD_MASK) == wc->pud_base)
+                return wc->pud;
+
+        wc->pud_base = vaddr & PUD_MASK;
+        wc->pud = NULL;
+        wc->pmd = NULL;
+
+        pgd = pgd_offset(wc->mm, vaddr);
+        if (pgd_none(*pgd) || pgd_bad(*pgd))
+                return NULL;
+        p4d = p4d_offset(pgd, vaddr);
+        if (p4d_none(*p4d) || p4d_bad(*p4d))
+                return NULL;
+        wc->pud = pud_offset(p4d, vaddr);
+        return wc->pud;
+}
+
+// PADDR_* flags from the x86 bits of a leaf entry
+static unsigned long leaf_flags(unsigned long f)
+{
+        return ((f & _PAGE_PRESENT) ? PADDR_PRESENT : 0) |
+               ((f & _PAGE_RW) ? PADDR_WRITE : 0) |
+               ((f & _PAGE_USER) ? PADDR_USER : 0) |
+               ((f & _PAGE_ACCESSED) ? PADDR_ACCESSED : 0) |
+               ((f & _PAGE_DIRTY) ? PADDR_DIRTY : 0) |
+               ((f & _PAGE_NX) ? PADDR_NX : 0);
+}
+
+// Fill x for vaddr mapped by a leaf of size bytes at pfn
+static void leaf_fill(struct xpacket *x, unsigned long vaddr,
+                      unsigned long pfn, unsigned long size, unsigned long f)
+{
+        x->paddr = (pfn << PAGE_SHIFT) | (vaddr & (size - 1));
+        x->size = size;
+        x->flags = leaf_flags(f);
+}
+
+// Fill x from a pte entry (not mapped if it is not present)
+static void pte_fill(struct xpacket *x, unsigned long vaddr, pte_t pte)
+{
+        if (pte_present(pte))
+                leaf_fill(x, vaddr, pte_pfn(pte), PAGE_SIZE, pte_flags(pte));
+}
+
+// Translate vaddr into x. 1GB and 2MB leaf entries end the walk with the
+// matching offset width. Returns the pmd entry if vaddr went through a
+// PTE table (so callers can scan its neighbours), NULL otherwise.
+static pmd_t *walk_one(struct walk_cache *wc, unsigned long vaddr,
+                       struct xpacket *x)
+{
+        pud_t *pud, pudv;
+        pmd_t *pmd, pmdv;
+        pte_t *pte;
+
+        x->paddr = x->size = x->flags = 0;
+
+        // 1GB
+        if (!(pud = walk_pud(wc, vaddr)))
+                return NULL;
+        pudv = READ_ONCE(*pud);
+        if (pud_none(pudv) || !pud_present(pudv))
+                return NULL;
+        if (pud_leaf(pudv)) {
+                leaf_fill(x, vaddr, pud_pfn(pudv), PUD_SIZE, pud_flags(pudv));
+                return NULL;
+        }
+        if (pud_bad(pudv))
+                return NULL;
+
+        // 2MB (THP or hugetlbfs)
+        if (!wc->pmd || (vaddr & PMD_MASK) != wc->pmd_base) {
+                wc->pmd_base = vaddr & PMD_MASK;
+                wc->pmd = pmd_offset(pud, vaddr);
+        }
+        pmd = wc->pmd;
+        pmdv = READ_ONCE(*pmd);
+        if (pmd_none(pmdv) || !pmd_present(pmdv))
+                return NULL;
+        if (pmd_leaf(pmdv)) {
+                leaf_fill(x, vaddr, pmd_pfn(pmdv), PMD_SIZE, pmd_flags(pmdv));
+                return NULL;
+        }
+        if (pmd_bad(pmdv))
+                return NULL;
+
+        // 4KB; pte_offset_map takes RCU where PTE tables can be freed
+        // under the mmap read lock, and fails if the table went away
+        if (!(pte = pte_offset_map(pmd, vaddr)))
+                return NULL;
+        pte_fill(x, vaddr, *pte);
+        pte_unmap(pte);
+        return pmd;
+}
+
+// Translate count pages from vaddr. Pages under one huge leaf are filled
+// from the first, and a PTE table is mapped once for all its pages.
+static void walk_range(struct walk_cache *wc, struct xpacket *pckts,
+                       unsigned long vaddr, unsigned long count)
+{
+        unsigned long i = 0, j, n, size;
+        struct xpacket *x;
+        pmd_t *pmd;
+        pte_t *pte;
+
+        while (i < count) {
+                x = &pckts[i];
+                x->pid = wc->pid;
+                x->vaddr = vaddr;
+                pmd = walk_one(wc, vaddr, x);
+
+                // Pages left in the region that the first one decides
+                size = x->size > PAGE_SIZE ? x->size : pmd ? PMD_SIZE : PAGE_SIZE;
+                n = ((vaddr & ~(size - 1)) + size - vaddr) >> PAGE_SHIFT;
+                n = min(count - i, n);
+
+                pte = (pmd && n > 1) ? pte_offset_map(pmd, vaddr) : NULL;
+                for (j = 1; j < n; j++) {
+                        pckts[i + j].pid = wc->pid;
+                        pckts[i + j].vaddr = vaddr + j * PAGE_SIZE;
+                        pckts[i + j].paddr = pckts[i + j].size = pckts[i + j].flags = 0;
+                        if (x->size > PAGE_SIZE) {
+                                pckts[i + j].paddr = x->paddr + j * PAGE_SIZE;
+                                pckts[i + j].size = x->size;
+                                pckts[i + j].flags = x->flags;
+                        } else if (pte) {
+                                pte_fill(&pckts[i + j], vaddr + j * PAGE_SIZE, pte[j]);
+                        }
+                }
+                if (pte)
+                        pte_unmap(pte);
+
+                i += n;
+                vaddr += n * PAGE_SIZE;
+        }
+}
+
 static ssize_t read_output(struct file *fp,
                         char __user *user_buffer,
                         size_t length,
                         loff_t *position)
 {
         // Implement read file operation
-        struct packet *pckt;
-        int ret;
+        struct walk_cache wc = { 0 };
+        struct xpacket pckt;
+        size_t size;
 
-        // Page Table
-        pgd_t *pgd; // Top level page table entry
-        p4d_t *p4d; // Next level page table entry
-        pud_t *pud;
-        pmd_t *pmd; 
-        pte_t *pte; // Pate Table Entry
-
-        pckt = (struct packet*) user_buffer;
+        // Old callers pass a struct packet, new ones a struct xpacket
+        if (length < sizeof(struct packet))
+                return -EINVAL;
+        size = length >= sizeof(struct xpacket) ? sizeof(struct xpacket) : sizeof(struct packet);
 
         // Get pid of app & virtual address
-        task = pid_task(find_get_pid(pckt -> pid), PIDTYPE_PID);
+        if (copy_from_user(&pckt, user_buffer, sizeof(struct packet)))
+                return -EFAULT;
 
-        // Get PHysical Address
-        pgd = pgd_offset(task->mm, pckt->vaddr);
-        p4d = p4d_offset(pgd, pckt->vaddr);
-        pud = pud_offset(p4d, pckt->vaddr);
-        pmd = pmd_offset(pud, pckt->vaddr);
-        pte = pte_offset_kernel(pmd, pckt->vaddr);
-
-        // Offset: 12bit
-        pckt->paddr = (pte_val(*pte) & 0xFFFFFFFFFF000) | (pckt->vaddr & 0x0000000000000FFF);
-        pte_unmap(pte);
+        // Get Physical Address (0 if not mapped)
+        if (!walk_attach(&wc, pckt.pid))
+                return -ESRCH;
+        walk_one(&wc, pckt.vaddr, &pckt);
+        walk_release(&wc);
 
         // Returns Physical address
-        // int copy_to_user(void __user* to, const void* from, unsigned long n)
-        ret = copy_to_user(user_buffer, pckt, sizeof(struct packet));
-        
+        if (copy_to_user(user_buffer, &pckt, size))
+                return -EFAULT;
+
+        return length;
+}
+
+// Translate count pages from vaddr straight into the ring, one contiguous
+// run of free slots at a time. Returns the number of xpackets queued.
+static unsigned long ring_range(struct walk_cache *wc, unsigned long vaddr,
+                                unsigned long count)
+{
+        struct xpacket *slots;
+        unsigned long done = 0;
+        u64 n;
+
+        mutex_lock(&ring_lock);
+        while (done < count) {
+                slots = dbfs_ring_reserve(&ring, count - done, &n);
+                if (!slots)
+                        break;
+                walk_range(wc, slots, vaddr + done * PAGE_SIZE, n);
+                done += n;
+                // Publish as we go so the consumer can start early
+                dbfs_ring_commit(&ring);
+        }
+        mutex_unlock(&ring_lock);
+        return done;
+}
+
+static ssize_t read_batch(struct file *fp,
+                        char __user *user_buffer,
+                        size_t length,
+                        loff_t *position)
+{
+        struct walk_cache wc = { 0 };
+        struct batch hdr;
+        struct xpacket *pckts;
+        unsigned long i, size;
+        ssize_t ret = length;
+
+        // 1. Header and, for a list, the requested addresses
+        if (length < sizeof(hdr) || copy_from_user(&hdr, user_buffer, sizeof(hdr)))
+                return -EFAULT;
+        if (hdr.count == 0 || hdr.count > BATCH_MAX ||
+            (hdr.mode != BATCH_LIST && hdr.mode != BATCH_RANGE && hdr.mode != BATCH_RING))
+                return -EINVAL;
+
+        // Ring mode: only the header goes back, with the count queued
+        if (hdr.mode == BATCH_RING) {
+                if (!walk_attach(&wc, hdr.pid))
+                        return -ESRCH;
+                hdr.count = ring_range(&wc, hdr.vaddr & PAGE_MASK, hdr.count);
+                walk_release(&wc);
+                if (copy_to_user(user_buffer, &hdr, sizeof(hdr)))
+                        return -EFAULT;
+                return length;
+        }
+
+        size = hdr.count * sizeof(struct xpacket);
+        if (length < sizeof(hdr) + size)
+                return -EINVAL;
+
+        pckts = kvmalloc(size, GFP_KERNEL);
+        if (!pckts)
+                return -ENOMEM;
+
+        // 2. Translate, keeping the mm locked and the upper levels across pages
+        if (hdr.mode == BATCH_RANGE) {
+                if (walk_attach(&wc, hdr.pid))
+                        walk_range(&wc, pckts, hdr.vaddr & PAGE_MASK, hdr.count);
+                else
+                        ret = -ESRCH;
+        } else if (copy_from_user(pckts, user_buffer + sizeof(hdr), size)) {
+                ret = -EFAULT;
+        } else {
+                for (i = 0; i < hdr.count; i++) {
+                        if (walk_attach(&wc, pckts[i].pid))
+                                walk_one(&wc, pckts[i].vaddr, &pckts[i]);
+                        else
+                                pckts[i].paddr = pckts[i].size = pckts[i].flags = 0;
+                }
+        }
+        walk_release(&wc);
+
+        // 3. All results in one copy
+        if (ret > 0 && copy_to_user(user_buffer + sizeof(hdr), pckts, size))
+                ret = -EFAULT;
+        kvfree(pckts);
+        return ret;
+}
+
+// Fill rec for vaddr mapped by a leaf of size bytes at pfn
+static void map_fill(struct map_rec *rec, unsigned long vaddr,
+                     unsigned long pfn, unsigned long size, unsigned long f)
+{
+        rec->vaddr = vaddr;
+        rec->pfn = pfn;
+        rec->size = size;
+        rec->flags = leaf_flags(f);
+        rec->nid = pfn_valid(pfn) ? page_to_nid(pfn_to_page(pfn)) : -1;
+        rec->pad = 0;
+}
+
+// Find the first present leaf at or after it->next, skipping whole empty
+// pgd/p4d/pud/pmd ranges and the holes between VMAs, so a scan over the
+// address space is linear in the number of mapped entries. Called with
+// the mmap read lock held.
+static int map_scan(struct map_iter *it)
+{
+        struct vm_area_struct *vma;
+        unsigned long addr = it->next, end, next;
+        pgd_t *pgd;
+        p4d_t *p4d;
+        pud_t *pud, pudv;
+        pmd_t *pmd, pmdv;
+        pte_t *pte, *ptep;
+        int found;
+
+        for (vma = find_vma(it->mm, addr); vma; vma = find_vma(it->mm, end)) {
+                addr = max(addr, vma->vm_start);
+                end = vma->vm_end;
+
+                for (; addr < end; addr = next) {
+                        pgd = pgd_offset(it->mm, addr);
+                        next = pgd_addr_end(addr, end);
+                        if (pgd_none(*pgd) || pgd_bad(*pgd))
+                                continue;
+                        p4d = p4d_offset(pgd, addr);
+                        next = p4d_addr_end(addr, end);
+                        if (p4d_none(*p4d) || p4d_bad(*p4d))
+                                continue;
+                        pud = pud_offset(p4d, addr);
+                        next = pud_addr_end(addr, end);
+                        pudv = READ_ONCE(*pud);
+                        if (pud_none(pudv) || !pud_present(pudv))
+                                continue;
+                        if (pud_leaf(pudv)) {
+                                addr &= PUD_MASK;
+                                map_fill(&it->rec, addr, pud_pfn(pudv), PUD_SIZE, pud_flags(pudv));
+                                it->next = addr + PUD_SIZE;
+                                return 1;
+                        }
+                        if (pud_bad(pudv))
+                                continue;
+                        pmd = pmd_offset(pud, addr);
+                        next = pmd_addr_end(addr, end);
+                        pmdv = READ_ONCE(*pmd);
+                        if (pmd_none(pmdv) || !pmd_present(pmdv))
+                                continue;
+                        if (pmd_leaf(pmdv)) {
+                                addr &= PMD_MASK;
+                                map_fill(&it->rec, addr, pmd_pfn(pmdv), PMD_SIZE, pmd_flags(pmdv));
+                                it->next = addr + PMD_SIZE;
+                                return 1;
+                        }
+                        if (pmd_bad(pmdv) || !(pte = pte_offset_map(pmd, addr)))
+                                continue;
+
+                        // First present pte in [addr, next)
+                        for (found = 0, ptep = pte; addr < next; addr += PAGE_SIZE, ptep++) {
+                                if (pte_present(*ptep)) {
+                                        map_fill(&it->rec, addr, pte_pfn(*ptep), PAGE_SIZE, pte_flags(*ptep));
+                                        found = 1;
+                                        break;
+                                }
+                        }
+                        pte_unmap(pte);
+                        if (found) {
+                                it->next = addr + PAGE_SIZE;
+                                return 1;
+                        }
+                }
+                cond_resched();
+        }
+        it->next = TASK_SIZE;
+        return 0;
+}
+
+static void *map_start(struct seq_file *m, loff_t *pos)
+{
+        struct map_iter *it = m->private;
+
+        if (!it->mm)
+                return NULL;
+        mmap_read_lock(it->mm);
+
+        // Resume at the cursor; any other position rescans from the start
+        if (*pos < it->pos) {
+                it->pos = -1;
+                it->next = 0;
+        }
+        while (it->pos < *pos) {
+                it->valid = map_scan(it);
+                it->pos++;
+                if (!it->valid)
+                        break;
+        }
+        return it->valid && it->pos == *pos ? &it->rec : NULL;
+}
+
+static void *map_next(struct seq_file *m, void *v, loff_t *pos)
+{
+        struct map_iter *it = m->private;
+
+        ++*pos;
+        it->valid = map_scan(it);
+        it->pos = *pos;
+        return it->valid ? &it->rec : NULL;
+}
+
+static void map_stop(struct seq_file *m, void *v)
+{
+        struct map_iter *it = m->private;
+
+        if (it->mm)
+                mmap_read_unlock(it->mm);
+}
+
+static int map_show(struct seq_file *m, void *v)
+{
+        seq_write(m, v, sizeof(struct map_rec));
+        return 0;
+}
+
+static const struct seq_operations map_seq_ops = {
+        .start = map_start,
+        .next = map_next,
+        .stop = map_stop,
+        .show = map_show,
+};
+
+static int open_pagemap(struct inode *inode, struct file *fp)
+{
+        struct map_iter *it;
+        struct task_struct *t;
+        struct pid *p;
+
+        it = __seq_open_private(fp, &map_seq_ops, sizeof(*it));
+        if (!it)
+                return -ENOMEM;
+        it->pos = -1;
+
+        p = find_get_pid(map_pid);
+        t = p ? get_pid_task(p, PIDTYPE_PID) : NULL;
+        put_pid(p);
+        if (t) {
+                it->mm = get_task_mm(t);
+                put_task_struct(t);
+        }
+        return 0;
+}
+
+static int release_pagemap(struct inode *inode, struct file *fp)
+{
+        struct map_iter *it = ((struct seq_file *)fp->private_data)->private;
+
+        if (it->mm)
+                mmput(it->mm);
+        return seq_release_private(inode, fp);
+}
+
+static ssize_t write_pid(struct file *fp,
+                        const char __user *user_buffer,
+                        size_t length,
+                        loff_t *position)
+{
+        int pid, ret;
+
+        ret = kstrtoint_from_user(user_buffer, length, 10, &pid);
+        if (ret)
+                return ret;
+        map_pid = pid;
         return length;
 }
 
@@ -60,13 +578,34 @@ static const struct file_operations dbfs_fops = {
         .read = read_output,
 };
 
+static const struct file_operations batch_fops = {
+        .read = read_batch,
+};
+
+static const struct file_operations pid_fops = {
+        .write = write_pid,
+};
+
+static const struct file_operations pagemap_fops = {
+        .open = open_pagemap,
+        .read = seq_read,
+        .llseek = seq_lseek,
+        .release = release_pagemap,
+};
+
 static int __init dbfs_module_init(void)
 {
         // Implement init module
 
+        if (dbfs_ring_init(&ring, sizeof(struct xpacket), ring_records)) {
+                printk("Cannot allocate paddr ring\n");
+                return -ENOMEM;
+        }
+
         dir = debugfs_create_dir("paddr", NULL);
         if (!dir) {
                 printk("Cannot create paddr dir\n");
+                dbfs_ring_free(&ring);
                 return -1;
         }
 
@@ -74,6 +613,11 @@ static int __init dbfs_module_init(void)
         // struct dentry* debugfs_create_file(const char *name, umode_t mode, struct dentry *parent, void *data, const struct file_operations *fops)
         // S_IRUSR: 읽기 권한
         output = debugfs_create_file("output", S_IRUSR, dir , NULL, &dbfs_fops);
+        batchfile = debugfs_create_file("batch", S_IRUSR, dir, NULL, &batch_fops);
+        pidfile = debugfs_create_file("pid", S_IWUSR, dir, NULL, &pid_fops);
+        pagemap = debugfs_create_file("pagemap", S_IRUSR, dir, NULL, &pagemap_fops);
+        // _unsafe: debugfs's proxy fops have no ->mmap (see dbfs_ring.h)
+        ringfile = debugfs_create_file_unsafe("ring", S_IRUSR | S_IWUSR, dir, &ring, &dbfs_ring_fops);
 
 	printk("dbfs_paddr module initialize done\n");
 
@@ -84,6 +628,7 @@ static void __exit dbfs_module_exit(void)
 {
         // Implement exit module
         debugfs_remove_recursive(dir);
+        dbfs_ring_free(&ring);
 
 	printk("dbfs_paddr module exit\n");
 }
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+#define DBFS_PID_PATH   "/sys/kernel/debug/paddr/pid"
+#define DBFS_MAP_PATH   "/sys/kernel/debug/paddr/pagemap"
+#define PAGE_SIZE       4096
+#define CHUNK           8192    // records per read()
+#define MAXNODES        64
+#define MAXORDER        40      // run length histogram buckets (log2 bytes)
+
+struct map_rec {
+        unsigned long vaddr;
+        unsigned long pfn;
+        unsigned int size;
+        unsigned int flags;
+        int nid;
+        int pad;
+};
+
+static int ilog2(unsigned long x)
+{
+        int n = 0;
+
+        while (x >>= 1)
+                n++;
+        return n;
+}
+
+// Close a physically contiguous run of len bytes
+static void end_run(unsigned long len, unsigned long *runs, unsigned long *maxrun,
+                    unsigned long *hist)
+{
+        if (len == 0)
+                return;
+        (*runs)++;
+        if (len > *maxrun)
+                *maxrun = len;
+        hist[ilog2(len)]++;
+}
+
+// usage: pmap <pid>
+// Summarizes how the process's mapped memory is backed: page sizes,
+// physically contiguous runs and NUMA nodes.
+int main(int argc, char **argv)
+{
+        static struct map_rec recs[CHUNK];
+        unsigned long nrec = 0, bytes = 0, npages[3] = { 0 };
+        unsigned long node[MAXNODES + 1] = { 0 }, hist[MAXORDER] = { 0 };
+        unsigned long runs = 0, maxrun = 0, run = 0, vend = 0, pend = 0;
+        struct map_rec *r;
+        ssize_t n;
+        int fd, i;
+
+        if (argc != 2) {
+                printf("usage: %s <pid>\n", argv[0]);
+                exit(-1);
+        }
+
+        fd = open(DBFS_PID_PATH, O_WRONLY);
+        if (fd < 0 || write(fd, argv[1], strlen(argv[1])) < 0) {
+                printf("debugfs pid file write failed (is dbfs_paddr loaded?)\n");
+                exit(-1);
+        }
+        close(fd);
+
+        fd = open(DBFS_MAP_PATH, O_RDONLY);
+        if (fd < 0) {
+                printf("debugfs pagemap file open error\n");
+                exit(-1);
+        }
+
+        while ((n = read(fd, recs, sizeof(recs))) > 0) {
+                for (i = 0; i < n / (ssize_t)sizeof(struct map_rec); i++) {
+                        r = &recs[i];
+                        nrec++;
+                        bytes += r->size;
+                        npages[r->size == PAGE_SIZE ? 0 : r->size == 2UL << 20 ? 1 : 2]++;
+                        node[r->nid >= 0 && r->nid < MAXNODES ? r->nid : MAXNODES] += r->size;
+
+                        // Contiguous in both address spaces: extend the run
+                        if (run && r->vaddr == vend && r->pfn * PAGE_SIZE == pend) {
+                                run += r->size;
+                        } else {
+                                end_run(run, &runs, &maxrun, hist);
+                                run = r->size;
+                        }
+                        vend = r->vaddr + r->size;
+                        pend = r->pfn * PAGE_SIZE + r->size;
+                }
+        }
+        end_run(run, &runs, &maxrun, hist);
+        close(fd);
+
+        if (nrec == 0) {
+                printf("pid %s: nothing mapped (or no such process)\n", argv[1]);
+                return 0;
+        }
+
+        printf("pid %s: %lu MB mapped in %lu entries\n", argv[1], bytes >> 20, nrec);
+        printf("  4KB pages %10lu (%5.1f%%)\n", npages[0], 100.0 * npages[0] * PAGE_SIZE / bytes);
+        printf("  2MB pages %10lu (%5.1f%%)\n", npages[1], 100.0 * (npages[1] << 21) / bytes);
+        printf("  1GB pages %10lu (%5.1f%%)\n", npages[2], 100.0 * (npages[2] << 30) / bytes);
+
+        printf("contiguity: %lu runs, mean %lu KB, largest %lu KB\n",
+               runs, (bytes / runs) >> 10, maxrun >> 10);
+        for (i = 0; i < MAXORDER; i++)
+                if (hist[i])
+                        printf("  runs of %8lu KB+ %10lu\n", (1UL << i) >> 10, hist[i]);
+
+        printf("NUMA nodes:\n");
+        for (i = 0; i <= MAXNODES; i++) {
+                if (!node[i])
+                        continue;
+                if (i == MAXNODES)
+                        printf("  unknown %10lu MB (%5.1f%%)\n", node[i] >> 20, 100.0 * node[i] / bytes);
+                else
+                        printf("  node %-3d %10lu MB (%5.1f%%)\n", i, node[i] >> 20, 100.0 * node[i] / bytes);
+        }
+
+        return 0;
+}
@@ -3,109 +3,423 @@
 #include <linux/module.h>
 #include <linux/uaccess.h>
 #include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/sched/signal.h>
+#include <linux/seq_file.h>
+#include "dbfs_ring.h"
 
 MODULE_LICENSE("GPL");
 
-static struct dentry *dir, *inputdir, *ptreedir;
-static struct task_struct *curr;
+// Output formats
+#define OUT_TEXT        0       // lines in logs
+#define OUT_BINARY      1       // struct ptree_rec records in logs
+#define OUT_RING        2       // struct ptree_rec records in the mmap-able ring
 
-struct debugfs_blob_wrapper *blob;
-static char *logs;
+#define MAXDEPTH        256     // deeper nodes roll straight into their MAXDEPTH-1 ancestor
+
+// Binary output: one record per process, in the same order as the text
+struct ptree_rec {
+        int pid;
+        int ppid;
+        int depth;
+        int threads;
+        char comm[16];
+        char state;                     // R, S, D, T, Z, ...
+        char pad[3];
+        unsigned int ncpus;             // CPUs in the affinity mask
+        unsigned long cpus;             // affinity mask of CPUs 0-63
+        unsigned long rss;              // bytes
+        unsigned long utime;            // ns, all threads
+        unsigned long stime;            // ns, all threads
+        // This process and all its descendants (subtree mode only)
+        unsigned long tot_procs;
+        unsigned long tot_threads;
+        unsigned long tot_rss;
+        unsigned long tot_utime;
+        unsigned long tot_stime;
+};
 
-struct ptree_node{
-        char* process_command;
-        int process_id;
-        struct ptree_node *next;
+struct ptree_tot {
+        unsigned long procs, threads, rss, utime, stime;
 };
 
-static void free_list(struct ptree_node* head){
-        struct ptree_node *temp;
-        while(head != NULL)
-        {
-                temp = head;
-                head = head->next;
-                kfree(temp);
+// Fixed-width totals field, reserved in each text line and filled in
+// once the node's subtree has been walked
+#define TOT_FMT         "procs=%-6lu thr=%-6lu rss=%-10luK cpu=%-10lums"
+#define TOT_WIDTH       (int)sizeof("procs=000000 thr=000000 rss=0000000000K cpu=0000000000ms")
+
+static struct dentry *dir, *inputdir, *ptreedir, *ringdir;
+
+// Output of the last write, reused (and grown) by the next one
+static char *logs;
+static size_t logs_len, logs_cap;
+static int out;
+static DEFINE_MUTEX(logs_lock);
+
+// Records of "ring" writes; logs_lock also makes us its single producer
+static unsigned int ring_records = 16384;
+module_param(ring_records, uint, 0444);
+static struct dbfs_ring ring;
+
+// Running totals of the nodes on the current DFS path, and where each
+// node's totals go (NULL if its output did not fit). Protected by
+// logs_lock like logs itself.
+static struct {
+        void *at;
+        struct ptree_tot tot;
+} frames[MAXDEPTH];
+
+// Append to logs. Past the end of the buffer nothing is written, but
+// *len still grows, so the caller learns how big the buffer must be.
+static void emit(size_t *len, const char *fmt, ...)
+{
+        va_list args;
+        size_t room = *len < logs_cap ? logs_cap - *len : 0;
+
+        va_start(args, fmt);
+        *len += vsnprintf(room ? logs + *len : NULL, room, fmt, args);
+        va_end(args);
+}
+
+static void emit_bytes(size_t *len, const void *data, size_t size)
+{
+        if (*len + size <= logs_cap)
+                memcpy(logs + *len, data, size);
+        *len += size;
+}
+
+// Snapshot of one process. Only spinlocks are taken, so this is safe
+// inside the walk, under tasklist_lock.
+static void task_stat(struct task_struct *t, struct ptree_rec *rec)
+{
+        struct task_struct *th;
+
+        memset(rec, 0, sizeof(*rec));
+        rec->pid = t->pid;
+        rec->ppid = t->real_parent->pid;
+        rec->threads = get_nr_threads(t);
+        memcpy(rec->comm, t->comm, sizeof(rec->comm));
+        rec->state = task_state_to_char(t);
+        rec->ncpus = cpumask_weight(t->cpus_ptr);
+        rec->cpus = cpumask_bits(t->cpus_ptr)[0];
+
+        task_lock(t);
+        if (t->mm)
+                rec->rss = get_mm_rss(t->mm) << PAGE_SHIFT;
+        task_unlock(t);
+
+        // Threads that already exited are accounted in signal
+        rec->utime = t->signal->utime;
+        rec->stime = t->signal->stime;
+        for_each_thread(t, th) {
+                rec->utime += th->utime;
+                rec->stime += th->stime;
         }
 }
 
-static ssize_t write_pid_to_input(struct file *fp, 
-                                const char __user *user_buffer, 
-                                size_t length, 
+// One line per process:
+// process_command (process_id) state rss cpu threads affinity [subtree totals]
+static void open_task(size_t *len, struct task_struct *t, int depth, int tree)
+{
+        struct ptree_rec rec;
+        void *at = NULL;
+        u64 got;
+
+        task_stat(t, &rec);
+        rec.depth = depth;
+        rec.tot_procs = 1;
+        rec.tot_threads = rec.threads;
+        rec.tot_rss = rec.rss;
+        rec.tot_utime = rec.utime;
+        rec.tot_stime = rec.stime;
+
+        if (out == OUT_RING) {
+                at = dbfs_ring_reserve(&ring, 1, &got);
+                if (at)
+                        memcpy(at, &rec, sizeof(rec));
+        } else if (out == OUT_BINARY) {
+                if (*len + sizeof(rec) <= logs_cap)
+                        at = logs + *len;
+                emit_bytes(len, &rec, sizeof(rec));
+        } else {
+                emit(len, "%*s%s (%d) %c rss=%luK cpu=%lu/%lums thr=%d cpus=%*pbl",
+                     depth * 2, "", rec.comm, rec.pid, rec.state, rec.rss >> 10,
+                     rec.utime / NSEC_PER_MSEC, rec.stime / NSEC_PER_MSEC,
+                     rec.threads, cpumask_pr_args(t->cpus_ptr));
+                if (tree)
+                        emit(len, " [");
+                if (*len + TOT_WIDTH - 1 <= logs_cap)
+                        at = logs + *len;
+                if (tree)
+                        emit(len, "%*s]", TOT_WIDTH - 1, "");
+                emit(len, "\n");
+        }
+        if (!tree)
+                return;
+
+        if (depth < MAXDEPTH) {
+                frames[depth].at = at;
+                frames[depth].tot = (struct ptree_tot){ 1, rec.threads, rec.rss,
+                                                        rec.utime, rec.stime };
+        } else {
+                frames[MAXDEPTH - 1].tot.procs++;
+                frames[MAXDEPTH - 1].tot.threads += rec.threads;
+                frames[MAXDEPTH - 1].tot.rss += rec.rss;
+                frames[MAXDEPTH - 1].tot.utime += rec.utime;
+                frames[MAXDEPTH - 1].tot.stime += rec.stime;
+        }
+}
+
+// The subtree under the node at depth is done: write its totals into its
+// line or record and add them to the parent's
+static void close_task(int depth)
+{
+        struct ptree_tot *tot, *up;
+        struct ptree_rec *rec;
+        char field[TOT_WIDTH];
+
+        if (depth >= MAXDEPTH)
+                return;
+        tot = &frames[depth].tot;
+
+        if (frames[depth].at && out != OUT_TEXT) {
+                rec = frames[depth].at;
+                rec->tot_procs = tot->procs;
+                rec->tot_threads = tot->threads;
+                rec->tot_rss = tot->rss;
+                rec->tot_utime = tot->utime;
+                rec->tot_stime = tot->stime;
+        } else if (frames[depth].at) {
+                snprintf(field, sizeof(field), TOT_FMT, tot->procs, tot->threads,
+                         tot->rss >> 10, (tot->utime + tot->stime) / NSEC_PER_MSEC);
+                memcpy(frames[depth].at, field, strlen(field));
+        }
+
+        if (depth == 0)
+                return;
+        up = &frames[depth - 1].tot;
+        up->procs += tot->procs;
+        up->threads += tot->threads;
+        up->rss += tot->rss;
+        up->utime += tot->utime;
+        up->stime += tot->stime;
+}
+
+// Tracing process tree from curr to init(1) process, init first.
+// The branch is short, so walking it again per line costs nothing and
+// needs no list of nodes.
+static void emit_branch(size_t *len, struct task_struct *curr)
+{
+        struct task_struct *t;
+        int depth, i;
+
+        for (depth = 0, t = curr; t->pid > 1; t = t->real_parent)
+                depth++;
+        for (; depth >= 0; depth--) {
+                for (i = 0, t = curr; i < depth; i++)
+                        t = t->real_parent;
+                open_task(len, t, 0, 0);
+        }
+}
+
+// Depth-first walk of the subtree under root along the children/sibling
+// lists, with the tree itself as the stack: go down to the first child,
+// else to the next sibling, else back up until an ancestor has one.
+// A node is closed, and its totals rolled up, when the walk leaves it.
+static void emit_subtree(size_t *len, struct task_struct *root)
+{
+        struct task_struct *t = root;
+        int depth = 0;
+
+        open_task(len, t, depth, 1);
+        while (1) {
+                if (!list_empty(&t->children)) {
+                        t = list_first_entry(&t->children, struct task_struct, sibling);
+                        open_task(len, t, ++depth, 1);
+                        continue;
+                }
+                close_task(depth);
+                while (t != root && list_is_last(&t->sibling, &t->real_parent->children)) {
+                        t = t->real_parent;
+                        close_task(--depth);
+                }
+                if (t == root)
+                        break;
+                t = list_next_entry(t, sibling);
+                open_task(len, t, depth, 1);
+        }
+}
+
+// Find the task and emit its branch or subtree. The children/sibling
+// lists and real_parent are protected by tasklist_lock, not RCU: exit
+// unlinks and reparents under it, so the walk holds it for reading (no
+// sleeping inside, records go into memory already allocated).
+static int emit_tasks(size_t *len, pid_t pid, int tree)
+{
+        struct task_struct *curr;
+
+        read_lock(&tasklist_lock);
+        rcu_read_lock();
+        curr = pid_task(find_vpid(pid), PIDTYPE_PID);
+        if (curr && tree)
+                emit_subtree(len, curr);
+        else if (curr)
+                emit_branch(len, curr);
+        rcu_read_unlock();
+        read_unlock(&tasklist_lock);
+        return curr != NULL;
+}
+
+static ssize_t write_pid_to_input(struct file *fp,
+                                const char __user *user_buffer,
+                                size_t length,
                                 loff_t *position)
 {
+        char buf[64], word[3][16] = { "", "", "" };
         pid_t input_pid;
-        int size = 0;
-        struct ptree_node *head;
-        struct ptree_node *node;
-        struct ptree_node *temp;
-
-        // user_buffer에 담긴 pid를 읽어들이고 input_pid에 입력
-        sscanf(user_buffer, "%u", &input_pid);
-        
-        // Find task_struct using input_pid. Hint: pid_task
-        curr = pid_task(find_get_pid(input_pid), PIDTYPE_PID);
-
-        // Tracing process tree from input_pid to init(1) process
-        head = (struct ptree_node *) kmalloc(sizeof(struct ptree_node), GFP_KERNEL);
-
-        while(1){
-                // 새로운 ptree_node를 생성해 head에 삽입
-                node = (struct ptree_node *) kmalloc(sizeof(struct ptree_node), GFP_KERNEL);
-
-                node -> process_command = curr -> comm;
-                node -> process_id = curr -> pid;
-                node -> next = head -> next;
-                head -> next = node;
-
-                // curr 업데이트
-                if(curr -> pid == 1) break;
-                curr = curr -> parent;
+        size_t len;
+        char *grown;
+        int ret = length, tree, fmt, found, i;
+
+        // user_buffer에 담긴 "pid [subtree] [binary|ring]"를 읽어들이고 input_pid에 입력
+        if (length >= sizeof(buf))
+                return -EINVAL;
+        if (copy_from_user(buf, user_buffer, length))
+                return -EFAULT;
+        buf[length] = '\0';
+        if (sscanf(buf, "%d %15s %15s %15s", &input_pid, word[0], word[1], word[2]) < 1)
+                return -EINVAL;
+
+        for (i = 0, tree = 0, fmt = OUT_TEXT; i < 3; i++) {
+                if (strcmp(word[i], "subtree") == 0)
+                        tree = 1;
+                else if (strcmp(word[i], "binary") == 0)
+                        fmt = OUT_BINARY;
+                else if (strcmp(word[i], "ring") == 0)
+                        fmt = OUT_RING;
+                else if (word[i][0])
+                        return -EINVAL;
         }
 
-        // Make Output Format string: process_command (process_id)
-        logs = kmalloc(sizeof(char) * 101010, GFP_KERNEL);
+        mutex_lock(&logs_lock);
+        out = fmt;
 
-        temp = head -> next;
+        // Ring: records go straight into the shared pages and are published
+        // together once the totals are in; what does not fit is dropped
+        if (out == OUT_RING) {
+                len = 0;
+                found = emit_tasks(&len, input_pid, tree);
+                dbfs_ring_commit(&ring);
+                mutex_unlock(&logs_lock);
+                return found ? ret : -ESRCH;
+        }
+
+        while (1) {
+                // Walk with tasklist_lock held, writing into the buffer we
+                // already have
+                len = 0;
+                if (!emit_tasks(&len, input_pid, tree)) {
+                        ret = -ESRCH;
+                        len = 0;
+                        break;
+                }
+                if (len < logs_cap)
+                        break;
 
-        while(temp != NULL){
-                // snprintf: https://www.ibm.com/docs/ko/i/7.3?topic=functions-snprintf-print-formatted-data-buffer 참고
-                size += snprintf(logs + size, 64, "%s (%d)\n", temp->process_command, temp->process_id);
-                temp = temp -> next;
+                // Too small: grow outside the lock and walk again
+                grown = kvmalloc(len + len / 2 + PAGE_SIZE, GFP_KERNEL);
+                if (!grown) {
+                        ret = -ENOMEM;
+                        len = 0;
+                        break;
+                }
+                kvfree(logs);
+                logs = grown;
+                logs_cap = len + len / 2 + PAGE_SIZE;
         }
-        blob->data = logs;
-        blob->size = (unsigned long)strlen(logs);
+        logs_len = len;
+        mutex_unlock(&logs_lock);
+
+        return ret;
+}
+
+// The ptree file streams logs one page at a time
+static void *ptree_start(struct seq_file *m, loff_t *pos)
+{
+        mutex_lock(&logs_lock);
+        return (size_t)*pos * PAGE_SIZE < logs_len ? pos : NULL;
+}
+
+static void *ptree_next(struct seq_file *m, void *v, loff_t *pos)
+{
+        ++*pos;
+        return (size_t)*pos * PAGE_SIZE < logs_len ? pos : NULL;
+}
 
-        free_list(head);
+static void ptree_stop(struct seq_file *m, void *v)
+{
+        mutex_unlock(&logs_lock);
+}
+
+static int ptree_show(struct seq_file *m, void *v)
+{
+        size_t off = (size_t)*(loff_t *)v * PAGE_SIZE;
+
+        seq_write(m, logs + off, min_t(size_t, PAGE_SIZE, logs_len - off));
+        return 0;
+}
 
-        return length;
+static const struct seq_operations ptree_seq_ops = {
+        .start = ptree_start,
+        .next = ptree_next,
+        .stop = ptree_stop,
+        .show = ptree_show,
+};
+
+static int open_ptree(struct inode *inode, struct file *fp)
+{
+        return seq_open(fp, &ptree_seq_ops);
 }
 
 static const struct file_operations dbfs_fops = {
         .write = write_pid_to_input,
 };
 
+static const struct file_operations ptree_fops = {
+        .open = open_ptree,
+        .read = seq_read,
+        .llseek = seq_lseek,
+        .release = seq_release,
+};
+
 static int __init dbfs_module_init(void)
 {
         // Implement init module code
 
+        if (dbfs_ring_init(&ring, sizeof(struct ptree_rec), ring_records)) {
+                printk("Cannot allocate ptree ring\n");
+                return -ENOMEM;
+        }
+
         dir = debugfs_create_dir("ptree", NULL);
-        
+
         if (!dir) {
                 printk("Cannot create ptree dir\n");
+                dbfs_ring_free(&ring);
                 return -1;
         }
         // struct dentry* debugfs_create_file(const char *name, umode_t mode, struct dentry *parent, void *data, const struct file_operations *fops)
         // S_IWUSR: 쓰기 권한
         inputdir = debugfs_create_file("input", S_IWUSR, dir, NULL, &dbfs_fops);
 
-        // Blob (Binary Large Object) 메모리 할당
-        // kmalloc: kernel malloc
-        blob = (struct debugfs_blob_wrapper *)kmalloc(sizeof(struct debugfs_blob_wrapper), GFP_KERNEL);
-
-        // struct dentry* debufgs_create_blob(const char *name, umode_t mode, struct dentry *parent, struct debugfs_blob_wrapper *blob);
         // S_IRUSR: 읽기 권한
-        ptreedir = debugfs_create_blob("ptree", S_IRUSR, dir, blob); // Find suitable debugfs API
-	
+        ptreedir = debugfs_create_file("ptree", S_IRUSR, dir, NULL, &ptree_fops);
+
+        // mmap-able ring for "ring" writes; _unsafe because debugfs's proxy
+        // fops have no ->mmap (see dbfs_ring.h)
+        ringdir = debugfs_create_file_unsafe("ring", S_IRUSR | S_IWUSR, dir, &ring, &dbfs_ring_fops);
+
 	printk("dbfs_ptree module initialize done\n");
 
         return 0;
@@ -114,14 +428,14 @@ static int __init dbfs_module_init(void)
 static void __exit dbfs_module_exit(void)
 {
         // Implement exit module code
-        
-        // // Free kmalloc'd object
-        kfree(logs);
-        kfree(blob);
 
         // struct dentry* debufgs_remove_recursive(struct dentry *dentry)
         debugfs_remove_recursive(dir);
-	
+
+        // Free the output buffers
+        kvfree(logs);
+        dbfs_ring_free(&ring);
+
 	printk("dbfs_ptree module exit\n");
 }
 
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include "dbfs_ring.h"
+
+#define DBFS_INPUT_PATH "/sys/kernel/debug/ptree/input"
+#define DBFS_PTREE_PATH "/sys/kernel/debug/ptree/ptree"
+#define DBFS_RING_PATH  "/sys/kernel/debug/ptree/ring"
+#define MAXRECS         (1 << 16)
+
+struct ptree_rec {
+        int pid;
+        int ppid;
+        int depth;
+        int threads;
+        char comm[16];
+        char state;
+        char pad[3];
+        unsigned int ncpus;
+        unsigned long cpus;
+        unsigned long rss;
+        unsigned long utime;
+        unsigned long stime;
+        unsigned long tot_procs;
+        unsigned long tot_threads;
+        unsigned long tot_rss;
+        unsigned long tot_utime;
+        unsigned long tot_stime;
+};
+
+static struct ptree_rec cur[MAXRECS], prev[MAXRECS];
+static struct dbfs_ring_user ring;
+static int use_ring;
+
+// Takes one binary subtree snapshot of pid, returns the number of records.
+// With the ring, the records are copied out of the shared pages; the
+// module has published all of them by the time write() returns.
+static int snapshot(const char *pid, struct ptree_rec *recs)
+{
+        char cmd[64];
+        ssize_t n, total = 0;
+        struct ptree_rec *r;
+        int fd;
+
+        snprintf(cmd, sizeof(cmd), "%s subtree %s", pid, use_ring ? "ring" : "binary");
+        fd = open(DBFS_INPUT_PATH, O_WRONLY);
+        if (fd < 0 || write(fd, cmd, strlen(cmd)) < 0) {
+                printf("debugfs input write failed (is dbfs_ptree loaded? does %s exist?)\n", pid);
+                exit(-1);
+        }
+        close(fd);
+
+        if (use_ring) {
+                for (n = 0; (r = dbfs_ring_peek(&ring)) != NULL; dbfs_ring_consume(&ring))
+                        if (n < MAXRECS)
+                                recs[n++] = *r;
+                return n;
+        }
+
+        fd = open(DBFS_PTREE_PATH, O_RDONLY);
+        if (fd < 0) {
+                printf("debugfs ptree file open error\n");
+                exit(-1);
+        }
+        while (total < (ssize_t)sizeof(cur) &&
+               (n = read(fd, (char *)recs + total, sizeof(cur) - total)) > 0)
+                total += n;
+        close(fd);
+
+        return total / sizeof(struct ptree_rec);
+}
+
+static unsigned long cputime(struct ptree_rec *rec, int pid, int n)
+{
+        int i;
+
+        for (i = 0; i < n; i++)
+                if (rec[i].pid == pid)
+                        return rec[i].tot_utime + rec[i].tot_stime;
+        return 0;
+}
+
+// usage: ptop <pid> [interval]
+// Every interval seconds (default 1), prints each child subtree of pid
+// with its process count, memory and share of a CPU since the last poll.
+int main(int argc, char **argv)
+{
+        int interval = argc > 2 ? atoi(argv[2]) : 1;
+        int n, np, i;
+        long used;
+
+        if (argc < 2 || interval <= 0) {
+                printf("usage: %s <pid> [interval]\n", argv[0]);
+                exit(-1);
+        }
+
+        // The ring saves the read() copies; fall back to the ptree file
+        use_ring = dbfs_ring_open(&ring, DBFS_RING_PATH) == 0;
+        if (use_ring)
+                while (dbfs_ring_peek(&ring))
+                        dbfs_ring_consume(&ring);
+
+        np = snapshot(argv[1], prev);
+        while (1) {
+                sleep(interval);
+                n = snapshot(argv[1], cur);
+
+                printf("%-16s %7s %6s %7s %10s %6s\n", "subtree", "pid", "procs",
+                       "threads", "rss(MB)", "cpu%");
+                for (i = 0; i < n; i++) {
+                        if (cur[i].depth > 1)
+                                continue;
+                        used = cur[i].tot_utime + cur[i].tot_stime -
+                               cputime(prev, cur[i].pid, np);
+                        // Children that exited take their time out of the subtree
+                        if (used < 0)
+                                used = 0;
+                        printf("%-16s %7d %6lu %7lu %10lu %6.1f\n", cur[i].comm,
+                               cur[i].pid, cur[i].tot_procs, cur[i].tot_threads,
+                               cur[i].tot_rss >> 20, 100.0 * used / (interval * 1e9));
+                }
+                printf("\n");
+
+                memcpy(prev, cur, n * sizeof(struct ptree_rec));
+                np = n;
+        }
+
+        return 0;
+}
@@ -0,0 +1,547 @@
+#include <linux/debugfs.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/uaccess.h>
+#include <linux/mm.h>
+#include <linux/sched/mm.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/random.h>
+#include <linux/ktime.h>
+#include <linux/seq_file.h>
+#include <asm/pgtable.h>
+#include <linux/pgtable.h>
+#include <asm/processor.h>
+#include <asm/tsc.h>
+
+MODULE_LICENSE("GPL");
+
+// Page table levels, top first
+#define LV_PGD          0
+#define LV_P4D          1
+#define LV_PUD          2
+#define LV_PMD          3
+#define LV_PTE          4
+#define NLEVELS         5
+
+// Leaf sizes: 4KB (pte), 2MB (pmd), 1GB (pud)
+#define SZ_4K           0
+#define SZ_2M           1
+#define SZ_1G           2
+#define NSIZES          3
+
+#define HIST_BUCKETS    24      // walk time buckets, log2 cycles
+
+// STLB sizes used when CPUID does not report them; 0 = detect
+static unsigned int tlb_4k, tlb_2m, tlb_1g;
+module_param(tlb_4k, uint, 0644);
+module_param(tlb_2m, uint, 0644);
+module_param(tlb_1g, uint, 0644);
+
+// Leaves timed per measurement, picked uniformly from all leaves
+static unsigned int walk_samples = 65536;
+module_param(walk_samples, uint, 0644);
+
+static const char * const lv_name[NLEVELS] = { "pgd", "p4d", "pud", "pmd", "pte" };
+static const char * const sz_name[NSIZES] = { "4K", "2M", "1G" };
+static const unsigned long sz_bytes[NSIZES] = { PAGE_SIZE, PMD_SIZE, PUD_SIZE };
+
+// Result of the last write to pid
+struct pt_stat {
+        pid_t pid;
+        unsigned long tables[NLEVELS];          // tables of this level
+        unsigned long entries[NLEVELS];         // present entries in them
+        unsigned long leaves[NSIZES];           // present leaves by size
+        unsigned long tlb[NSIZES];              // STLB entries by page size
+        const char *tlb_source;                 // "cpuid", "param" or "none"
+        u64 scan_ns;                            // ktime of the full scan
+        u64 walk_ns;                            // ktime of all timed walks
+        unsigned long nwalks[NSIZES];           // timed walks by leaf size
+        u64 cycles[NSIZES];                     // rdtsc total by leaf size
+        unsigned long hist[NSIZES][HIST_BUCKETS];
+};
+
+// Sampling state of a scan
+struct sampler {
+        unsigned long *addr;    // walk_samples slots
+        unsigned long n;        // slots filled
+        unsigned long seen;     // leaves offered
+};
+
+static struct dentry *dir;
+static struct pt_stat ptstat;
+static DEFINE_MUTEX(stat_lock);
+
+// Reservoir sampling, so every leaf is equally likely to be timed
+static void sample(struct sampler *s, unsigned long addr)
+{
+        unsigned long j;
+
+        s->seen++;
+        if (s->n < walk_samples) {
+                s->addr[s->n++] = addr;
+                return;
+        }
+        j = get_random_u32() % s->seen;
+        if (j < walk_samples)
+                s->addr[j] = addr;
+}
+
+static void scan_pte(struct pt_stat *st, struct sampler *s, pmd_t *pmd,
+                     unsigned long addr, unsigned long end)
+{
+        pte_t *pte, *ptep;
+
+        // pte_offset_map fails if the table was freed under us
+        if (!(pte = pte_offset_map(pmd, addr)))
+                return;
+        for (ptep = pte; addr < end; addr += PAGE_SIZE, ptep++) {
+                if (!pte_present(*ptep))
+                        continue;
+                st->entries[LV_PTE]++;
+                st->leaves[SZ_4K]++;
+                sample(s, addr);
+        }
+        pte_unmap(pte);
+}
+
+static void scan_pmd(struct pt_stat *st, struct sampler *s, pud_t *pud,
+                     unsigned long addr, unsigned long end)
+{
+        unsigned long next;
+        pmd_t *pmd, pmdv;
+
+        pmd = pmd_offset(pud, addr);
+        do {
+                next = pmd_addr_end(addr, end);
+                pmdv = READ_ONCE(*pmd);
+                if (pmd_none(pmdv) || !pmd_present(pmdv))
+                        continue;
+                st->entries[LV_PMD]++;
+                if (pmd_leaf(pmdv)) {
+                        st->leaves[SZ_2M]++;
+                        sample(s, addr);
+                } else if (!pmd_bad(pmdv)) {
+                        st->tables[LV_PTE]++;
+                        scan_pte(st, s, pmd, addr, next);
+                }
+        } while (pmd++, addr = next, addr != end);
+}
+
+static void scan_pud(struct pt_stat *st, struct sampler *s, p4d_t *p4d,
+                     unsigned long addr, unsigned long end)
+{
+        unsigned long next;
+        pud_t *pud, pudv;
+
+        pud = pud_offset(p4d, addr);
+        do {
+                next = pud_addr_end(addr, end);
+                pudv = READ_ONCE(*pud);
+                if (pud_none(pudv) || !pud_present(pudv))
+                        continue;
+                st->entries[LV_PUD]++;
+                if (pud_leaf(pudv)) {
+                        st->leaves[SZ_1G]++;
+                        sample(s, addr);
+                } else if (!pud_bad(pudv)) {
+                        st->tables[LV_PMD]++;
+                        scan_pmd(st, s, pud, addr, next);
+                }
+                cond_resched();
+        } while (pud++, addr = next, addr != end);
+}
+
+// Count every table and present entry of the user half of mm, level by
+// level. Walks the tables rather than the VMAs, so a table shared by two
+// VMAs is counted once. Called with the mmap read lock held.
+static void scan_mm(struct pt_stat *st, struct sampler *s, struct mm_struct *mm)
+{
+        unsigned long addr = 0, end = TASK_SIZE, next, p4next;
+        pgd_t *pgd;
+        p4d_t *p4d;
+
+        st->tables[LV_PGD] = 1;
+        pgd = pgd_offset(mm, addr);
+        do {
+                next = pgd_addr_end(addr, end);
+                if (pgd_none(*pgd) || pgd_bad(*pgd))
+                        continue;
+                st->entries[LV_PGD]++;
+
+                // With 4-level paging the p4d is folded into the pgd
+                st->tables[LV_P4D]++;
+                p4d = p4d_offset(pgd, addr);
+                do {
+                        p4next = p4d_addr_end(addr, next);
+                        if (p4d_none(*p4d) || p4d_bad(*p4d))
+                                continue;
+                        st->entries[LV_P4D]++;
+                        st->tables[LV_PUD]++;
+                        scan_pud(st, s, p4d, addr, p4next);
+                } while (p4d++, addr = p4next, addr != next);
+        } while (pgd++, addr = next, addr != end);
+}
+
+// Full walk from the pgd for one address; returns the leaf size or -1
+static int walk_addr(struct mm_struct *mm, unsigned long vaddr)
+{
+        pgd_t *pgd;
+        p4d_t *p4d;
+        pud_t *pud, pudv;
+        pmd_t *pmd, pmdv;
+        pte_t *pte, ptev;
+
+        pgd = pgd_offset(mm, vaddr);
+        if (pgd_none(*pgd) || pgd_bad(*pgd))
+                return -1;
+        p4d = p4d_offset(pgd, vaddr);
+        if (p4d_none(*p4d) || p4d_bad(*p4d))
+                return -1;
+        pud = pud_offset(p4d, vaddr);
+        pudv = READ_ONCE(*pud);
+        if (pud_none(pudv) || !pud_present(pudv))
+                return -1;
+        if (pud_leaf(pudv))
+                return SZ_1G;
+        pmd = pmd_offset(pud, vaddr);
+        pmdv = READ_ONCE(*pmd);
+        if (pmd_none(pmdv) || !pmd_present(pmdv))
+                return -1;
+        if (pmd_leaf(pmdv))
+                return SZ_2M;
+        if (!(pte = pte_offset_map(pmd, vaddr)))
+                return -1;
+        ptev = *pte;
+        pte_unmap(pte);
+        return pte_present(ptev) ? SZ_4K : -1;
+}
+
+// Time a full software walk of each sampled address
+static void time_walks(struct pt_stat *st, struct sampler *s, struct mm_struct *mm)
+{
+        unsigned long i;
+        u64 start, t0, t1;
+        int sz, b;
+
+        start = ktime_get_ns();
+        for (i = 0; i < s->n; i++) {
+                t0 = rdtsc_ordered();
+                sz = walk_addr(mm, s->addr[i]);
+                t1 = rdtsc_ordered();
+                if (sz < 0)
+                        continue;
+                b = min(fls64(t1 - t0), HIST_BUCKETS - 1);
+                st->hist[sz][b]++;
+                st->nwalks[sz]++;
+                st->cycles[sz] += t1 - t0;
+        }
+        st->walk_ns = ktime_get_ns() - start;
+}
+
+// Keep the TLB of the highest level seen for size sz, the larger of two
+// at the same level
+static void tlb_take(unsigned long *tlb, unsigned int *best, int sz,
+                     unsigned int level, unsigned long entries)
+{
+        if (level > best[sz]) {
+                best[sz] = level;
+                tlb[sz] = entries;
+        } else if (level == best[sz]) {
+                tlb[sz] = max(tlb[sz], entries);
+        }
+}
+
+// Entries of the largest data (or unified) TLB that holds each page size.
+// Intel reports them in CPUID leaf 0x18, AMD in 0x80000006/0x80000019.
+static void tlb_detect(unsigned long *tlb)
+{
+        unsigned int a, b, c, d, i, n, level, best[NSIZES] = { 0 };
+        unsigned long entries;
+
+        memset(tlb, 0, NSIZES * sizeof(*tlb));
+
+        if (boot_cpu_data.x86_vendor == X86_VENDOR_INTEL &&
+            boot_cpu_data.cpuid_level >= 0x18) {
+                cpuid_count(0x18, 0, &n, &b, &c, &d);
+                for (i = 0; i <= n; i++) {
+                        cpuid_count(0x18, i, &a, &b, &c, &d);
+                        // type: 1 data, 3 unified
+                        if ((d & 0x1f) != 1 && (d & 0x1f) != 3)
+                                continue;
+                        level = (d >> 5) & 0x7;
+                        entries = ((b >> 16) & 0xffff) * (unsigned long)c;
+                        if (b & 0x1)
+                                tlb_take(tlb, best, SZ_4K, level, entries);
+                        if (b & 0x2)
+                                tlb_take(tlb, best, SZ_2M, level, entries);
+                        if (b & 0x8)
+                                tlb_take(tlb, best, SZ_1G, level, entries);
+                }
+        } else if ((boot_cpu_data.x86_vendor == X86_VENDOR_AMD ||
+                    boot_cpu_data.x86_vendor == X86_VENDOR_HYGON) &&
+                   boot_cpu_data.extended_cpuid_level >= 0x80000006) {
+                cpuid(0x80000006, &a, &b, &c, &d);
+                tlb[SZ_4K] = (b >> 16) & 0xfff;
+                tlb[SZ_2M] = (a >> 16) & 0xfff;
+                if (boot_cpu_data.extended_cpuid_level >= 0x80000019) {
+                        cpuid(0x80000019, &a, &b, &c, &d);
+                        tlb[SZ_1G] = (b >> 16) & 0xfff;
+                }
+        }
+}
+
+// Measure pid into stat
+static int measure(pid_t pid)
+{
+        struct pt_stat *st = &ptstat;
+        struct sampler s = { 0 };
+        struct task_struct *t;
+        struct mm_struct *mm;
+        struct pid *p;
+        u64 start;
+
+        p = find_get_pid(pid);
+        t = p ? get_pid_task(p, PIDTYPE_PID) : NULL;
+        put_pid(p);
+        if (!t)
+                return -ESRCH;
+        mm = get_task_mm(t);
+        put_task_struct(t);
+        if (!mm)
+                return -EINVAL;
+
+        s.addr = kvmalloc_array(max(walk_samples, 1U), sizeof(*s.addr), GFP_KERNEL);
+        if (!s.addr) {
+                mmput(mm);
+                return -ENOMEM;
+        }
+
+        memset(st, 0, sizeof(*st));
+        st->pid = pid;
+
+        mmap_read_lock(mm);
+        start = ktime_get_ns();
+        scan_mm(st, &s, mm);
+        st->scan_ns = ktime_get_ns() - start;
+        time_walks(st, &s, mm);
+        mmap_read_unlock(mm);
+        mmput(mm);
+        kvfree(s.addr);
+
+        // Module parameters override what the CPU reports
+        tlb_detect(st->tlb);
+        st->tlb_source = st->tlb[SZ_4K] ? "cpuid" : "none";
+        if (tlb_4k || tlb_2m || tlb_1g) {
+                st->tlb[SZ_4K] = tlb_4k;
+                st->tlb[SZ_2M] = tlb_2m;
+                st->tlb[SZ_1G] = tlb_1g;
+                st->tlb_source = "param";
+        }
+        return 0;
+}
+
+static ssize_t write_pid(struct file *fp,
+                        const char __user *user_buffer,
+                        size_t length,
+                        loff_t *position)
+{
+        int pid, ret;
+
+        ret = kstrtoint_from_user(user_buffer, length, 10, &pid);
+        if (ret)
+                return ret;
+
+        mutex_lock(&stat_lock);
+        ret = measure(pid);
+        mutex_unlock(&stat_lock);
+
+        return ret ? ret : length;
+}
+
+// levels: tables and present entries per level, and the leaves among them
+static int show_levels(struct seq_file *m, void *v)
+{
+        int lv;
+
+        mutex_lock(&stat_lock);
+        seq_printf(m, "pid %d\n", ptstat.pid);
+        seq_printf(m, "%-6s %12s %12s %12s\n", "level", "tables", "entries", "leaves");
+        for (lv = 0; lv < NLEVELS; lv++)
+                seq_printf(m, "%-6s %12lu %12lu %12lu\n", lv_name[lv], ptstat.tables[lv],
+                           ptstat.entries[lv],
+                           lv == LV_PUD ? ptstat.leaves[SZ_1G] :
+                           lv == LV_PMD ? ptstat.leaves[SZ_2M] :
+                           lv == LV_PTE ? ptstat.leaves[SZ_4K] : 0);
+        mutex_unlock(&stat_lock);
+        return 0;
+}
+
+static unsigned long resident(void)
+{
+        unsigned long total = 0;
+        int sz;
+
+        for (sz = 0; sz < NSIZES; sz++)
+                total += ptstat.leaves[sz] * sz_bytes[sz];
+        return total;
+}
+
+// percent of whole with one decimal, as tenths
+static unsigned long permille(unsigned long part, unsigned long whole)
+{
+        return whole ? div64_u64((u64)part * 1000, whole) : 0;
+}
+
+// coverage: resident memory by the size of the mapping that covers it
+static int show_coverage(struct seq_file *m, void *v)
+{
+        unsigned long total, bytes, pm;
+        int sz;
+
+        mutex_lock(&stat_lock);
+        total = resident();
+        seq_printf(m, "pid %d\n", ptstat.pid);
+        seq_printf(m, "%-6s %12s %16s %8s\n", "size", "mappings", "bytes", "percent");
+        for (sz = 0; sz < NSIZES; sz++) {
+                bytes = ptstat.leaves[sz] * sz_bytes[sz];
+                pm = permille(bytes, total);
+                seq_printf(m, "%-6s %12lu %16lu %6lu.%lu\n", sz_name[sz],
+                           ptstat.leaves[sz], bytes, pm / 10, pm % 10);
+        }
+        seq_printf(m, "%-6s %12lu %16lu %6u.0\n", "total",
+                   ptstat.leaves[SZ_4K] + ptstat.leaves[SZ_2M] + ptstat.leaves[SZ_1G],
+                   total, total ? 100 : 0);
+        mutex_unlock(&stat_lock);
+        return 0;
+}
+
+// tlb: how much of the resident memory the STLB can map at once. Each
+// mapping needs one entry of its size; sizes are counted as separate
+// structures, so with a shared 4K/2M STLB this is an upper bound.
+static int show_tlb(struct seq_file *m, void *v)
+{
+        unsigned long total, reach = 0, covered, pm;
+        int sz;
+
+        mutex_lock(&stat_lock);
+        total = resident();
+        seq_printf(m, "pid %d\n", ptstat.pid);
+        seq_printf(m, "source %s\n", ptstat.tlb_source);
+        seq_printf(m, "%-6s %12s %12s %16s %16s\n", "size", "needed", "tlb_entries",
+                   "reach_bytes", "covered_bytes");
+        for (sz = 0; sz < NSIZES; sz++) {
+                covered = min(ptstat.leaves[sz], ptstat.tlb[sz]) * sz_bytes[sz];
+                reach += covered;
+                seq_printf(m, "%-6s %12lu %12lu %16lu %16lu\n", sz_name[sz],
+                           ptstat.leaves[sz], ptstat.tlb[sz],
+                           ptstat.tlb[sz] * sz_bytes[sz], covered);
+        }
+        pm = permille(reach, total);
+        seq_printf(m, "resident_bytes %lu\n", total);
+        seq_printf(m, "reach_bytes %lu\n", reach);
+        seq_printf(m, "reach_percent %lu.%lu\n", pm / 10, pm % 10);
+        mutex_unlock(&stat_lock);
+        return 0;
+}
+
+// walk: cost of the software walk, whole-scan and per sampled address
+static int show_walk(struct seq_file *m, void *v)
+{
+        unsigned long n, entries = 0;
+        int sz, b, lv;
+
+        mutex_lock(&stat_lock);
+        for (lv = 0; lv < NLEVELS; lv++)
+                entries += ptstat.entries[lv];
+        n = ptstat.nwalks[SZ_4K] + ptstat.nwalks[SZ_2M] + ptstat.nwalks[SZ_1G];
+
+        seq_printf(m, "pid %d\n", ptstat.pid);
+        seq_printf(m, "scan_ns %llu\n", ptstat.scan_ns);
+        seq_printf(m, "scan_ns_per_entry %llu\n", entries ? div64_u64(ptstat.scan_ns, entries) : 0);
+        seq_printf(m, "walks %lu\n", n);
+        seq_printf(m, "walk_ns %llu\n", ptstat.walk_ns);
+        seq_printf(m, "walk_ns_per_walk %llu\n", n ? div64_u64(ptstat.walk_ns, n) : 0);
+        for (sz = 0; sz < NSIZES; sz++)
+                seq_printf(m, "cycles_per_walk_%s %llu\n", sz_name[sz],
+                           ptstat.nwalks[sz] ? div64_u64(ptstat.cycles[sz], ptstat.nwalks[sz]) : 0);
+
+        // Bucket b counts walks of [2^(b-1), 2^b) cycles
+        seq_printf(m, "%-10s %12s %12s %12s\n", "cycles<", sz_name[SZ_4K],
+                   sz_name[SZ_2M], sz_name[SZ_1G]);
+        for (b = 0; b < HIST_BUCKETS; b++) {
+                if (!ptstat.hist[SZ_4K][b] && !ptstat.hist[SZ_2M][b] && !ptstat.hist[SZ_1G][b])
+                        continue;
+                seq_printf(m, "%-10lu %12lu %12lu %12lu\n", 1UL << b, ptstat.hist[SZ_4K][b],
+                           ptstat.hist[SZ_2M][b], ptstat.hist[SZ_1G][b]);
+        }
+        mutex_unlock(&stat_lock);
+        return 0;
+}
+
+static int open_levels(struct inode *inode, struct file *fp)
+{
+        return single_open(fp, show_levels, NULL);
+}
+
+static int open_coverage(struct inode *inode, struct file *fp)
+{
+        return single_open(fp, show_coverage, NULL);
+}
+
+static int open_tlb(struct inode *inode, struct file *fp)
+{
+        return single_open(fp, show_tlb, NULL);
+}
+
+static int open_walk(struct inode *inode, struct file *fp)
+{
+        return single_open(fp, show_walk, NULL);
+}
+
+static const struct file_operations pid_fops = {
+        .write = write_pid,
+};
+
+#define SEQ_FOPS(name) \
+static const struct file_operations name##_fops = { \
+        .open = open_##name, \
+        .read = seq_read, \
+        .llseek = seq_lseek, \
+        .release = single_release, \
+}
+
+SEQ_FOPS(levels);
+SEQ_FOPS(coverage);
+SEQ_FOPS(tlb);
+SEQ_FOPS(walk);
+
+static int __init dbfs_module_init(void)
+{
+        dir = debugfs_create_dir("ptstat", NULL);
+        if (!dir) {
+                printk("Cannot create ptstat dir\n");
+                return -1;
+        }
+
+        // Writing a pid measures it; the other files show the result
+        debugfs_create_file("pid", S_IWUSR, dir, NULL, &pid_fops);
+        debugfs_create_file("levels", S_IRUSR, dir, NULL, &levels_fops);
+        debugfs_create_file("coverage", S_IRUSR, dir, NULL, &coverage_fops);
+        debugfs_create_file("tlb", S_IRUSR, dir, NULL, &tlb_fops);
+        debugfs_create_file("walk", S_IRUSR, dir, NULL, &walk_fops);
+
+	printk("dbfs_ptstat module initialize done\n");
+
+        return 0;
+}
+
+static void __exit dbfs_module_exit(void)
+{
+        debugfs_remove_recursive(dir);
+
+	printk("dbfs_ptstat module exit\n");
+}
+
+module_init(dbfs_module_init);
+module_exit(dbfs_module_exit);